@@ -56,6 +56,12 @@ Bool bar_record_values = False;
 //! Data is copied to/from shadow memory via this buffer of 2x V256.
 V256* dg_bar_shadow_mem_buffer;
 
+//! Use the slots layout of shadow memory (--shadow-layout=slots).
+Bool bar_shadow_slots = False;
+
+//! Use 4-byte indices in a single shadow layer (--index-bits=32).
+Bool bar_index32 = False;
+
 #define dg_rounding_mode IRExpr_Const(IRConst_U32(0))
 
 /* --- Define ExpressionHandling. --- */
@@ -115,10 +121,113 @@ void dg_bar_x86g_amd64g_dirtyhelper_store(Addr addr, ULong size){
  *  \param size Number of bytes per layer to be copied.
  */
 void dg_bar_x86g_amd64g_dirtyhelper_load(Addr addr, ULong size){
-  dg_bar_shadowGet((void*)addr,dg_bar_shadow_mem_buffer,dg_bar_shadow_mem_buffer+1,size);
+  dg_bar_shadowGet((void*)addr,dg_bar_shadow_mem_buffer,bar_index32 ? NULL : dg_bar_shadow_mem_buffer+1,size);
+}
+
+/*! \page shadow_layout_slots Slots layout of shadow memory
+ *
+ *  With --shadow-layout=slots, the lower and higher layer of the shadow of
+ *  every 8-byte slot of client memory are stored next to each other. For
+ *  most loads and stores, the instrumented code obtains a pointer into
+ *  shadow memory from a cheap dirty call, and accesses both layers directly
+ *  from there, instead of copying them through dg_bar_shadow_mem_buffer.
+ *  Shadow data of bytes 8k..8k+7 of the access is found at offset 16k (lower
+ *  layer) and 16k+8 (higher layer) from that pointer.
+ */
+
+//! Whether the slots layout has a direct access path for shadow data of this type.
+static Bool dg_bar_slots_supported(IRType type){
+  switch(type){
+    case Ity_I8: case Ity_I16: case Ity_I32: case Ity_I64:
+    case Ity_F32: case Ity_F64: case Ity_V128: case Ity_V256:
+      return True;
+    default:
+      return False;
+  }
+}
+
+//! Address expression ptr+offset.
+static IRExpr* dg_bar_slots_addr(IRTemp ptr, ULong offset){
+  #ifdef BUILD_32BIT
+  return IRExpr_Binop(Iop_Add32,IRExpr_RdTmp(ptr),IRExpr_Const(IRConst_U32(offset)));
+  #else
+  return IRExpr_Binop(Iop_Add64,IRExpr_RdTmp(ptr),IRExpr_Const(IRConst_U64(offset)));
+  #endif
+}
+
+//! Load shadow data of one layer of the given type, starting at ptr+offset.
+static IRExpr* dg_bar_slots_load_layer(DiffEnv* diffenv, IRTemp ptr, ULong offset, IRType type){
+  IRExpr* q[4];
+  int n;
+  switch(type){
+    case Ity_V128: n = 2; break;
+    case Ity_V256: n = 4; break;
+    default: return IRExpr_Load(Iend_LE,type,dg_bar_slots_addr(ptr,offset));
+  }
+  for(int i=0; i<n; i++){
+    IRTemp t = newIRTemp(diffenv->sb_out->tyenv,Ity_I64);
+    addStmtToIRSB(diffenv->sb_out,IRStmt_WrTmp(t,IRExpr_Load(Iend_LE,Ity_I64,dg_bar_slots_addr(ptr,offset+16*i))));
+    q[i] = IRExpr_RdTmp(t);
+  }
+  if(type==Ity_V128) return IRExpr_Binop(Iop_64HLtoV128,q[1],q[0]);
+  else return IRExpr_Qop(Iop_64x4toV256,q[3],q[2],q[1],q[0]);
+}
+
+//! Store shadow data of one layer, starting at ptr+offset.
+static void dg_bar_slots_store_layer(DiffEnv* diffenv, IRTemp ptr, ULong offset, IRExpr* expr){
+  IRType type = typeOfIRExpr(diffenv->sb_out->tyenv,expr);
+  if(type==Ity_V128){
+    addStmtToIRSB(diffenv->sb_out,IRStmt_Store(Iend_LE,dg_bar_slots_addr(ptr,offset),IRExpr_Unop(Iop_V128to64,expr)));
+    addStmtToIRSB(diffenv->sb_out,IRStmt_Store(Iend_LE,dg_bar_slots_addr(ptr,offset+16),IRExpr_Unop(Iop_V128HIto64,expr)));
+  } else if(type==Ity_V256){
+    IROp parts[4] = {Iop_V256to64_0,Iop_V256to64_1,Iop_V256to64_2,Iop_V256to64_3};
+    for(int i=0; i<4; i++)
+      addStmtToIRSB(diffenv->sb_out,IRStmt_Store(Iend_LE,dg_bar_slots_addr(ptr,offset+16*i),IRExpr_Unop(parts[i],expr)));
+  } else {
+    addStmtToIRSB(diffenv->sb_out,IRStmt_Store(Iend_LE,dg_bar_slots_addr(ptr,offset),expr));
+  }
+}
+
+/*! Emit a dirty call returning the pointer into shadow memory in the slots layout.
+ */
+static IRTemp dg_bar_slots_ptr(DiffEnv* diffenv, IRExpr* addr, ULong size, Bool write){
+  #ifdef BUILD_32BIT
+  IRTemp ptr = newIRTemp(diffenv->sb_out->tyenv,Ity_I32);
+  #else
+  IRTemp ptr = newIRTemp(diffenv->sb_out->tyenv,Ity_I64);
+  #endif
+  IRDirty* dd;
+  if(write)
+    dd = unsafeIRDirty_1_N(ptr, 0, "dg_bar_shadowPtrWrite", &dg_bar_shadowPtrWrite,
+          mkIRExprVec_2(addr,IRExpr_Const(IRConst_U64(size))));
+  else
+    dd = unsafeIRDirty_1_N(ptr, 0, "dg_bar_shadowPtrRead", &dg_bar_shadowPtrRead,
+          mkIRExprVec_2(addr,IRExpr_Const(IRConst_U64(size))));
+  addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(dd));
+  return ptr;
 }
 
 void dg_bar_store(DiffEnv* diffenv, IRExpr* addr, void* expr, IRExpr* guard){
+  if(bar_shadow_slots && !guard){
+    IRType type = typeOfIRExpr(diffenv->sb_out->tyenv, ((IRExpr**)expr)[0]);
+    if(dg_bar_slots_supported(type)){
+      ULong size = sizeofIRType(type);
+      IRTemp ptr = dg_bar_slots_ptr(diffenv,addr,size,True);
+      dg_bar_slots_store_layer(diffenv,ptr,0,((IRExpr**)expr)[0]);
+      dg_bar_slots_store_layer(diffenv,ptr,8,((IRExpr**)expr)[1]);
+      // if the access did not fit into a leaf, the data went to the scratch buffer
+      IRDirty* dd = unsafeIRDirty_0_N(
+            0, "dg_bar_shadowScatter", &dg_bar_shadowScatter,
+            mkIRExprVec_2(addr,IRExpr_Const(IRConst_U64(size))) );
+      #ifdef BUILD_32BIT
+      dd->guard = IRExpr_Binop(Iop_CmpEQ32,IRExpr_RdTmp(ptr),IRExpr_Const(IRConst_U32(dg_bar_shadowScratch())));
+      #else
+      dd->guard = IRExpr_Binop(Iop_CmpEQ64,IRExpr_RdTmp(ptr),IRExpr_Const(IRConst_U64(dg_bar_shadowScratch())));
+      #endif
+      addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(dd));
+      return;
+    }
+  }
   #ifdef BUILD_32BIT
   IRExpr* buffer_addr_Lo = IRExpr_Const(IRConst_U32((Addr)dg_bar_shadow_mem_buffer));
   IRExpr* buffer_addr_Hi = IRExpr_Const(IRConst_U32((Addr)(dg_bar_shadow_mem_buffer+1)));
@@ -127,7 +236,8 @@ void dg_bar_store(DiffEnv* diffenv, IRExpr* addr, void* expr, IRExpr* guard){
   IRExpr* buffer_addr_Hi = IRExpr_Const(IRConst_U64((Addr)(dg_bar_shadow_mem_buffer+1)));
   #endif
   addStmtToIRSB(diffenv->sb_out,IRStmt_Store(Iend_LE,buffer_addr_Lo,((IRExpr**)expr)[0]));
-  addStmtToIRSB(diffenv->sb_out,IRStmt_Store(Iend_LE,buffer_addr_Hi,((IRExpr**)expr)[1]));
+  if(!bar_index32) // the higher layer is not stored
+    addStmtToIRSB(diffenv->sb_out,IRStmt_Store(Iend_LE,buffer_addr_Hi,((IRExpr**)expr)[1]));
   IRType type = typeOfIRExpr(diffenv->sb_out->tyenv, ((IRExpr**)expr)[0]);
   tl_assert(type == typeOfIRExpr(diffenv->sb_out->tyenv, ((IRExpr**)expr)[1]));
   ULong size = sizeofIRType(type);
@@ -138,7 +248,17 @@ void dg_bar_store(DiffEnv* diffenv, IRExpr* addr, void* expr, IRExpr* guard){
   if(guard) dd->guard=guard;
   addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(dd));
 }
+void* dg_bar_default_(DiffEnv* diffenv, IRType type);
+
 void* dg_bar_load(DiffEnv* diffenv, IRExpr* addr, IRType type){
+  if(bar_shadow_slots && dg_bar_slots_supported(type)){
+    IRTemp ptr = dg_bar_slots_ptr(diffenv,addr,sizeofIRType(type),False);
+    IRTemp exLo_tmp = newIRTemp(diffenv->sb_out->tyenv,type);
+    IRTemp exHi_tmp = newIRTemp(diffenv->sb_out->tyenv,type);
+    addStmtToIRSB(diffenv->sb_out,IRStmt_WrTmp(exLo_tmp,dg_bar_slots_load_layer(diffenv,ptr,0,type)));
+    addStmtToIRSB(diffenv->sb_out,IRStmt_WrTmp(exHi_tmp,dg_bar_slots_load_layer(diffenv,ptr,8,type)));
+    return (void*)mkIRExprVec_2(IRExpr_RdTmp(exLo_tmp),IRExpr_RdTmp(exHi_tmp));
+  }
   #ifdef BUILD_32BIT
   IRExpr* buffer_addr_Lo = IRExpr_Const(IRConst_U32((Addr)dg_bar_shadow_mem_buffer));
   IRExpr* buffer_addr_Hi = IRExpr_Const(IRConst_U32((Addr)(dg_bar_shadow_mem_buffer+1)));
@@ -155,6 +275,10 @@ void* dg_bar_load(DiffEnv* diffenv, IRExpr* addr, IRType type){
   IRTemp exLo_tmp = newIRTemp(diffenv->sb_out->tyenv,type);
   IRTemp exHi_tmp = newIRTemp(diffenv->sb_out->tyenv,type);
   addStmtToIRSB(diffenv->sb_out,IRStmt_WrTmp(exLo_tmp,IRExpr_Load(Iend_LE,type,buffer_addr_Lo)));
+  if(bar_index32){ // the higher layer is zero
+    IRExpr* exHi = ((IRExpr**)dg_bar_default_(diffenv,type))[1];
+    return (void*)mkIRExprVec_2(IRExpr_RdTmp(exLo_tmp),exHi);
+  }
   addStmtToIRSB(diffenv->sb_out,IRStmt_WrTmp(exHi_tmp,IRExpr_Load(Iend_LE,type,buffer_addr_Hi)));
   return (void*)mkIRExprVec_2(IRExpr_RdTmp(exLo_tmp),IRExpr_RdTmp(exHi_tmp));
 }
@@ -296,12 +420,30 @@ ULong dg_bar_writeToTape_call(ULong index1Lo, ULong index1Hi, ULong index2Lo, UL
   return returnindex;
 }
 
-void dg_bar_writeToTape_value_call(ULong value, ULong index){
+void dg_bar_writeToTape_value_call(ULong value, ULong index, ULong opcode){
   if(index!=0){
-    valuesAddStatement(*(double*)&value);
+    valuesAddStatement(*(double*)&value,(UChar)opcode);
   }
 }
 
+/*! Emit a temporary of type Ity_I1 telling whether any of the index layers is nonzero.
+ *
+ *  tapeAddStatement does not record operations whose inputs are all passive,
+ *  so the dirty calls writing to the tape are guarded by this temporary. Passive
+ *  arithmetic thereby costs a few inline instructions instead of a helper call.
+ *  \returns The temporary, or NULL with --typegrind=yes, which records every operation.
+ */
+static IRExpr* dg_bar_activityGuard(DiffEnv* diffenv, IRExpr* index1Lo, IRExpr* index1Hi, IRExpr* index2Lo, IRExpr* index2Hi){
+  if(typegrind) return NULL;
+  IRTypeEnv* tyenv = diffenv->sb_out->tyenv;
+  IRExpr* passive = IRExpr_Binop(Iop_And1,
+    IRExpr_Binop(Iop_And1, isZero(index1Lo,typeOfIRExpr(tyenv,index1Lo)), isZero(index1Hi,typeOfIRExpr(tyenv,index1Hi))),
+    IRExpr_Binop(Iop_And1, isZero(index2Lo,typeOfIRExpr(tyenv,index2Lo)), isZero(index2Hi,typeOfIRExpr(tyenv,index2Hi))) );
+  IRTemp active = newIRTemp(tyenv,Ity_I1);
+  addStmtToIRSB(diffenv->sb_out, IRStmt_WrTmp(active, IRExpr_Unop(Iop_Not1,passive)));
+  return IRExpr_RdTmp(active);
+}
+
 /*! Add dirty call writing to tape.
  * 
  * This function is called from the code in dg_bar_operations.c, which is generated by
@@ -315,11 +457,13 @@ void dg_bar_writeToTape_value_call(ULong value, ULong index){
  * \param diff1 - IRExpr* of type F64 for the partial derivative w.r.t. dependency 1
  * \param diff2 - IRExpr* of type F64 for the partial derivative w.r.t. dependency 2
  * \param value - IRExpr* of type F64 for the value of the result
+ * \param opcode - Dg_Opcode of the operation, recorded together with the value
  * \returns Array of two IRExpr*'s of type I64 for the lower and higher layer of the 
  *   new index assigned to the result.
  *
  */
-IRExpr** dg_bar_writeToTape(DiffEnv* diffenv, IRExpr* index1Lo, IRExpr* index1Hi, IRExpr* index2Lo, IRExpr* index2Hi, IRExpr* diff1, IRExpr* diff2, IRExpr* value){
+IRExpr** dg_bar_writeToTape(DiffEnv* diffenv, IRExpr* index1Lo, IRExpr* index1Hi, IRExpr* index2Lo, IRExpr* index2Hi, IRExpr* diff1, IRExpr* diff2, IRExpr* value, Dg_Opcode opcode){
+  IRExpr* active = dg_bar_activityGuard(diffenv,index1Lo,index1Hi,index2Lo,index2Hi);
   IRTemp returnindex = newIRTemp(diffenv->sb_out->tyenv,Ity_I64);
   IRDirty* dd = unsafeIRDirty_1_N(
         returnindex,
@@ -328,23 +472,207 @@ IRExpr** dg_bar_writeToTape(DiffEnv* diffenv, IRExpr* index1Lo, IRExpr* index1Hi
         mkIRExprVec_6(index1Lo,index1Hi,index2Lo,index2Hi,
           IRExpr_Unop(Iop_ReinterpF64asI64,diff1),
           IRExpr_Unop(Iop_ReinterpF64asI64,diff2) )  );
+  if(active) dd->guard = active;
   addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(dd));
+  // a skipped call leaves 0x55..5 in returnindex, the index of passive results is 0
+  IRExpr* newindex = active ? IRExpr_ITE(active,IRExpr_RdTmp(returnindex),IRExpr_Const(IRConst_U64(0)))
+                            : IRExpr_RdTmp(returnindex);
   if(bar_record_values){
     IRDirty* dd_val = unsafeIRDirty_0_N(
           0, "dg_bar_writeToTape_value_call",
           &dg_bar_writeToTape_value_call,
-          mkIRExprVec_2(IRExpr_Unop(Iop_ReinterpF64asI64,value), IRExpr_RdTmp(returnindex)) );
+          mkIRExprVec_3(IRExpr_Unop(Iop_ReinterpF64asI64,value), newindex,
+            IRExpr_Const(IRConst_U64(opcode))) );
+    if(active) dd_val->guard = active;
     addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(dd_val));
   }
   // split I64 returnindex into two I32 layers
-  IRExpr* exLo_i32 = IRExpr_Unop(Iop_64to32, IRExpr_RdTmp(returnindex));
-  IRExpr* exHi_i32 = IRExpr_Unop(Iop_64HIto32, IRExpr_RdTmp(returnindex));
+  IRExpr* exLo_i32 = IRExpr_Unop(Iop_64to32, newindex);
+  IRExpr* exHi_i32 = IRExpr_Unop(Iop_64HIto32, newindex);
   // convert to I64
   IRExpr* exLo = IRExpr_Binop(Iop_32HLto64,IRExpr_Const(IRConst_U32(0)),exLo_i32);
-  IRExpr* exHi = IRExpr_Binop(Iop_32HLto64,IRExpr_Const(IRConst_U32(0)),exHi_i32);
+  IRExpr* exHi = bar_index32 ? IRExpr_Const(IRConst_U64(0))
+                 : IRExpr_Binop(Iop_32HLto64,IRExpr_Const(IRConst_U32(0)),exHi_i32);
   return mkIRExprVec_2(exLo,exHi);
 }
 
+/*! Staging area of dg_bar_writeToTape_vector_call.
+ *
+ *  Dirty calls only take integer arguments, so the index layers and partial
+ *  derivatives of all lanes of a SIMD operation are stored here by the
+ *  instrumented code before the call, and the new indices are loaded from
+ *  here afterwards. Each lane of an index layer occupies fpsize bytes, with
+ *  the 4-byte layer at its beginning.
+ */
+static struct {
+  UChar index1Lo[32], index1Hi[32], index2Lo[32], index2Hi[32];
+  double diff1[8], diff2[8], value[8];
+  UChar indexLo[32], indexHi[32];
+} dg_bar_tape_vector;
+
+void dg_bar_writeToTape_vector_call(ULong fpsize, ULong simdsize, ULong opcode){
+  for(ULong lane=0; lane<simdsize; lane++){
+    ULong offset = lane*fpsize;
+    UInt index1[2], index2[2];
+    index1[0] = *(UInt*)(dg_bar_tape_vector.index1Lo+offset);
+    index1[1] = *(UInt*)(dg_bar_tape_vector.index1Hi+offset);
+    index2[0] = *(UInt*)(dg_bar_tape_vector.index2Lo+offset);
+    index2[1] = *(UInt*)(dg_bar_tape_vector.index2Hi+offset);
+    ULong returnindex = tapeAddStatement(*(ULong*)index1,*(ULong*)index2,dg_bar_tape_vector.diff1[lane],dg_bar_tape_vector.diff2[lane]);
+    if(bar_record_values && returnindex!=0){
+      valuesAddStatement(dg_bar_tape_vector.value[lane],(UChar)opcode);
+    }
+    if(fpsize==8){
+      *(ULong*)(dg_bar_tape_vector.indexLo+offset) = (UInt)returnindex;
+      *(ULong*)(dg_bar_tape_vector.indexHi+offset) = (UInt)(returnindex>>32);
+    } else {
+      *(UInt*)(dg_bar_tape_vector.indexLo+offset) = (UInt)returnindex;
+      *(UInt*)(dg_bar_tape_vector.indexHi+offset) = (UInt)(returnindex>>32);
+    }
+  }
+}
+
+//! Add a statement storing expr into the staging area at addr.
+static void dg_bar_stage(DiffEnv* diffenv, void* addr, IRExpr* expr){
+  addStmtToIRSB(diffenv->sb_out, IRStmt_Store(Iend_LE, mkIRExpr_HWord((HWord)addr), expr));
+}
+
+/*! Add a single dirty call writing one tape block for every lane of a SIMD operation.
+ *
+ *  This replaces simdsize calls of dg_bar_writeToTape for operations with one or two inputs.
+ *
+ * \param diffenv - General setup.
+ * \param index1Lo - IRExpr* for the lower layer of the indices of dependency 1, of the size of the operand
+ * \param index1Hi - IRExpr* for the higher layer of the indices of dependency 1
+ * \param index2Lo - IRExpr* for the lower layer of the indices of dependency 2, or NULL
+ * \param index2Hi - IRExpr* for the higher layer of the indices of dependency 2, or NULL
+ * \param diff1 - Array of simdsize IRExpr*'s of type F64 for the partial derivatives w.r.t. dependency 1
+ * \param diff2 - Array of simdsize IRExpr*'s of type F64 for the partial derivatives w.r.t. dependency 2
+ * \param value - Array of simdsize IRExpr*'s of type F64 for the values of the result
+ * \param fpsize - Size of a lane, 4 or 8 (bytes)
+ * \param simdsize - Number of lanes
+ * \param opcode - Dg_Opcode of the operation, recorded together with the values
+ * \returns Array of two IRExpr*'s for the lower and higher layer of the new indices,
+ *   of the size of the operand.
+ */
+IRExpr** dg_bar_writeToTape_vector(DiffEnv* diffenv, IRExpr* index1Lo, IRExpr* index1Hi, IRExpr* index2Lo, IRExpr* index2Hi, IRExpr** diff1, IRExpr** diff2, IRExpr** value, Int fpsize, Int simdsize, Dg_Opcode opcode){
+  IRType type;
+  switch(fpsize*simdsize){
+    case 8: type = Ity_I64; break;
+    case 16: type = Ity_V128; break;
+    case 32: type = Ity_V256; break;
+    default: VG_(printf)("Bad vector size in dg_bar_writeToTape_vector.\n"); tl_assert(False); return NULL;
+  }
+  if(!index2Lo){ // use index 0 to indicate missing input
+    index2Lo = index2Hi = mkIRConst_zero(type);
+  }
+  dg_bar_stage(diffenv, dg_bar_tape_vector.index1Lo, index1Lo);
+  dg_bar_stage(diffenv, dg_bar_tape_vector.index1Hi, index1Hi);
+  dg_bar_stage(diffenv, dg_bar_tape_vector.index2Lo, index2Lo);
+  dg_bar_stage(diffenv, dg_bar_tape_vector.index2Hi, index2Hi);
+  for(Int lane=0; lane<simdsize; lane++){
+    dg_bar_stage(diffenv, &dg_bar_tape_vector.diff1[lane], diff1[lane]);
+    dg_bar_stage(diffenv, &dg_bar_tape_vector.diff2[lane], diff2[lane]);
+    if(bar_record_values){
+      dg_bar_stage(diffenv, &dg_bar_tape_vector.value[lane], value[lane]);
+    }
+  }
+  IRExpr* active = dg_bar_activityGuard(diffenv,index1Lo,index1Hi,index2Lo,index2Hi);
+  IRDirty* dd = unsafeIRDirty_0_N(
+        0, "dg_bar_writeToTape_vector_call",
+        &dg_bar_writeToTape_vector_call,
+        mkIRExprVec_3(IRExpr_Const(IRConst_U64(fpsize)), IRExpr_Const(IRConst_U64(simdsize)),
+          IRExpr_Const(IRConst_U64(opcode))) );
+  dd->mFx = Ifx_Modify;
+  dd->mAddr = mkIRExpr_HWord((HWord)&dg_bar_tape_vector);
+  dd->mSize = sizeof(dg_bar_tape_vector);
+  if(active) dd->guard = active;
+  addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(dd));
+  // load the new indices into temporaries before the staging area is reused;
+  // if the call was skipped, the staging area is stale and all lanes are passive
+  IRExpr* loadLo = IRExpr_Load(Iend_LE,type,mkIRExpr_HWord((HWord)dg_bar_tape_vector.indexLo));
+  IRTemp indexLo = newIRTemp(diffenv->sb_out->tyenv,type);
+  addStmtToIRSB(diffenv->sb_out, IRStmt_WrTmp(indexLo,
+    active ? IRExpr_ITE(active,loadLo,mkIRConst_zero(type)) : loadLo));
+  IRExpr* exHi;
+  if(bar_index32){
+    exHi = mkIRConst_zero(type);
+  } else {
+    IRExpr* loadHi = IRExpr_Load(Iend_LE,type,mkIRExpr_HWord((HWord)dg_bar_tape_vector.indexHi));
+    IRTemp indexHi = newIRTemp(diffenv->sb_out->tyenv,type);
+    addStmtToIRSB(diffenv->sb_out, IRStmt_WrTmp(indexHi,
+      active ? IRExpr_ITE(active,loadHi,mkIRConst_zero(type)) : loadHi));
+    exHi = IRExpr_RdTmp(indexHi);
+  }
+  return mkIRExprVec_2(IRExpr_RdTmp(indexLo),exHi);
+}
+
+/*! Recording-mode AD handling of a bitwise logical operation whose mask is
+ *  known at translation time, without calling dg_bar_bitwise_*.
+ *
+ *  Sign changes are recorded by dg_bar_writeToTape. For abs and negative abs,
+ *  the input index is replaced by zero if the sign is kept, so the activity
+ *  guard skips the tape dirty call.
+ *  \param[in] op - 'a', 'o' or 'x' for "and", "or" or "xor".
+ *  \param[in] fpsize - Smallest unit size to be considered, 4 or 8.
+ *  \param[out] unchanged - See dg_bitwise_mask.
+ *  \returns Lower and higher layer of the index of the result, or NULL if no
+ *    mask was recognized.
+ */
+static IRExpr** dg_bar_bitwise_constant_mask(DiffEnv* diffenv, HChar op, int fpsize,
+    IRExpr* arg1, IRExpr* i1Lo, IRExpr* i1Hi, IRExpr* arg2, IRExpr* i2Lo, IRExpr* i2Hi, IRExpr** unchanged){
+  if(typegrind) return NULL; // the runtime handlers take care of 0xff..f indices
+  int unitsize;
+  Dg_MaskOp maskops[8];
+  IRExpr *y, *yLo, *yHi;
+  if(dg_bitwise_mask(diffenv,op,arg1,fpsize,&unitsize,maskops,unchanged)){
+    y = arg2; yLo = i2Lo; yHi = i2Hi;
+  } else if(dg_bitwise_mask(diffenv,op,arg2,fpsize,&unitsize,maskops,unchanged)){
+    y = arg1; yLo = i1Lo; yHi = i1Hi;
+  } else {
+    return NULL;
+  }
+  int nunits = sizeofIRType(typeOfIRExpr(diffenv->sb_out->tyenv,y)) / unitsize;
+  IRExpr* zero = IRExpr_Const(IRConst_U64(0));
+  IRExpr *indexLo_arr[8], *indexHi_arr[8];
+  for(int unit=0; unit<nunits; unit++){
+    IRExpr* y_unit = getSIMDComponent(y,unitsize,nunits,unit,diffenv);
+    IRExpr* yLo_unit = getSIMDComponent(yLo,unitsize,nunits,unit,diffenv);
+    IRExpr* yHi_unit = getSIMDComponent(yHi,unitsize,nunits,unit,diffenv);
+    IRExpr* y_f;
+    if(unitsize==4){ // widen to 64 bit
+      yLo_unit = IRExpr_Binop(Iop_32HLto64,IRExpr_Const(IRConst_U32(0)),yLo_unit);
+      yHi_unit = IRExpr_Binop(Iop_32HLto64,IRExpr_Const(IRConst_U32(0)),yHi_unit);
+      y_f = IRExpr_Unop(Iop_F32toF64,IRExpr_Unop(Iop_ReinterpI32asF32,y_unit));
+    } else {
+      y_f = IRExpr_Unop(Iop_ReinterpI64asF64,y_unit);
+    }
+    IRExpr* flip;
+    switch(maskops[unit]){
+      case DG_MASK_COPY: flip = NULL; break;
+      case DG_MASK_NEG: flip = IRExpr_Const(IRConst_U1(True)); break;
+      case DG_MASK_ABS: flip = dg_compare_to_zero(y_unit,unitsize,Ircr_LT); break;
+      case DG_MASK_NEGABS: flip = dg_compare_to_zero(y_unit,unitsize,Ircr_GT); break;
+      default: tl_assert(False); return NULL;
+    }
+    // if the mask has been modified, the runtime handlers record the operation
+    if(flip && *unchanged) flip = IRExpr_Binop(Iop_And1,flip,*unchanged);
+    if(flip){
+      IRExpr** minus = dg_bar_writeToTape(diffenv,
+        IRExpr_ITE(flip,yLo_unit,zero), IRExpr_ITE(flip,yHi_unit,zero), zero, zero,
+        IRExpr_Const(IRConst_F64(-1.)), IRExpr_Const(IRConst_F64(0.)),
+        IRExpr_Unop(Iop_NegF64,y_f), DG_OPCODE_LINEAR);
+      indexLo_arr[unit] = IRExpr_ITE(flip,minus[0],yLo_unit);
+      indexHi_arr[unit] = IRExpr_ITE(flip,minus[1],yHi_unit);
+    } else {
+      indexLo_arr[unit] = yLo_unit;
+      indexHi_arr[unit] = yHi_unit;
+    }
+  }
+  return mkIRExprVec_2(assembleSIMDVector(indexLo_arr,unitsize,nunits,diffenv),
+                       assembleSIMDVector(indexHi_arr,unitsize,nunits,diffenv));
+}
+
 void* dg_bar_operation(DiffEnv* diffenv, IROp op,
                          IRExpr* arg1, IRExpr* arg2, IRExpr* arg3, IRExpr* arg4,
                          void* i1, void* i2, void* i3, void* i4){
@@ -393,6 +721,10 @@ void dg_bar_handle_statement(DiffEnv* diffenv, IRStmt* st_orig){
   add_statement_modified(diffenv,dg_bar_expressionhandling,st_orig);
 }
 
+void dg_bar_handle_statement_passive(DiffEnv* diffenv, IRStmt* st_orig){
+  add_statement_passive(diffenv,dg_bar_expressionhandling,st_orig);
+}
+
 void dg_bar_initialize(void){
   dg_bar_shadow_mem_buffer = VG_(malloc)("dg_bar_shadow_mem_buffer",2*sizeof(V256));
   dg_bar_shadowInit();
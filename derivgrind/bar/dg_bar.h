@@ -45,6 +45,13 @@ extern Bool bar_record_values;
  */
 void dg_bar_handle_statement(DiffEnv* diffenv, IRStmt* st_orig);
 
+/*! Add passive reverse-mode instrumentation to output IRSB, for functions
+ *  excluded by --no-instrument.
+ *  \param[in,out] diffenv - General data.
+ *  \param[in] st_orig - Original statement.
+ */
+void dg_bar_handle_statement_passive(DiffEnv* diffenv, IRStmt* st_orig);
+
 /*! Initialize recording-pass data structures.
  */
 void dg_bar_initialize(void);
@@ -32,6 +32,7 @@
 
 #include "pub_tool_basics.h"
 
+#include "derivgrind.h"
 #include "dg_bar_bitwise.h"
 #include "dg_bar_tape.h"
 #include "dg_bar.h"
@@ -109,7 +110,7 @@ static ULong assemble64x2to64(ULong iLo, ULong iHi){
     else { \
       ULong yi = assemble64x2to64(y##iLo, y##iHi); \
       ULong minus_yi = tapeAddStatement(yi,0,-1.,0.); \
-      if(bar_record_values && minus_yi!=0) valuesAddStatement(-y_f); \
+      if(bar_record_values && minus_yi!=0) valuesAddStatement(-y_f,DG_OPCODE_LINEAR); \
       out->w32[0] = *(UInt*)&minus_yi; \
       out->w32[2] = *((UInt*)&minus_yi+1); \
     } \
@@ -163,7 +164,7 @@ VG_REGPARM(0) void dg_bar_bitwise_and64(ULong x, ULong xiLo, ULong xiHi, ULong y
     else { \
       ULong yi = assemble64x2to64(y##iLo,y##iHi); \
       ULong minus_yi = tapeAddStatement(yi,0,-1.,0); \
-      if(bar_record_values && minus_yi!=0) valuesAddStatement(-y_f); \
+      if(bar_record_values && minus_yi!=0) valuesAddStatement(-y_f,DG_OPCODE_LINEAR); \
       out->w32[0] = *(UInt*)&minus_yi; \
       out->w32[2] = *((UInt*)&minus_yi+1); \
     } \
@@ -198,7 +199,7 @@ VG_REGPARM(0) void dg_bar_bitwise_or64(ULong x, ULong xiLo, ULong xiHi, ULong y,
     fptype y_f = *(fptype*)&y; \
     ULong yi = assemble64x2to64(y##iLo,y##iHi); \
     ULong minus_yi = tapeAddStatement(yi,0,-1.,0); \
-    if(bar_record_values && minus_yi!=0) valuesAddStatement(-y_f); \
+    if(bar_record_values && minus_yi!=0) valuesAddStatement(-y_f,DG_OPCODE_LINEAR); \
     out->w32[0] = *(UInt*)&minus_yi; \
     out->w32[2] = *((UInt*)&minus_yi+1); \
   } \
@@ -33,6 +33,8 @@
 #include "externals/flexible-shadow/flexible-shadow-valgrindstdlib.hpp"
 #include <pub_tool_libcbase.h>
 #include "dg_utils.h"
+#include "dg_bar_shadow.h"
+#include "dg_shadow_leaf.hpp"
 
 #ifndef SHADOW_LAYERS_32
   #define SHADOW_LAYERS_32 18,14
@@ -47,9 +49,15 @@
   #define SHADOW_LAYERS SHADOW_LAYERS_64
 #endif
 
+//! Number of bytes shadowed by a leaf.
+static const ULong leafSize = 1ul<<(SHADOW_LAYERS);
+
+/*! Leaf for the default split layout.
+ *
+ *  The storage holds the lower layer, followed by the higher layer.
+ */
 struct ShadowLeafBar {
-  UChar data_Lo[1ul<<(SHADOW_LAYERS)];
-  UChar data_Hi[1ul<<(SHADOW_LAYERS)];
+  ShadowLeafStorage<2*leafSize> storage;
   static ShadowLeafBar distinguished;
 };
 ShadowLeafBar ShadowLeafBar::distinguished;
@@ -58,20 +66,123 @@ using ShadowMapTypeBar = ShadowMap<Addr,ShadowLeafBar,ValgrindStandardLibraryInt
 
 ShadowMapTypeBar* sm_bar2;
 
+/*! Leaf for --index-bits=32.
+ *
+ *  Indices fit into the lower layer, the higher layer is always zero
+ *  and not stored.
+ */
+struct ShadowLeafBarSingle {
+  ShadowLeafStorage<leafSize> storage;
+  static ShadowLeafBarSingle distinguished;
+};
+ShadowLeafBarSingle ShadowLeafBarSingle::distinguished;
+
+using ShadowMapTypeBarSingle = ShadowMap<Addr,ShadowLeafBarSingle,ValgrindStandardLibraryInterface,SHADOW_LAYERS>;
+
+ShadowMapTypeBarSingle* sm_bar_single;
+
+/*! Leaf for --shadow-layout=slots.
+ *
+ *  Every 8-byte-aligned slot of client memory is shadowed by 16 consecutive
+ *  bytes: the 8 bytes of the lower layer, followed by the 8 bytes of the
+ *  higher layer. So both halves of the index of a double or float are
+ *  next to each other, and can be accessed by the instrumented code directly.
+ */
+struct ShadowLeafBarSlots {
+  ShadowLeafStorage<2*leafSize> storage;
+  static ShadowLeafBarSlots distinguished;
+};
+ShadowLeafBarSlots ShadowLeafBarSlots::distinguished;
+
+using ShadowMapTypeBarSlots = ShadowMap<Addr,ShadowLeafBarSlots,ValgrindStandardLibraryInterface,SHADOW_LAYERS>;
+
+ShadowMapTypeBarSlots* sm_bar_slots;
+
+//! Position of the lower-layer shadow byte of the byte with the given index in a slots leaf.
+static inline ULong dg_bar_slotpos(ULong index){
+  return 16*(index/8) + index%8;
+}
+
+/*! Buffer for accesses that cannot be done in a leaf directly,
+ *  laid out like a slots leaf for an 8-byte-aligned address.
+ */
+static ULong dg_bar_slots_scratch[8];
+
+static void dg_bar_shadowGetSlots(Addr addr, UChar* real_address_Lo, UChar* real_address_Hi, ULong size){
+  while(size>0){
+    UChar* data = shadowLeafRead<leafSize>(sm_bar_slots,addr);
+    Addr chunk = sm_bar_slots->contiguousElements(addr);
+    if(size<chunk) chunk = size;
+    ULong index = sm_bar_slots->index(addr);
+    for(ULong j=0; j<chunk; j++){
+      ULong pos = dg_bar_slotpos(index+j);
+      if(real_address_Lo) *real_address_Lo++ = data[pos];
+      if(real_address_Hi) *real_address_Hi++ = data[pos+8];
+    }
+    addr += chunk; size -= chunk;
+  }
+}
+
+static void dg_bar_shadowSetSlots(Addr addr, const UChar* real_address_Lo, const UChar* real_address_Hi, ULong size){
+  while(size>0){
+    UChar* data = shadowLeafWrite<leafSize>(sm_bar_slots,addr);
+    Addr chunk = sm_bar_slots->contiguousElements(addr);
+    if(size<chunk) chunk = size;
+    ULong index = sm_bar_slots->index(addr);
+    for(ULong j=0; j<chunk; j++){
+      ULong pos = dg_bar_slotpos(index+j);
+      if(real_address_Lo) data[pos] = *real_address_Lo++;
+      if(real_address_Hi) data[pos+8] = *real_address_Hi++;
+    }
+    addr += chunk; size -= chunk;
+  }
+}
+
+static void dg_bar_shadowGetSingle(Addr addr, UChar* real_address_Lo, UChar* real_address_Hi, ULong size){
+  if(real_address_Hi) VG_(memset)(real_address_Hi, 0, size);
+  if(!real_address_Lo) return;
+  while(size>0){
+    UChar* data = shadowLeafRead<leafSize>(sm_bar_single,addr);
+    Addr chunk = sm_bar_single->contiguousElements(addr);
+    if(size<chunk) chunk = size;
+    VG_(memcpy)(real_address_Lo, &data[sm_bar_single->index(addr)], chunk);
+    real_address_Lo += chunk; addr += chunk; size -= chunk;
+  }
+}
+
+static void dg_bar_shadowSetSingle(Addr addr, const UChar* real_address_Lo, ULong size){
+  if(!real_address_Lo) return;
+  while(size>0){
+    UChar* data = shadowLeafWrite<leafSize>(sm_bar_single,addr);
+    Addr chunk = sm_bar_single->contiguousElements(addr);
+    if(size<chunk) chunk = size;
+    VG_(memcpy)(&data[sm_bar_single->index(addr)], real_address_Lo, chunk);
+    real_address_Lo += chunk; addr += chunk; size -= chunk;
+  }
+}
+
 extern "C" void dg_bar_shadowGet(void* sm_address, void* real_address_Lo, void* real_address_Hi, int size){
-  ShadowLeafBar* leaf = sm_bar2->leaf_for_read((Addr)sm_address);
+  if(bar_index32){
+    dg_bar_shadowGetSingle((Addr)sm_address,(UChar*)real_address_Lo,(UChar*)real_address_Hi,size);
+    return;
+  }
+  if(bar_shadow_slots){
+    dg_bar_shadowGetSlots((Addr)sm_address,(UChar*)real_address_Lo,(UChar*)real_address_Hi,size);
+    return;
+  }
+  UChar* data = shadowLeafRead<leafSize>(sm_bar2,(Addr)sm_address);
   Addr contiguousSize = sm_bar2->contiguousElements((Addr)sm_address);
   ULong index = sm_bar2->index((Addr)sm_address);
   if(contiguousSize >= size){
-    if(real_address_Lo) VG_(memcpy)(real_address_Lo, &leaf->data_Lo[index], size);
-    if(real_address_Hi) VG_(memcpy)(real_address_Hi, &leaf->data_Hi[index], size);
+    if(real_address_Lo) VG_(memcpy)(real_address_Lo, &data[index], size);
+    if(real_address_Hi) VG_(memcpy)(real_address_Hi, &data[leafSize+index], size);
   } else {
     if(real_address_Lo){
-      VG_(memcpy)(real_address_Lo, &leaf->data_Lo[index], contiguousSize);
+      VG_(memcpy)(real_address_Lo, &data[index], contiguousSize);
       real_address_Lo = (void*)((Addr)real_address_Lo+contiguousSize);
     }
     if(real_address_Hi){
-      VG_(memcpy)(real_address_Hi, &leaf->data_Hi[index], contiguousSize);
+      VG_(memcpy)(real_address_Hi, &data[leafSize+index], contiguousSize);
       real_address_Hi = (void*)((Addr)real_address_Hi+contiguousSize);
     }
     sm_address = (void*)((Addr)sm_address+contiguousSize);
@@ -81,19 +192,27 @@ extern "C" void dg_bar_shadowGet(void* sm_address, void* real_address_Lo, void*
 }
 
 extern "C" void dg_bar_shadowSet(void* sm_address, void* real_address_Lo, void* real_address_Hi, int size){
-  ShadowLeafBar* leaf = sm_bar2->leaf_for_write((Addr)sm_address);
+  if(bar_index32){
+    dg_bar_shadowSetSingle((Addr)sm_address,(const UChar*)real_address_Lo,size);
+    return;
+  }
+  if(bar_shadow_slots){
+    dg_bar_shadowSetSlots((Addr)sm_address,(const UChar*)real_address_Lo,(const UChar*)real_address_Hi,size);
+    return;
+  }
+  UChar* data = shadowLeafWrite<leafSize>(sm_bar2,(Addr)sm_address);
   Addr contiguousSize = sm_bar2->contiguousElements((Addr)sm_address);
   ULong index = sm_bar2->index((Addr)sm_address);
   if(contiguousSize >= size){
-    if(real_address_Lo) VG_(memcpy)(&leaf->data_Lo[index], real_address_Lo, size);
-    if(real_address_Hi) VG_(memcpy)(&leaf->data_Hi[index], real_address_Hi, size);
+    if(real_address_Lo) VG_(memcpy)(&data[index], real_address_Lo, size);
+    if(real_address_Hi) VG_(memcpy)(&data[leafSize+index], real_address_Hi, size);
   } else {
     if(real_address_Lo){
-      VG_(memcpy)(&leaf->data_Lo[index], real_address_Lo, contiguousSize);
+      VG_(memcpy)(&data[index], real_address_Lo, contiguousSize);
       real_address_Lo = (void*)((Addr)real_address_Lo+contiguousSize);
     }
     if(real_address_Hi){
-      VG_(memcpy)(&leaf->data_Hi[index], real_address_Hi, contiguousSize);
+      VG_(memcpy)(&data[leafSize+index], real_address_Hi, contiguousSize);
       real_address_Hi = (void*)((Addr)real_address_Hi+contiguousSize);
     }
     sm_address = (void*)((Addr)sm_address+contiguousSize);
@@ -102,15 +221,301 @@ extern "C" void dg_bar_shadowSet(void* sm_address, void* real_address_Lo, void*
   }
 }
 
+/*! Move a chunk of shadow memory that lies within a single leaf
+ *  both on the source and on the destination side.
+ */
+static void dg_bar_shadowMoveChunk(Addr dst, Addr src, Addr chunk){
+  ShadowLeafBar* leaf_src = sm_bar2->leaf_for_read(src);
+  if(!leaf_src->storage.allocated() && !sm_bar2->leaf_for_read(dst)->storage.allocated())
+    return; // zeros are copied onto zeros, don't allocate a leaf for that
+  UChar* data_dst = shadowLeafWrite<leafSize>(sm_bar2,dst);
+  UChar* data_src = leaf_src->storage.read();
+  ULong index_dst = sm_bar2->index(dst), index_src = sm_bar2->index(src);
+  VG_(memmove)(&data_dst[index_dst], &data_src[index_src], chunk);
+  VG_(memmove)(&data_dst[leafSize+index_dst], &data_src[leafSize+index_src], chunk);
+}
+
+/*! Move a chunk of shadow memory with --index-bits=32 that lies within a single
+ *  leaf both on the source and on the destination side.
+ */
+static void dg_bar_shadowMoveChunkSingle(Addr dst, Addr src, Addr chunk){
+  ShadowLeafBarSingle* leaf_src = sm_bar_single->leaf_for_read(src);
+  if(!leaf_src->storage.allocated() && !sm_bar_single->leaf_for_read(dst)->storage.allocated())
+    return;
+  UChar* data_dst = shadowLeafWrite<leafSize>(sm_bar_single,dst);
+  VG_(memmove)(&data_dst[sm_bar_single->index(dst)], &leaf_src->storage.read()[sm_bar_single->index(src)], chunk);
+}
+
+/*! Move a chunk of shadow memory in the slots layout that lies within a single
+ *  leaf both on the source and on the destination side.
+ *  \param backwards - Whether to copy back to front, for overlapping ranges with dst>src.
+ */
+static void dg_bar_shadowMoveChunkSlots(Addr dst, Addr src, Addr chunk, bool backwards){
+  ShadowLeafBarSlots* leaf_src = sm_bar_slots->leaf_for_read(src);
+  if(!leaf_src->storage.allocated() && !sm_bar_slots->leaf_for_read(dst)->storage.allocated())
+    return;
+  UChar* data_dst = shadowLeafWrite<leafSize>(sm_bar_slots,dst);
+  UChar* data_src = leaf_src->storage.read();
+  ULong index_dst = sm_bar_slots->index(dst), index_src = sm_bar_slots->index(src);
+  auto copyByte = [&](ULong j){
+    ULong pos_dst = dg_bar_slotpos(index_dst+j), pos_src = dg_bar_slotpos(index_src+j);
+    data_dst[pos_dst] = data_src[pos_src];
+    data_dst[pos_dst+8] = data_src[pos_src+8];
+  };
+  if(index_dst%8 != index_src%8){ // different positions within slots, byte by byte
+    if(backwards) for(ULong j=chunk; j>0; j--) copyByte(j-1);
+    else for(ULong j=0; j<chunk; j++) copyByte(j);
+    return;
+  }
+  // copy head and tail byte by byte, and the whole slots in between at once
+  ULong head = (8-index_dst%8)%8;
+  if(head>chunk) head = chunk;
+  ULong slots = (chunk-head)/8;
+  ULong tail = chunk-head-8*slots;
+  if(backwards){
+    for(ULong j=chunk; j>chunk-tail; j--) copyByte(j-1);
+  } else {
+    for(ULong j=0; j<head; j++) copyByte(j);
+  }
+  if(slots>0){
+    VG_(memmove)(&data_dst[dg_bar_slotpos(index_dst+head)], &data_src[dg_bar_slotpos(index_src+head)], 16*slots);
+  }
+  if(backwards){
+    for(ULong j=head; j>0; j--) copyByte(j-1);
+  } else {
+    for(ULong j=chunk-tail; j<chunk; j++) copyByte(j);
+  }
+}
+
+extern "C" void dg_bar_shadowCopy(void* sm_dst, void* sm_src, ULong size){
+  Addr dst = (Addr)sm_dst, src = (Addr)sm_src;
+  if(dst==src) return;
+  if(bar_index32){
+    if(dst<src || dst>=src+size){ // front to back
+      while(size>0){
+        Addr chunk = sm_bar_single->contiguousElements(src);
+        Addr chunk_dst = sm_bar_single->contiguousElements(dst);
+        if(chunk_dst<chunk) chunk = chunk_dst;
+        if(size<chunk) chunk = size;
+        dg_bar_shadowMoveChunkSingle(dst,src,chunk);
+        dst += chunk; src += chunk; size -= chunk;
+      }
+    } else { // overlapping ranges with dst>src, back to front
+      while(size>0){
+        Addr chunk = sm_bar_single->index(src+size-1)+1;
+        Addr chunk_dst = sm_bar_single->index(dst+size-1)+1;
+        if(chunk_dst<chunk) chunk = chunk_dst;
+        if(size<chunk) chunk = size;
+        size -= chunk;
+        dg_bar_shadowMoveChunkSingle(dst+size,src+size,chunk);
+      }
+    }
+    return;
+  }
+  if(bar_shadow_slots){
+    if(dst<src || dst>=src+size){ // front to back
+      while(size>0){
+        Addr chunk = sm_bar_slots->contiguousElements(src);
+        Addr chunk_dst = sm_bar_slots->contiguousElements(dst);
+        if(chunk_dst<chunk) chunk = chunk_dst;
+        if(size<chunk) chunk = size;
+        dg_bar_shadowMoveChunkSlots(dst,src,chunk,false);
+        dst += chunk; src += chunk; size -= chunk;
+      }
+    } else { // overlapping ranges with dst>src, back to front
+      while(size>0){
+        Addr chunk = sm_bar_slots->index(src+size-1)+1;
+        Addr chunk_dst = sm_bar_slots->index(dst+size-1)+1;
+        if(chunk_dst<chunk) chunk = chunk_dst;
+        if(size<chunk) chunk = size;
+        size -= chunk;
+        dg_bar_shadowMoveChunkSlots(dst+size,src+size,chunk,true);
+      }
+    }
+    return;
+  }
+  if(dst<src || dst>=src+size){ // front to back
+    while(size>0){
+      Addr chunk = sm_bar2->contiguousElements(src);
+      Addr chunk_dst = sm_bar2->contiguousElements(dst);
+      if(chunk_dst<chunk) chunk = chunk_dst;
+      if(size<chunk) chunk = size;
+      dg_bar_shadowMoveChunk(dst,src,chunk);
+      dst += chunk; src += chunk; size -= chunk;
+    }
+  } else { // overlapping ranges with dst>src, back to front
+    while(size>0){
+      Addr chunk = sm_bar2->index(src+size-1)+1;
+      Addr chunk_dst = sm_bar2->index(dst+size-1)+1;
+      if(chunk_dst<chunk) chunk = chunk_dst;
+      if(size<chunk) chunk = size;
+      size -= chunk;
+      dg_bar_shadowMoveChunk(dst+size,src+size,chunk);
+    }
+  }
+}
+
+extern "C" void dg_bar_shadowClear(void* sm_address, ULong size){
+  Addr addr = (Addr)sm_address;
+  if(bar_index32){
+    while(size>0){
+      Addr chunk = sm_bar_single->contiguousElements(addr);
+      if(size<chunk) chunk = size;
+      ShadowLeafBarSingle* leaf = sm_bar_single->leaf_for_read(addr);
+      if(leaf->storage.allocated()){
+        if(chunk==leafSize){ // whole leaf is cleared
+          leaf->storage.release();
+        } else {
+          VG_(memset)(&leaf->storage.write()[sm_bar_single->index(addr)], 0, chunk);
+        }
+      }
+      addr += chunk; size -= chunk;
+    }
+    return;
+  }
+  if(bar_shadow_slots){
+    while(size>0){
+      Addr chunk = sm_bar_slots->contiguousElements(addr);
+      if(size<chunk) chunk = size;
+      ShadowLeafBarSlots* leaf = sm_bar_slots->leaf_for_read(addr);
+      if(leaf->storage.allocated()){
+        if(chunk==leafSize){ // whole leaf is cleared
+          leaf->storage.release();
+        } else {
+          UChar* data = leaf->storage.write();
+          ULong index = sm_bar_slots->index(addr);
+          for(ULong j=0; j<chunk; j++){
+            ULong pos = dg_bar_slotpos(index+j);
+            data[pos] = data[pos+8] = 0;
+          }
+        }
+      }
+      addr += chunk; size -= chunk;
+    }
+    return;
+  }
+  while(size>0){
+    Addr chunk = sm_bar2->contiguousElements(addr);
+    if(size<chunk) chunk = size;
+    ShadowLeafBar* leaf = sm_bar2->leaf_for_read(addr);
+    if(leaf->storage.allocated()){
+      if(chunk==leafSize){ // whole leaf is cleared
+        leaf->storage.release();
+      } else {
+        UChar* data = leaf->storage.write();
+        ULong index = sm_bar2->index(addr);
+        VG_(memset)(&data[index], 0, chunk);
+        VG_(memset)(&data[leafSize+index], 0, chunk);
+      }
+    }
+    addr += chunk; size -= chunk;
+  }
+}
+
+/*! Whether an access of size bytes at addr can be done directly in a
+ *  slots leaf, i.e. the lower layer of every 8 bytes is followed by the
+ *  higher layer.
+ */
+static inline bool dg_bar_shadowDirect(Addr addr, ULong size){
+  if(addr%8 + size <= 8) return true; // within a single slot
+  return addr%8==0 && sm_bar_slots->contiguousElements(addr) >= size;
+}
+
+extern "C" HWord dg_bar_shadowPtrRead(Addr addr, ULong size){
+  if(dg_bar_shadowDirect(addr,size)){
+    UChar* data = shadowLeafRead<leafSize>(sm_bar_slots,addr);
+    return (HWord)&data[dg_bar_slotpos(sm_bar_slots->index(addr))];
+  } else {
+    UChar* scratch = (UChar*)dg_bar_slots_scratch;
+    for(ULong j=0; j<size; j++){
+      dg_bar_shadowGetSlots(addr+j, scratch+dg_bar_slotpos(j), scratch+dg_bar_slotpos(j)+8, 1);
+    }
+    return (HWord)scratch;
+  }
+}
+
+extern "C" HWord dg_bar_shadowPtrWrite(Addr addr, ULong size){
+  if(dg_bar_shadowDirect(addr,size)){
+    UChar* data = shadowLeafWrite<leafSize>(sm_bar_slots,addr);
+    return (HWord)&data[dg_bar_slotpos(sm_bar_slots->index(addr))];
+  } else {
+    return (HWord)dg_bar_slots_scratch;
+  }
+}
+
+extern "C" void dg_bar_shadowScatter(Addr addr, ULong size){
+  UChar* scratch = (UChar*)dg_bar_slots_scratch;
+  for(ULong j=0; j<size; j++){
+    dg_bar_shadowSetSlots(addr+j, scratch+dg_bar_slotpos(j), scratch+dg_bar_slotpos(j)+8, 1);
+  }
+}
+
+extern "C" HWord dg_bar_shadowScratch(void){
+  return (HWord)dg_bar_slots_scratch;
+}
+
+extern "C" ULong dg_bar_shadowCompact(void){
+  if(bar_index32) return ShadowLeafStorage<leafSize>::compact();
+  else return ShadowLeafStorage<2*leafSize>::compact(); // split and slots layout
+}
+
+/*! Counters of the leaf storage of one kind of leaves.
+ */
+template<ULong size>
+static void dg_bar_shadowStatsStorage(ULong* live, ULong* peak, ULong* compacted, ULong* bytes){
+  using Storage = ShadowLeafStorage<size>;
+  *live = Storage::nAllocated;
+  *peak = Storage::peakAllocated;
+  *compacted = Storage::nCompacted;
+  *bytes = size;
+}
+
+extern "C" void dg_bar_shadowStats(ULong* live, ULong* peak, ULong* compacted, ULong* bytes){
+  if(bar_index32) dg_bar_shadowStatsStorage<leafSize>(live,peak,compacted,bytes);
+  else dg_bar_shadowStatsStorage<2*leafSize>(live,peak,compacted,bytes);
+}
+
+/*! Hit and miss counters of the leaf caches of one kind of leaves.
+ */
+template<ULong size>
+static void dg_bar_shadowCacheStatsStorage(ULong* read_hits, ULong* read_misses, ULong* write_hits, ULong* write_misses){
+  using Storage = ShadowLeafStorage<size>;
+  *read_hits = Storage::readCache.hits;
+  *read_misses = Storage::readCache.misses;
+  *write_hits = Storage::writeCache.hits;
+  *write_misses = Storage::writeCache.misses;
+}
+
+extern "C" void dg_bar_shadowCacheStats(ULong* read_hits, ULong* read_misses, ULong* write_hits, ULong* write_misses){
+  if(bar_index32) dg_bar_shadowCacheStatsStorage<leafSize>(read_hits,read_misses,write_hits,write_misses);
+  else dg_bar_shadowCacheStatsStorage<2*leafSize>(read_hits,read_misses,write_hits,write_misses);
+}
+
 extern "C" void dg_bar_shadowInit(){
-  for(Addr i=0; i<(1ul<<(SHADOW_LAYERS)); i++){
-    ShadowLeafBar::distinguished.data_Lo[i] = 0;
-    ShadowLeafBar::distinguished.data_Hi[i] = 0;
+  if(bar_index32){
+    sm_bar_single = (ShadowMapTypeBarSingle*)VG_(malloc)("Space for primary map",sizeof(ShadowMapTypeBarSingle));
+    ShadowMapTypeBarSingle::constructAt(sm_bar_single);
+    return;
+  }
+  if(bar_shadow_slots){
+    sm_bar_slots = (ShadowMapTypeBarSlots*)VG_(malloc)("Space for primary map",sizeof(ShadowMapTypeBarSlots));
+    ShadowMapTypeBarSlots::constructAt(sm_bar_slots);
+    return;
   }
   sm_bar2 = (ShadowMapTypeBar*)VG_(malloc)("Space for primary map",sizeof(ShadowMapTypeBar));
   ShadowMapTypeBar::constructAt(sm_bar2);
 }
 extern "C" void dg_bar_shadowFini(){
+  if(bar_index32){
+    ShadowMapTypeBarSingle::destructAt(sm_bar_single);
+    VG_(free)(sm_bar_single);
+    return;
+  }
+  if(bar_shadow_slots){
+    ShadowMapTypeBarSlots::destructAt(sm_bar_slots);
+    VG_(free)(sm_bar_slots);
+    return;
+  }
   ShadowMapTypeBar::destructAt(sm_bar2);
   VG_(free)(sm_bar2);
 }
@@ -32,6 +32,8 @@
 #ifndef DG_BAR_SHADOW_H
 #define DG_BAR_SHADOW_H
 
+#include "pub_tool_basics.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,6 +41,52 @@ extern "C" {
 /*! */
 void dg_bar_shadowGet(void* sm_address, void* real_address_Lo, void* real_address_Hi, int size);
 void dg_bar_shadowSet(void* sm_address, void* real_address, void* real_address_Hi, int size);
+/*! Copy shadow memory of size bytes from sm_src to sm_dst, leaf by leaf.
+ *  Overlapping ranges are handled like memmove does.
+ */
+void dg_bar_shadowCopy(void* sm_dst, void* sm_src, ULong size);
+/*! Zero shadow memory of size bytes at sm_address, leaf by leaf.
+ */
+void dg_bar_shadowClear(void* sm_address, ULong size);
+/*! With --shadow-layout=slots, pointer to the shadow of size bytes at addr,
+ *  where the lower layer of every 8 bytes is followed by the higher layer.
+ *  If the access cannot be done in a leaf directly, the shadow is copied
+ *  into a scratch buffer with that layout.
+ */
+HWord dg_bar_shadowPtrRead(Addr addr, ULong size);
+/*! With --shadow-layout=slots, pointer where the shadow of size bytes at addr
+ *  should be written to, in the layout of dg_bar_shadowPtrRead. If the
+ *  scratch buffer is returned, call dg_bar_shadowScatter after writing.
+ */
+HWord dg_bar_shadowPtrWrite(Addr addr, ULong size);
+/*! Copy the shadow of size bytes at addr from the scratch buffer into shadow memory.
+ */
+void dg_bar_shadowScatter(Addr addr, ULong size);
+/*! Address of the scratch buffer of the slots layout.
+ */
+HWord dg_bar_shadowScratch(void);
+/*! Use the slots layout instead of two separate layers (--shadow-layout=slots).
+ */
+extern Bool bar_shadow_slots;
+/*! Use 4-byte indices in a single shadow layer (--index-bits=32).
+ *  dg_bar_shadowGet returns zeros for the higher layer, and
+ *  dg_bar_shadowSet ignores it.
+ */
+extern Bool bar_index32;
+/*! Release the storage of all leaves that contain only zeros.
+ *  \returns Number of released leaves.
+ */
+ULong dg_bar_shadowCompact(void);
+/*! Counters of the leaf storage.
+ *  \param[out] live - Number of leaves with allocated storage.
+ *  \param[out] peak - Maximal number of leaves with allocated storage.
+ *  \param[out] compacted - Number of leaves released by dg_bar_shadowCompact.
+ *  \param[out] bytes - Bytes of storage per leaf.
+ */
+void dg_bar_shadowStats(ULong* live, ULong* peak, ULong* compacted, ULong* bytes);
+/*! Hit and miss counters of the leaf caches for reading and writing.
+ */
+void dg_bar_shadowCacheStats(ULong* read_hits, ULong* read_misses, ULong* write_hits, ULong* write_misses);
 void dg_bar_shadowInit(void);
 void dg_bar_shadowFini(void);
 
@@ -42,30 +42,205 @@
 
 #include "pub_tool_gdbserver.h"
 #include "pub_tool_threadstate.h"
+#include "pub_tool_xarray.h"
+#include "pub_tool_debuginfo.h"
+#include "pub_tool_libcproc.h"
+#include "pub_tool_clientstate.h"
 
 
 #include "dg_bar_tape.h"
 
-static ULong nextindex = 1;
-
 //! Number of tape blocks fitting into the buffer.
 #define BUFSIZE 1000000
 
-//! Buffer for tape blocks.
-static ULong* buffer_tape;
+/*! State of a tape.
+ *
+ *  With --tape-per-thread=yes, every thread has its own tape. Otherwise,
+ *  all threads share the tape in the entry 0 of dg_bar_tapes.
+ */
+typedef struct {
+  //! Local index of the next tape block.
+  ULong nextindex;
+  //! Added to local indices to obtain the indices visible to the client.
+  ULong index_offset;
+  //! Buffer for tape blocks of dg_bar_tape_blocksize bytes each.
+  UChar* buffer_tape;
+  //! Buffer for values.
+  ULong* buffer_values;
+  //! Buffer for operation codes, one byte per block.
+  UChar* buffer_opcodes;
+  Int fd_tape;
+  Int fd_values;
+  Int fd_opcodes;
+} DgBarTape;
 
-//! Buffer for values.
-static ULong* buffer_values;
+static DgBarTape* dg_bar_tapes;
 
-static Int fd_tape;
-static Int fd_values;
 static VgFile *fp_inputs, *fp_outputs;
 
+//! Copy of the recording directory, to open per-thread tapes on demand.
+static HChar* dg_bar_tape_path;
+
 extern Long* dg_disable;
 extern Bool typegrind;
 extern Bool bar_record_values;
 extern Bool tape_in_ram;
 extern const ULong* recording_stop_indices;
+extern Bool bar_index32;
+
+/*! Set when the tape runs out of indices for --index-bits=32. Recording
+ *  stops then, dg-tape-format marks the tape as incomplete, and dg_fini
+ *  reports it.
+ */
+Bool dg_bar_tape_full = False;
+
+//! Size of a tape block in bytes, depends on --index-bits.
+static ULong dg_bar_tape_blocksize = 4*sizeof(ULong);
+
+/*! Write one tape, values and opcodes file per thread.
+ */
+Bool tape_per_thread = False;
+
+/*! Namespace stored in the upper bits of all indices, see DG_TAPE_THREAD_SHIFT.
+ *
+ *  derivgrind-launch gives every MPI rank its own namespace, so that indices
+ *  of different ranks can be told apart.
+ */
+Long index_namespace = 0;
+
+//! Totals for --instr-stats=yes.
+static ULong dg_bar_tape_total_blocks = 0, dg_bar_tape_total_flushes = 0, dg_bar_tape_total_bytes = 0;
+
+/*! Write a buffer to the tape, values or opcodes file, and update the totals.
+ */
+static void dg_bar_tape_flush(Int fd, void* buffer, ULong size){
+  VG_(write)(fd,buffer,size);
+  dg_bar_tape_total_flushes++;
+  dg_bar_tape_total_bytes += size;
+}
+
+/*! Store partial derivatives as binary32 (--tape-partials=f32).
+ */
+Bool bar_partials_f32 = False;
+
+/*! Count tape blocks per superblock and write a profile.
+ */
+Bool bar_record_profile = False;
+
+DgBarProfileCounter* dg_bar_profile_current = NULL;
+
+//! All counters allocated by dg_bar_profile_new_counter.
+static XArray* dg_bar_profile_counters = NULL;
+
+/*! Open tape, values and opcodes file and allocate buffers.
+ *  \param[in] tape - Tape to be opened.
+ *  \param[in] tid - Thread ID used as a suffix of the file names, or 0 for no suffix.
+ */
+static void dg_bar_tape_open(DgBarTape* tape, ThreadId tid){
+  ULong len = VG_(strlen)(dg_bar_tape_path);
+  HChar* filename = VG_(malloc)("filename in dg_bar_tape_open", len+1000);
+  VG_(memcpy)(filename,dg_bar_tape_path,len+1);
+
+  if(tid==0){
+    VG_(strcpy)(filename+len, "/dg-tape");
+  } else {
+    VG_(sprintf)(filename+len, "/dg-tape.%u", tid);
+  }
+  tape->fd_tape = VG_(fd_open)(filename,VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC|VKI_O_LARGEFILE,0777);
+  if(tape->fd_tape==-1){
+    VG_(printf)("Cannot open tape file at path '%s'.", filename ); tl_assert(False);
+  }
+  if(bar_record_values){
+    if(tid==0){
+      VG_(strcpy)(filename+len, "/dg-values");
+    } else {
+      VG_(sprintf)(filename+len, "/dg-values.%u", tid);
+    }
+    tape->fd_values = VG_(fd_open)(filename,VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC|VKI_O_LARGEFILE,0777);
+    if(tape->fd_values==-1){
+      VG_(printf)("Cannot open values file at path '%s'.", filename ); tl_assert(False);
+    }
+    if(tid==0){
+      VG_(strcpy)(filename+len, "/dg-opcodes");
+    } else {
+      VG_(sprintf)(filename+len, "/dg-opcodes.%u", tid);
+    }
+    tape->fd_opcodes = VG_(fd_open)(filename,VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC|VKI_O_LARGEFILE,0777);
+    if(tape->fd_opcodes==-1){
+      VG_(printf)("Cannot open opcodes file at path '%s'.", filename ); tl_assert(False);
+    }
+  }
+  VG_(free)(filename);
+
+  tape->nextindex = 1;
+  tape->index_offset = (ULong)(tid==0 ? index_namespace : tid) << DG_TAPE_THREAD_SHIFT;
+  // allocate and zero buffer for tape
+  tape->buffer_tape = VG_(malloc)("Tape buffer", BUFSIZE*dg_bar_tape_blocksize);
+  VG_(memset)(tape->buffer_tape, 0, BUFSIZE*dg_bar_tape_blocksize);
+  // allocate and zero buffer for values
+  if(bar_record_values){
+    tape->buffer_values = VG_(malloc)("Values buffer", BUFSIZE*sizeof(ULong));
+    for(ULong i=0; i<BUFSIZE; i++){
+      tape->buffer_values[i] = 0;
+    }
+    tape->buffer_opcodes = VG_(malloc)("Opcodes buffer", BUFSIZE*sizeof(UChar));
+    VG_(memset)(tape->buffer_opcodes, 0, BUFSIZE*sizeof(UChar));
+  }
+}
+
+/*! Flush buffers and close files of a tape.
+ */
+static void dg_bar_tape_close(DgBarTape* tape){
+  ULong pos = (tape->nextindex%BUFSIZE);
+  if(pos>0){ // flush buffers
+    dg_bar_tape_flush(tape->fd_tape,tape->buffer_tape,pos*dg_bar_tape_blocksize);
+    if(bar_record_values){
+      dg_bar_tape_flush(tape->fd_values,tape->buffer_values,pos*sizeof(ULong));
+      dg_bar_tape_flush(tape->fd_opcodes,tape->buffer_opcodes,pos*sizeof(UChar));
+    }
+  }
+  dg_bar_tape_total_blocks += tape->nextindex-1;
+  VG_(close)(tape->fd_tape);
+  if(bar_record_values){
+    VG_(close)(tape->fd_values);
+    VG_(close)(tape->fd_opcodes);
+  }
+
+  VG_(free)(tape->buffer_tape);
+  tape->buffer_tape = NULL;
+  if(bar_record_values){
+    VG_(free)(tape->buffer_values);
+    VG_(free)(tape->buffer_opcodes);
+  }
+}
+
+/*! Tape of the running thread, opened if necessary.
+ */
+static DgBarTape* dg_bar_tape_current(void){
+  if(!tape_per_thread) return &dg_bar_tapes[0];
+  ThreadId tid = VG_(get_running_tid)();
+  DgBarTape* tape = &dg_bar_tapes[tid];
+  if(!tape->buffer_tape) dg_bar_tape_open(tape,tid);
+  return tape;
+}
+
+/*! Write dg-tape-format, which describes the layout of the tape blocks for
+ *  the evaluation tools, and marks an incomplete tape so they refuse it.
+ */
+static void dg_bar_tape_write_format(void){
+  ULong len = VG_(strlen)(dg_bar_tape_path);
+  HChar* filename = VG_(malloc)("filename in dg_bar_tape_write_format", len+100);
+  VG_(memcpy)(filename,dg_bar_tape_path,len+1);
+  VG_(strcpy)(filename+len, "/dg-tape-format");
+  VgFile* fp_format = VG_(fopen)(filename,VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC,0777);
+  if(!fp_format){
+    VG_(printf)("Cannot open tape format file at path '%s'.", filename ); tl_assert(False);
+  }
+  VG_(fprintf)(fp_format, "index-bits %d\npartial-bits %d\n", bar_index32 ? 32 : 64, bar_partials_f32 ? 32 : 64);
+  if(dg_bar_tape_full) VG_(fprintf)(fp_format, "incomplete 1\n");
+  VG_(fclose)(fp_format);
+  VG_(free)(filename);
+}
 
 ULong tapeAddStatement(ULong index1,ULong index2,double diff1,double diff2){
   if(index1==0 && index2==0 && !typegrind) // activity analysis
@@ -76,18 +251,39 @@ ULong tapeAddStatement(ULong index1,ULong index2,double diff1,double diff2){
 
 ULong tapeAddStatement_noActivityAnalysis(ULong index1,ULong index2,double diff1,double diff2){
   if(dg_disable[VG_(get_running_tid)()]!=0) return typegrind ? 0xffffffffffffffff : 0;
-  ULong pos = (nextindex%BUFSIZE);
-  buffer_tape[4*pos] = index1;
-  buffer_tape[4*pos+1] = index2;
-  buffer_tape[4*pos+2] = *(ULong*)&diff1;
-  buffer_tape[4*pos+3] = *(ULong*)&diff2;
+  if(dg_bar_tape_full) return 0;
+  if(dg_bar_profile_current) dg_bar_profile_current->blocks++;
+  DgBarTape* tape = dg_bar_tape_current();
+  ULong pos = (tape->nextindex%BUFSIZE);
+  UChar* block = tape->buffer_tape + pos*dg_bar_tape_blocksize;
+  if(bar_index32){
+    // Only the lower layer carries the index. Sign-extend it, so that
+    // 0xff..f from --typegrind=yes is recognized below.
+    index1 = (ULong)(Long)(Int)(UInt)index1;
+    index2 = (ULong)(Long)(Int)(UInt)index2;
+    ((UInt*)block)[0] = (UInt)index1;
+    ((UInt*)block)[1] = (UInt)index2;
+    block += 2*sizeof(UInt);
+  } else {
+    ((ULong*)block)[0] = index1;
+    ((ULong*)block)[1] = index2;
+    block += 2*sizeof(ULong);
+  }
+  if(bar_partials_f32){
+    ((float*)block)[0] = (float)diff1;
+    ((float*)block)[1] = (float)diff2;
+  } else {
+    ((double*)block)[0] = diff1;
+    ((double*)block)[1] = diff2;
+  }
+  ULong newindex = tape->index_offset + tape->nextindex;
   if(recording_stop_indices){
     Int i=0;
     ULong stop_index = recording_stop_indices[i];
     while(stop_index!=0){
-      if(nextindex==stop_index){
+      if(newindex==stop_index){
         VG_(message)(Vg_UserMsg, "User-specified index has been reached (--record-stop).\n");
-        VG_(message)(Vg_UserMsg, "Index %llu assigned at\n",nextindex);
+        VG_(message)(Vg_UserMsg, "Index %llu assigned at\n",newindex);
         VG_(get_and_pp_StackTrace)(VG_(get_running_tid)(), 16);
         VG_(message)(Vg_UserMsg, "\n");
         VG_(gdbserver)(VG_(get_running_tid)());
@@ -96,46 +292,46 @@ ULong tapeAddStatement_noActivityAnalysis(ULong index1,ULong index2,double diff1
       stop_index = recording_stop_indices[i];
     }
   }
-  nextindex++;
-  if(nextindex%BUFSIZE==0){
+  tape->nextindex++;
+  if((tape_per_thread || index_namespace!=0) && tape->nextindex >= (1ull<<DG_TAPE_THREAD_SHIFT)){
+    VG_(printf)("Too many tape blocks for a single thread or namespace with --tape-per-thread=yes or --index-namespace.\n");
+    tl_assert(False);
+  }
+  if(bar_index32 && tape->nextindex >= 0x80000000ull){
+    // we are inside a dirty call, so leave the tape files to dg_fini
+    VG_(message)(Vg_UserMsg, "Too many tape blocks for --index-bits=32. Recording stops here.\n");
+    dg_bar_tape_full = True;
+    dg_bar_tape_write_format();
+  }
+  if(tape->nextindex%BUFSIZE==0){
     if(tape_in_ram){
-      buffer_tape = VG_(malloc)("Tape buffer reallocation.",BUFSIZE*4*sizeof(ULong));
+      tape->buffer_tape = VG_(malloc)("Tape buffer reallocation.",BUFSIZE*dg_bar_tape_blocksize);
       // The connection to previous tape buffers is lost and they will never be freed;
       // note that --tape-to-ram=yes is only for benchmarking purposes.
     } else {
-      VG_(write)(fd_tape,buffer_tape,4*BUFSIZE*sizeof(ULong));
+      dg_bar_tape_flush(tape->fd_tape,tape->buffer_tape,BUFSIZE*dg_bar_tape_blocksize);
     }
   }
   if(index1==0xffffffffffffffff||index2==0xffffffffffffffff){
     VG_(message)(Vg_UserMsg, "Result of unwrapped operation used as input of differentiable operation.\n");
-    VG_(message)(Vg_UserMsg, "Index of result of differentiable operation: %llu.\n",nextindex-1);
+    VG_(message)(Vg_UserMsg, "Index of result of differentiable operation: %llu.\n",newindex);
     VG_(get_and_pp_StackTrace)(VG_(get_running_tid)(), 16);
     VG_(message)(Vg_UserMsg, "\n");
   }
-  return typegrind ? 0 : (nextindex-1);
+  return typegrind ? 0 : newindex;
 }
 
 void dg_bar_tape_initialize(const HChar* path){
   // open tape, input-index and output-index files
   ULong len = VG_(strlen)(path);
+  dg_bar_tape_path = VG_(malloc)("path in dg_bar_tape_initialize", len+1);
+  VG_(strcpy)(dg_bar_tape_path, path);
   HChar* filename = VG_(malloc)("filename in dg_bar_tape_initialize", len+1000);
   if(!filename){
     VG_(printf)("Cannot allocate memory for filename in dg_bar_tape_initialize.\n");
   }
   VG_(memcpy)(filename,path,len+1);
 
-  VG_(strcpy)(filename+len, "/dg-tape");
-  fd_tape = VG_(fd_open)(filename,VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC|VKI_O_LARGEFILE,0777);
-  if(fd_tape==-1){
-    VG_(printf)("Cannot open tape file at path '%s'.", filename ); tl_assert(False);
-  }
-  if(bar_record_values){
-    VG_(strcpy)(filename+len, "/dg-values");
-    fd_values = VG_(fd_open)(filename,VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC|VKI_O_LARGEFILE,0777);
-    if(fd_values==-1){
-      VG_(printf)("Cannot open values file at path '%s'.", filename ); tl_assert(False);
-    }
-  }
   VG_(strcpy)(filename+len, "/dg-input-indices");
   fp_inputs = VG_(fopen)(filename,VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC,0777);
   if(!fp_inputs){
@@ -146,19 +342,19 @@ void dg_bar_tape_initialize(const HChar* path){
   if(!fp_outputs){
     VG_(printf)("Cannot open output indices file at path '%s'.", filename ); tl_assert(False);
   }
+  // describe the layout of tape blocks for the evaluation tools
+  dg_bar_tape_blocksize = (bar_index32 ? 2*sizeof(UInt) : 2*sizeof(ULong))
+                          + (bar_partials_f32 ? 2*sizeof(float) : 2*sizeof(double));
+  dg_bar_tape_write_format();
   VG_(free)(filename);
 
-  // allocate and zero buffer for tape
-  buffer_tape = VG_(malloc)("Tape buffer", BUFSIZE*4*sizeof(ULong));
-  for(ULong i=0; i<4*BUFSIZE; i++){
-    buffer_tape[i] = 0;
+  // Per-thread tapes are opened when the thread first writes to its tape.
+  dg_bar_tapes = VG_(malloc)("Tapes", (VG_N_THREADS+1)*sizeof(DgBarTape));
+  for(UInt i=0; i<VG_N_THREADS+1; i++){
+    dg_bar_tapes[i].buffer_tape = NULL;
   }
-  // allocate and zero buffer for values
-  if(bar_record_values){
-    buffer_values = VG_(malloc)("Values buffer", BUFSIZE*sizeof(ULong));
-    for(ULong i=0; i<BUFSIZE; i++){
-      buffer_values[i] = 0;
-    }
+  if(!tape_per_thread){
+    dg_bar_tape_open(&dg_bar_tapes[0],0);
   }
 }
 
@@ -168,27 +364,116 @@ void dg_bar_tape_write_input_index(ULong index){
 void dg_bar_tape_write_output_index(ULong index){
   VG_(fprintf)(fp_outputs,"%llu\n", index);
 }
+void dg_bar_tape_write_indices(Bool output, const ULong* indices, ULong count){
+  if(count==0) return;
+  // at most 20 decimal digits and a newline per index
+  HChar* text = VG_(malloc)("Index file text", count*21+1);
+  HChar* pos = text;
+  for(ULong i=0; i<count; i++){
+    pos += VG_(sprintf)(pos,"%llu\n", indices[i]);
+  }
+  VG_(fprintf)(output ? fp_outputs : fp_inputs, "%s", text);
+  VG_(free)(text);
+}
 
-void valuesAddStatement(double value){
-  ULong pos = ((nextindex-1)%BUFSIZE);
-  buffer_values[pos] = *(ULong*)&value;
-  if(nextindex%BUFSIZE==0){
-    VG_(write)(fd_values,buffer_values,BUFSIZE*sizeof(ULong));
+void valuesAddStatement(double value, UChar opcode){
+  DgBarTape* tape = dg_bar_tape_current();
+  ULong pos = ((tape->nextindex-1)%BUFSIZE);
+  tape->buffer_values[pos] = *(ULong*)&value;
+  tape->buffer_opcodes[pos] = opcode;
+  if(tape->nextindex%BUFSIZE==0){
+    dg_bar_tape_flush(tape->fd_values,tape->buffer_values,BUFSIZE*sizeof(ULong));
+    dg_bar_tape_flush(tape->fd_opcodes,tape->buffer_opcodes,BUFSIZE*sizeof(UChar));
   }
 }
 
+DgBarProfileCounter* dg_bar_profile_new_counter(Addr addr){
+  if(!dg_bar_profile_counters){
+    dg_bar_profile_counters = VG_(newXA)(VG_(malloc), "Profile counters", VG_(free), sizeof(DgBarProfileCounter*));
+  }
+  DgBarProfileCounter* counter = VG_(malloc)("Profile counter", sizeof(DgBarProfileCounter));
+  counter->addr = addr;
+  counter->epoch = VG_(current_DiEpoch)();
+  counter->blocks = 0;
+  VG_(addToXA)(dg_bar_profile_counters, &counter);
+  return counter;
+}
+
+static Int dg_bar_profile_cmp(const void* a, const void* b){
+  Addr addr_a = (*(DgBarProfileCounter* const*)a)->addr;
+  Addr addr_b = (*(DgBarProfileCounter* const*)b)->addr;
+  return addr_a<addr_b ? -1 : (addr_a>addr_b ? 1 : 0);
+}
+
+/*! Write the profile in the Callgrind format.
+ *
+ *  Superblocks translated several times have several counters,
+ *  which are summed up.
+ */
+static void dg_bar_profile_write(void){
+  ULong len = VG_(strlen)(dg_bar_tape_path);
+  HChar* filename = VG_(malloc)("filename in dg_bar_profile_write", len+1000);
+  VG_(strcpy)(filename, dg_bar_tape_path);
+  VG_(strcpy)(filename+len, "/callgrind.out.derivgrind");
+  VgFile* fp = VG_(fopen)(filename,VKI_O_WRONLY|VKI_O_CREAT|VKI_O_TRUNC,0777);
+  if(!fp){
+    VG_(printf)("Cannot open profile file at path '%s'.", filename ); tl_assert(False);
+  }
+  VG_(free)(filename);
+
+  ULong bytes_per_block = dg_bar_tape_blocksize + (bar_record_values ? sizeof(ULong)+sizeof(UChar) : 0);
+  Word n = dg_bar_profile_counters ? VG_(sizeXA)(dg_bar_profile_counters) : 0;
+  ULong total = 0;
+  for(Word i=0; i<n; i++){
+    total += (*(DgBarProfileCounter**)VG_(indexXA)(dg_bar_profile_counters,i))->blocks;
+  }
+  VG_(fprintf)(fp, "# callgrind format\nversion: 1\ncreator: derivgrind\npid: %d\ncmd: %s\n",
+    VG_(getpid)(), VG_(args_the_exename));
+  VG_(fprintf)(fp, "positions: instr line\nevents: TapeBlocks TapeBytes\nsummary: %llu %llu\n\n",
+    total, total*bytes_per_block);
+
+  if(n>0){
+    VG_(setCmpFnXA)(dg_bar_profile_counters, dg_bar_profile_cmp);
+    VG_(sortXA)(dg_bar_profile_counters);
+  }
+  for(Word i=0; i<n; ){
+    DgBarProfileCounter* counter = *(DgBarProfileCounter**)VG_(indexXA)(dg_bar_profile_counters,i);
+    ULong blocks = 0;
+    for(; i<n && (*(DgBarProfileCounter**)VG_(indexXA)(dg_bar_profile_counters,i))->addr==counter->addr; i++){
+      blocks += (*(DgBarProfileCounter**)VG_(indexXA)(dg_bar_profile_counters,i))->blocks;
+    }
+    if(blocks==0) continue;
+    const HChar *file, *dir, *fn;
+    UInt line;
+    if(!VG_(get_filename_linenum)(counter->epoch, counter->addr, &file, &dir, &line)){
+      file = "???"; line = 0;
+    }
+    VG_(fprintf)(fp, "fl=%s\n", file);
+    if(!VG_(get_fnname)(counter->epoch, counter->addr, &fn)) fn = "???";
+    VG_(fprintf)(fp, "fn=%s\n", fn);
+    VG_(fprintf)(fp, "0x%lx %u %llu %llu\n", counter->addr, line, blocks, blocks*bytes_per_block);
+  }
+  VG_(fclose)(fp);
+
+  for(Word i=0; i<n; i++){
+    VG_(free)(*(DgBarProfileCounter**)VG_(indexXA)(dg_bar_profile_counters,i));
+  }
+  if(dg_bar_profile_counters) VG_(deleteXA)(dg_bar_profile_counters);
+}
+
+void dg_bar_tape_print_stats(void){
+  VG_(message)(Vg_UserMsg, "  tape blocks:              %llu\n", dg_bar_tape_total_blocks);
+  VG_(message)(Vg_UserMsg, "  tape/values flushes:      %llu\n", dg_bar_tape_total_flushes);
+  VG_(message)(Vg_UserMsg, "  tape/values bytes:        %llu\n", dg_bar_tape_total_bytes);
+}
+
 void dg_bar_tape_finalize(void){
-  ULong pos = (nextindex%BUFSIZE);
-  if(pos>0){ // flush buffers
-    VG_(write)(fd_tape,buffer_tape,pos*4*sizeof(ULong));
-    if(bar_record_values) VG_(write)(fd_values,buffer_values,pos*sizeof(ULong));
+  if(bar_record_profile) dg_bar_profile_write();
+  for(UInt i=0; i<VG_N_THREADS+1; i++){
+    if(dg_bar_tapes[i].buffer_tape) dg_bar_tape_close(&dg_bar_tapes[i]);
   }
-  VG_(close)(fd_tape);
-  VG_(close)(fd_values);
+  VG_(free)(dg_bar_tapes);
   VG_(fclose)(fp_inputs);
   VG_(fclose)(fp_outputs);
-
-  VG_(free)(buffer_tape);
-  if(bar_record_values) VG_(free)(buffer_values);
+  VG_(free)(dg_bar_tape_path);
 }
-
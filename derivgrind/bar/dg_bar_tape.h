@@ -34,6 +34,18 @@
 
 #include "pub_tool_basics.h"
 
+/*! With --tape-per-thread=yes, the upper bits of an index starting from this
+ *  bit contain the ID of the thread whose tape the block is recorded on.
+ *  The lower bits contain the position of the block on that tape.
+ *
+ *  With --index-namespace=<n>, the upper bits contain n instead.
+ */
+#define DG_TAPE_THREAD_SHIFT 48
+
+/*! Whether the tape has run out of indices for --index-bits=32.
+ */
+extern Bool dg_bar_tape_full;
+
 /*! Add one elementary operation to the tape if an active variable is involved.
  *  \param index1 - Index of first operand.
  *  \param index2 - Index of second operand.
@@ -48,7 +60,8 @@ ULong tapeAddStatement(ULong index1,ULong index2,double diff1,double diff2);
  *  \param index2 - Index of second operand.
  *  \param diff1 - Partial derivative of result w.r.t. first operand.
  *  \param diff2 - Partial derivative of result w.r.t. second operand.
- *  \returns Index of result of operation, newly assigned and in particular non-zero.
+ *  \returns Index of result of operation, newly assigned and in particular non-zero,
+ *    unless recording is disabled or the tape is full.
  */
 ULong tapeAddStatement_noActivityAnalysis(ULong index1,ULong index2,double diff1,double diff2);
 
@@ -60,26 +73,75 @@ void dg_bar_tape_write_input_index(ULong index);
  */
 void dg_bar_tape_write_output_index(ULong index);
 
-/*! Add one recorded value to the list of operation results.
+/*! Write count indices to the input-index or output-index file at once.
+ */
+void dg_bar_tape_write_indices(Bool output, const ULong* indices, ULong count);
+
+/*! Add one recorded value to the list of operation results, and the
+ *  operation code to the list of operations.
  *
  *  Call this function after the corresponding tapeAddStatement that returned a non-zero index,
  *  and only if bar_record_values==True.
  *
  *  \param value - Value to be recorded.
+ *  \param opcode - Dg_Opcode of the operation.
  */
-void valuesAddStatement(double value);
+void valuesAddStatement(double value, UChar opcode);
 // Note: We did not merge valuesAddStatement into tapeAddStatement because the dirty call would
 // need seven parameters (both halves of two indices, two partial derivatives, plus the value),
 // which is currently not possible in Valgrind/VEX. So one must have two dirty calls, and
 // correspondingly two separate functions that they call. Actually, we need to emit the
-// dirty call for valuesAddStatement only if bar_record_values==True.
+// dirty call for valuesAddStatement only if bar_record_values==True. The opcode is an
+// instrumentation-time constant, so it fits into the second dirty call.
+
+/*! Counter of tape blocks recorded by a section of a superblock, for 
+ *  --record-profile=yes.
+ *
+ *  As VEX chases calls and returns, a superblock may contain guest code
+ *  of several functions. Every maximal run of guest instructions of the
+ *  same function within a superblock is a section with its own counter.
+ *  In callgrind.out.derivgrind, all blocks of a section are charged to 
+ *  the function and source line of its first instruction, so the profile
+ *  is exact per function but only approximate per source line. Blocks
+ *  recorded by client requests are charged to the section executed last.
+ */
+typedef struct {
+  Addr addr; //!< Guest address of the first instruction of the section.
+  DiEpoch epoch; //!< Debug info epoch at instrumentation time.
+  ULong blocks; //!< Number of tape blocks recorded.
+} DgBarProfileCounter;
+
+/*! Counter of the section executed last, or NULL.
+ *
+ *  With --record-profile=yes, every section of an instrumented superblock 
+ *  starts with a store of its counter to this variable.
+ */
+extern DgBarProfileCounter* dg_bar_profile_current;
+
+/*! Allocate a counter for the section starting at guest address addr.
+ */
+DgBarProfileCounter* dg_bar_profile_new_counter(Addr addr);
 
 /*! Initialize tape.
+ *
+ *  Also writes dg-tape-format, which describes the layout of the tape blocks:
+ *  two indices of 64 or 32 bits (--index-bits), followed by two partial
+ *  derivatives of 64 or 32 bits (--tape-partials). If the tape runs out of
+ *  indices, the file is rewritten with the line "incomplete 1".
  */
 void dg_bar_tape_initialize(const HChar* filename);
 
 /*! Finalize tape.
+ *
+ *  With --record-profile=yes, also write the profile callgrind.out.derivgrind.
  */
 void dg_bar_tape_finalize(void);
 
+/*! Print the number of tape blocks, and the number and total size of
+ *  writes to the tape and values files, for --instr-stats=yes.
+ *
+ *  Call after dg_bar_tape_finalize.
+ */
+void dg_bar_tape_print_stats(void);
+
 #endif // DG_BAR_TAPE_H
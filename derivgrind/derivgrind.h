@@ -76,6 +76,13 @@ typedef
       VG_USERREQ__GET_MODE,
       VG_USERREQ__GET_FLAGS,
       VG_USERREQ__SET_FLAGS,
+      VG_USERREQ__MEMMOVE,
+      VG_USERREQ__MEMSET,
+      VG_USERREQ__INPUT_ARRAY,
+      VG_USERREQ__OUTPUT_ARRAY,
+      VG_USERREQ__START,
+      VG_USERREQ__STOP,
+      VG_USERREQ__CLEAR,
    } Vg_DerivgrindClientRequest;
 
 typedef enum {
@@ -83,6 +90,35 @@ typedef enum {
      DG_INDEXFILE_OUTPUT
    } Dg_Indexfile;
 
+/* Operation codes stored for every tape block in the file dg-opcodes, if
+   recording with --record-values=yes. Together with the values in dg-values
+   and the partial derivatives on the tape, they determine the second-order
+   partial derivatives of the operation, as required by tape-evaluation --hvp.
+   Blocks pushed by DG_NEW_INDEX get DG_OPCODE_UNKNOWN, so tape-evaluation
+   --hvp warns about them; use DG_NEW_INDEX_OPCODE to specify the operation.
+   DG_NEW_INDEX_NOACTIVITYANALYSIS, which DG_INPUT and DG_OUTPUT use to
+   copy indices, records DG_OPCODE_LINEAR.
+   !! ABIWARNING !! Add new entries at the end. */
+typedef enum {
+     DG_OPCODE_LINEAR, /* partial derivatives are locally constant (add, sub, neg, abs, copies, ...) */
+     DG_OPCODE_UNKNOWN, /* second-order partial derivatives are not available */
+     DG_OPCODE_MUL,
+     DG_OPCODE_DIV,
+     DG_OPCODE_SQRT,
+     DG_OPCODE_EXP,
+     DG_OPCODE_LOG,
+     DG_OPCODE_LOG10,
+     DG_OPCODE_SIN,
+     DG_OPCODE_COS,
+     DG_OPCODE_TAN,
+     DG_OPCODE_SINH,
+     DG_OPCODE_COSH,
+     DG_OPCODE_TANH,
+     DG_OPCODE_ASIN,
+     DG_OPCODE_ACOS,
+     DG_OPCODE_ATAN
+   } Dg_Opcode;
+
 /* === Client-code macros to manipulate the state of memory. === */
 // We added synonymes that write out "DG_" as "DERIVGRNID_" for better
 // readability, and the VALGRIND_[S/G]ET_DERIVATIVE from the first preprint.
@@ -105,6 +141,15 @@ typedef enum {
 #define DERIVGRIND_SET_DOTVALUE(_qzz_addr,_qzz_daddr,_qzz_size) DG_SET_DOTVALUE(_qzz_addr,_qzz_daddr,_qzz_size)
 #define VALGRIND_SET_DERIVATIVE(_qzz_addr,_qzz_daddr,_qzz_size) DG_SET_DOTVALUE(_qzz_addr,_qzz_daddr,_qzz_size)
 
+/* Get/set dot values of an array of _qzz_count variables of type _qzz_type
+ * at _qzz_addr, from/to the array of dot values at _qzz_daddr, by a single
+ * client request.
+ */
+#define DG_GET_DOTVALUE_ARRAY(_qzz_addr,_qzz_daddr,_qzz_count,_qzz_type) DG_GET_DOTVALUE(_qzz_addr,_qzz_daddr,(_qzz_count)*sizeof(_qzz_type))
+#define DERIVGRIND_GET_DOTVALUE_ARRAY(_qzz_addr,_qzz_daddr,_qzz_count,_qzz_type) DG_GET_DOTVALUE_ARRAY(_qzz_addr,_qzz_daddr,_qzz_count,_qzz_type)
+#define DG_SET_DOTVALUE_ARRAY(_qzz_addr,_qzz_daddr,_qzz_count,_qzz_type) DG_SET_DOTVALUE(_qzz_addr,_qzz_daddr,(_qzz_count)*sizeof(_qzz_type))
+#define DERIVGRIND_SET_DOTVALUE_ARRAY(_qzz_addr,_qzz_daddr,_qzz_count,_qzz_type) DG_SET_DOTVALUE_ARRAY(_qzz_addr,_qzz_daddr,_qzz_count,_qzz_type)
+
 /* Disable certain Derivgrind actions on specific sections of user code
  * by putting the section into a DG_DISABLE(1,0) ... DG_DISABLE(0,1) bracket.
  *
@@ -166,6 +211,7 @@ static TapeBlockInfo tbi;
 * _qzz_diff1addr, _qzz_diff2addr point to 8-byte (double) partial derivatives,
 * _qzz_newindexaddr points to 8 byte for new index, which can be zero if input indices are zero,
 * _qzz_valueaddr points to double for value.
+* The second-order partial derivatives are unknown, see Dg_Opcode.
 */
 #define DG_NEW_INDEX(_qzz_index1addr,_qzz_index2addr,_qzz_diff1addr,_qzz_diff2addr,_qzz_newindexaddr,_qzz_valueaddr)  \
    ( \
@@ -177,10 +223,28 @@ static TapeBlockInfo tbi;
      tbi.valueaddr = _qzz_valueaddr, \
      VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
                             VG_USERREQ__NEW_INDEX,          \
-                            &tbi, 0, 0, 0, 0) \
+                            &tbi, DG_OPCODE_UNKNOWN, 0, 0, 0) \
    )
 #define DERIVGRIND_NEW_INDEX(_qzz_index1addr,_qzz_index2addr,_qzz_diff1addr,_qzz_diff2addr,_qzz_newindexaddr,_qzz_valueaddr) DG_NEW_INDEX(_qzz_index1addr,_qzz_index2addr,_qzz_diff1addr,_qzz_diff2addr,_qzz_newindexaddr,_qzz_valueaddr)
 
+/* Push new operation to the tape, with activity analysis, like DG_NEW_INDEX.
+* _qzz_opcode is the Dg_Opcode of the operation, which is recorded into
+* dg-opcodes with --record-values=yes.
+*/
+#define DG_NEW_INDEX_OPCODE(_qzz_index1addr,_qzz_index2addr,_qzz_diff1addr,_qzz_diff2addr,_qzz_newindexaddr,_qzz_valueaddr,_qzz_opcode)  \
+   ( \
+     tbi.index1addr = _qzz_index1addr, \
+     tbi.index2addr = _qzz_index2addr, \
+     tbi.diff1addr = _qzz_diff1addr, \
+     tbi.diff2addr = _qzz_diff2addr, \
+     tbi.newindexaddr = _qzz_newindexaddr, \
+     tbi.valueaddr = _qzz_valueaddr, \
+     VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
+                            VG_USERREQ__NEW_INDEX,          \
+                            &tbi, (_qzz_opcode), 0, 0, 0) \
+   )
+#define DERIVGRIND_NEW_INDEX_OPCODE(_qzz_index1addr,_qzz_index2addr,_qzz_diff1addr,_qzz_diff2addr,_qzz_newindexaddr,_qzz_valueaddr,_qzz_opcode) DG_NEW_INDEX_OPCODE(_qzz_index1addr,_qzz_index2addr,_qzz_diff1addr,_qzz_diff2addr,_qzz_newindexaddr,_qzz_valueaddr,_qzz_opcode)
+
 
 /* Push new operation to the tape, without activity analysis.
 * _qzz_index1addr, _qzz_index2addr point to 8-byte indices,
@@ -210,6 +274,32 @@ static TapeBlockInfo tbi;
                             (_qzz_outputfile), (_qzz_indexaddr), 0, 0, 0)
 #define DERIVGRIND_INDEX_TO_FILE(_qzz_outputfile,_qzz_addrindex) DG_INDEX_TO_FILE(_qzz_outputfile,_qzz_addrindex)
 
+/* Mark an array of _qzz_count floating-point variables of type _qzz_type
+ * (float or double) at _qzz_addr as AD inputs, assigning
+ * consecutive new indices to them, and dump the indices into the input-index file.
+ *
+ * This does the same as DG_INPUTF for every element, but by a single 
+ * client request.
+ */
+#define DG_INPUT_ARRAY(_qzz_addr,_qzz_count,_qzz_type)  \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
+                            VG_USERREQ__INPUT_ARRAY,          \
+                            (_qzz_addr), (_qzz_count), sizeof(_qzz_type), 0, 0)
+#define DERIVGRIND_INPUT_ARRAY(_qzz_addr,_qzz_count,_qzz_type) DG_INPUT_ARRAY(_qzz_addr,_qzz_count,_qzz_type)
+
+/* Mark an array of _qzz_count floating-point variables of type _qzz_type
+ * (float or double) at _qzz_addr as AD outputs, and dump
+ * their indices into the output-index file.
+ *
+ * This does the same as DG_OUTPUTF for every element, but by a single 
+ * client request.
+ */
+#define DG_OUTPUT_ARRAY(_qzz_addr,_qzz_count,_qzz_type)  \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
+                            VG_USERREQ__OUTPUT_ARRAY,          \
+                            (_qzz_addr), (_qzz_count), sizeof(_qzz_type), 0, 0)
+#define DERIVGRIND_OUTPUT_ARRAY(_qzz_addr,_qzz_count,_qzz_type) DG_OUTPUT_ARRAY(_qzz_addr,_qzz_count,_qzz_type)
+
 /* Get flags of the bit-trick finder.
  */
 #define DG_GET_FLAGS(_qzz_addr,_qzz_Aaddr, _qzz_Daddr, _qzz_size)  \
@@ -224,6 +314,29 @@ static TapeBlockInfo tbi;
                             VG_USERREQ__SET_FLAGS,\
                             (_qzz_addr), (_qzz_Aaddr), (_qzz_Daddr), (_qzz_size), 0)
 
+/* Copy _qzz_size bytes from _qzz_src to _qzz_dst together with their
+ * shadow (dot values, indices or flags), like memmove does.
+ * The copy is done by Derivgrind itself rather than on the simulated CPU,
+ * so large copies are much faster than an instrumented copy loop.
+ * Evaluates to 1 on success, and to 0 if the client code has to do the
+ * copy by itself (e.g. because an address range is not accessible).
+ */
+#define DG_MEMMOVE(_qzz_dst,_qzz_src,_qzz_size)  \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
+                            VG_USERREQ__MEMMOVE,          \
+                            (_qzz_dst), (_qzz_src), (_qzz_size), 0, 0)
+#define DERIVGRIND_MEMMOVE(_qzz_dst,_qzz_src,_qzz_size) DG_MEMMOVE(_qzz_dst,_qzz_src,_qzz_size)
+
+/* Fill _qzz_size bytes at _qzz_dst with the byte _qzz_c, and zero their
+ * shadow, like memset does. Evaluates to 1 on success and 0 otherwise,
+ * as DG_MEMMOVE.
+ */
+#define DG_MEMSET(_qzz_dst,_qzz_c,_qzz_size)  \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
+                            VG_USERREQ__MEMSET,          \
+                            (_qzz_dst), (_qzz_c), (_qzz_size), 0, 0)
+#define DERIVGRIND_MEMSET(_qzz_dst,_qzz_c,_qzz_size) DG_MEMSET(_qzz_dst,_qzz_c,_qzz_size)
+
 /* Get AD mode.
  */
 #define DG_GET_MODE  \
@@ -232,6 +345,36 @@ static TapeBlockInfo tbi;
                             0, 0, 0, 0, 0)
 #define DERIVGRIND_GET_MODE DG_GET_MODE
 
+/* Switch AD instrumentation on or off. Code executed after DG_STOP runs
+ * at native Valgrind speed, but its effects on dot values, indices or 
+ * flags are not tracked: Shadows of variables written in between keep
+ * their previous state. With --activate=on-first-input, Derivgrind starts
+ * in the stopped state and switches the instrumentation on when the first
+ * AD input is registered (a non-zero dot value or flags, or a new index),
+ * or at DG_START. Evaluates to 1 if the instrumentation was on before.
+ */
+#define DG_START  \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
+                            VG_USERREQ__START,          \
+                            0, 0, 0, 0, 0)
+#define DERIVGRIND_START DG_START
+#define DG_STOP  \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
+                            VG_USERREQ__STOP,          \
+                            0, 0, 0, 0, 0)
+#define DERIVGRIND_STOP DG_STOP
+
+/* Zero the shadow (dot values, indices or flags) of _qzz_size bytes at
+ * _qzz_addr, without modifying the bytes themselves. Derivgrind does this
+ * for unmapped memory and for heap blocks released by free, so the shadow
+ * memory can be returned to the allocator. 
+ */
+#define DG_CLEAR(_qzz_addr,_qzz_size)  \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,      \
+                            VG_USERREQ__CLEAR,          \
+                            (_qzz_addr), (_qzz_size), 0, 0, 0)
+#define DERIVGRIND_CLEAR(_qzz_addr,_qzz_size) DG_CLEAR(_qzz_addr,_qzz_size)
+
 
 #endif
 
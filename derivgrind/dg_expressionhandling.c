@@ -296,5 +296,76 @@ void add_statement_modified(DiffEnv* diffenv, ExpressionHandling eh, IRStmt* st_
   }
 }
 
+void add_statement_passive(DiffEnv* diffenv, ExpressionHandling eh, IRStmt* st_orig){
+  const IRStmt* st = st_orig;
+  IRTypeEnv* tyenv = diffenv->sb_out->tyenv;
+  // Shadow temporaries are never read by passive instructions, but an active
+  // instruction later in the superblock might read a temporary defined here,
+  // e.g. if VEX chases a call from an excluded function. So all shadow
+  // temporaries, registers and memory written here are cleared.
+  if(st->tag==Ist_WrTmp) {
+    IRType type = typeOfIRTemp(tyenv,st->Ist.WrTmp.tmp);
+    eh.wrtmp(diffenv,st->Ist.WrTmp.tmp,eh.default_(diffenv,type));
+  } else if(st->tag==Ist_LoadG) {
+    IRTemp dst = st->Ist.LoadG.details->dst;
+    eh.wrtmp(diffenv,dst,eh.default_(diffenv,typeOfIRTemp(tyenv,dst)));
+  } else if(st->tag==Ist_LLSC) {
+    IRTemp result = st->Ist.LLSC.result;
+    eh.wrtmp(diffenv,result,eh.default_(diffenv,typeOfIRTemp(tyenv,result)));
+  } else if(st->tag==Ist_Put) {
+    IRType type = typeOfIRExpr(tyenv,st->Ist.Put.data);
+    eh.puti(diffenv,st->Ist.Put.offset,eh.default_(diffenv,type),(IRRegArray*)NULL,(IRExpr*)NULL);
+  } else if(st->tag==Ist_PutI) {
+    IRPutI* det = st->Ist.PutI.details;
+    IRType type = typeOfIRExpr(tyenv,det->data);
+    eh.puti(diffenv,det->bias,eh.default_(diffenv,type),det->descr,det->ix);
+  } else if(st->tag==Ist_Store){
+    IRType type = typeOfIRExpr(tyenv,st->Ist.Store.data);
+    eh.store(diffenv,st->Ist.Store.addr,eh.default_(diffenv,type),(IRExpr*)NULL);
+  } else if(st->tag==Ist_StoreG){
+    IRStoreG* det = st->Ist.StoreG.details;
+    IRType type = typeOfIRExpr(tyenv,det->data);
+    eh.store(diffenv,det->addr,eh.default_(diffenv,type),det->guard);
+  } else if(st->tag==Ist_CAS) {
+    // Clear the shadow if the primal values agree, so the CAS will succeed.
+    IRCAS* det = st->Ist.CAS.details;
+    IRType type = typeOfIRExpr(tyenv,det->expdLo);
+    IRExpr* addr_Lo;
+    IRExpr* addr_Hi;
+    addressesOfCAS(det,diffenv->sb_out,&addr_Lo,&addr_Hi);
+    IROp cmp;
+    switch(type){
+      case Ity_I8: cmp = Iop_CmpEQ8; break;
+      case Ity_I16: cmp = Iop_CmpEQ16; break;
+      case Ity_I32: cmp = Iop_CmpEQ32; break;
+      case Ity_I64: cmp = Iop_CmpEQ64; break;
+      default: VG_(printf)("Unhandled type in translation of Ist_CAS.\n"); tl_assert(False); break;
+    }
+    IRExpr* succeeds = IRExpr_Binop(cmp,det->expdLo,IRExpr_Load(det->end,type,addr_Lo));
+    if(det->expdHi!=NULL){
+      succeeds = IRExpr_Binop(Iop_And1,succeeds,IRExpr_Binop(cmp,det->expdHi,IRExpr_Load(det->end,type,addr_Hi)));
+    }
+    IRTemp succeeds_tmp = newIRTemp(tyenv,Ity_I1);
+    addStmtToIRSB(diffenv->sb_out, IRStmt_WrTmp(succeeds_tmp,succeeds));
+    eh.store(diffenv,addr_Lo,eh.default_(diffenv,type),IRExpr_RdTmp(succeeds_tmp));
+    eh.wrtmp(diffenv,det->oldLo,eh.default_(diffenv,type));
+    if(det->expdHi!=NULL){
+      eh.store(diffenv,addr_Hi,eh.default_(diffenv,type),IRExpr_RdTmp(succeeds_tmp));
+      eh.wrtmp(diffenv,det->oldHi,eh.default_(diffenv,type));
+    }
+  } else if(st->tag==Ist_Dirty) {
+    IRDirty* det = st->Ist.Dirty.details;
+    const HChar* name = det->cee->name;
+    if(!VG_(strcmp)(name, "x86g_dirtyhelper_storeF80le") ||
+       !VG_(strcmp)(name, "amd64g_dirtyhelper_storeF80le") ){
+      IRType type = typeOfIRExpr(tyenv,det->args[1]);
+      eh.dirty_storeF80le(diffenv,det->args[0],eh.default_(diffenv,type));
+    }
+    if(det->tmp!=IRTemp_INVALID){
+      eh.wrtmp(diffenv,det->tmp,eh.default_(diffenv,typeOfIRTemp(tyenv,det->tmp)));
+    }
+  }
+}
+
 /* --- Helper functions. ---*/
 
@@ -196,6 +196,17 @@ void* dg_modify_expression_or_default(DiffEnv* diffenv, ExpressionHandling eh, I
  */
 void add_statement_modified(DiffEnv* diffenv, ExpressionHandling eh, IRStmt* st_orig);
 
+/*! Add passive instrumentation to output IRSB, for statements in functions
+ *  excluded by --no-instrument.
+ *
+ *  Shadows of registers and memory written by the statement are set to the
+ *  default data, nothing is computed or loaded from shadow locations.
+ *  \param diffenv - General setup.
+ *  \param eh - Mode-dependent details of the instrumentation.
+ *  \param st_orig - Original statement to be instrumented.
+ */
+void add_statement_passive(DiffEnv* diffenv, ExpressionHandling eh, IRStmt* st_orig);
+
 
 
 #endif // DG_EXPRESSIONHANDLING_H
@@ -0,0 +1,212 @@
+/*--------------------------------------------------------------------*/
+/*--- Instrumentation statistics.                  dg_instrstats.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "dg_instrstats.h"
+#include "dg_utils.h"
+
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_mallocfree.h"
+
+Bool instr_stats = False;
+
+//! Maximal number of distinct helpers.
+#define DG_INSTRSTATS_MAXHELPERS 256
+
+/*! Statistics for a dirty call or clean helper.
+ */
+typedef struct {
+  const HChar* name; //!< Name of the helper.
+  Bool dirty; //!< True for dirty calls, False for ccalls.
+  ULong emitted; //!< Number of calls emitted into instrumented superblocks.
+  ULong executed; //!< Number of executions of a dirty call.
+} DgInstrStatsHelper;
+
+static DgInstrStatsHelper dg_instrstats_helpers[DG_INSTRSTATS_MAXHELPERS];
+static Int dg_instrstats_nhelpers = 0;
+
+static ULong dg_instrstats_superblocks = 0;
+static ULong dg_instrstats_stmts_in = 0;
+static ULong dg_instrstats_stmts_out = 0;
+
+/*! Find or create the entry of a helper.
+ *
+ *  Helper names are string literals, so we can often compare pointers.
+ */
+static DgInstrStatsHelper* dg_instrstats_helper(const HChar* name, Bool dirty){
+  for(Int i=0; i<dg_instrstats_nhelpers; i++){
+    DgInstrStatsHelper* helper = &dg_instrstats_helpers[i];
+    if(helper->dirty==dirty && (helper->name==name || VG_(strcmp)(helper->name,name)==0))
+      return helper;
+  }
+  if(dg_instrstats_nhelpers==DG_INSTRSTATS_MAXHELPERS){
+    VG_(printf)("Too many distinct helpers for --instr-stats=yes.\n");
+    tl_assert(False);
+  }
+  DgInstrStatsHelper* helper = &dg_instrstats_helpers[dg_instrstats_nhelpers++];
+  helper->name = name;
+  helper->dirty = dirty;
+  helper->emitted = 0;
+  helper->executed = 0;
+  return helper;
+}
+
+//! Count ccalls within an expression.
+static void dg_instrstats_expr(IRExpr* ex){
+  if(!ex) return;
+  switch(ex->tag){
+    case Iex_CCall:
+      dg_instrstats_helper(ex->Iex.CCall.cee->name,False)->emitted++;
+      for(Int i=0; ex->Iex.CCall.args[i]; i++) dg_instrstats_expr(ex->Iex.CCall.args[i]);
+      break;
+    case Iex_GetI: dg_instrstats_expr(ex->Iex.GetI.ix); break;
+    case Iex_Qop:
+      dg_instrstats_expr(ex->Iex.Qop.details->arg1);
+      dg_instrstats_expr(ex->Iex.Qop.details->arg2);
+      dg_instrstats_expr(ex->Iex.Qop.details->arg3);
+      dg_instrstats_expr(ex->Iex.Qop.details->arg4);
+      break;
+    case Iex_Triop:
+      dg_instrstats_expr(ex->Iex.Triop.details->arg1);
+      dg_instrstats_expr(ex->Iex.Triop.details->arg2);
+      dg_instrstats_expr(ex->Iex.Triop.details->arg3);
+      break;
+    case Iex_Binop:
+      dg_instrstats_expr(ex->Iex.Binop.arg1);
+      dg_instrstats_expr(ex->Iex.Binop.arg2);
+      break;
+    case Iex_Unop: dg_instrstats_expr(ex->Iex.Unop.arg); break;
+    case Iex_Load: dg_instrstats_expr(ex->Iex.Load.addr); break;
+    case Iex_ITE:
+      dg_instrstats_expr(ex->Iex.ITE.cond);
+      dg_instrstats_expr(ex->Iex.ITE.iftrue);
+      dg_instrstats_expr(ex->Iex.ITE.iffalse);
+      break;
+    default: break;
+  }
+}
+
+//! Count ccalls within a statement.
+static void dg_instrstats_stmt(IRStmt* st){
+  switch(st->tag){
+    case Ist_Put: dg_instrstats_expr(st->Ist.Put.data); break;
+    case Ist_PutI:
+      dg_instrstats_expr(st->Ist.PutI.details->ix);
+      dg_instrstats_expr(st->Ist.PutI.details->data);
+      break;
+    case Ist_WrTmp: dg_instrstats_expr(st->Ist.WrTmp.data); break;
+    case Ist_Store:
+      dg_instrstats_expr(st->Ist.Store.addr);
+      dg_instrstats_expr(st->Ist.Store.data);
+      break;
+    case Ist_StoreG:
+      dg_instrstats_expr(st->Ist.StoreG.details->addr);
+      dg_instrstats_expr(st->Ist.StoreG.details->data);
+      dg_instrstats_expr(st->Ist.StoreG.details->guard);
+      break;
+    case Ist_LoadG:
+      dg_instrstats_expr(st->Ist.LoadG.details->addr);
+      dg_instrstats_expr(st->Ist.LoadG.details->alt);
+      dg_instrstats_expr(st->Ist.LoadG.details->guard);
+      break;
+    case Ist_Exit: dg_instrstats_expr(st->Ist.Exit.guard); break;
+    default: break;
+  }
+}
+
+//! Constant address of a counter.
+static IRExpr* dg_instrstats_addr(ULong* counter){
+  #ifdef BUILD_32BIT
+  return IRExpr_Const(IRConst_U32((Addr)counter));
+  #else
+  return IRExpr_Const(IRConst_U64((Addr)counter));
+  #endif
+}
+
+IRSB* dg_instrstats_superblock(IRSB* sb_in, IRSB* sb_out){
+  dg_instrstats_superblocks++;
+  dg_instrstats_stmts_in += sb_in->stmts_used;
+  dg_instrstats_stmts_out += sb_out->stmts_used;
+
+  IRSB* sb = deepCopyIRSBExceptStmts(sb_out);
+  for(Int i=0; i<sb_out->stmts_used; i++){
+    IRStmt* st = sb_out->stmts[i];
+    if(st->tag==Ist_Dirty){
+      IRDirty* d = st->Ist.Dirty.details;
+      DgInstrStatsHelper* helper = dg_instrstats_helper(d->cee->name,True);
+      helper->emitted++;
+      for(Int j=0; d->args[j]; j++) dg_instrstats_expr(d->args[j]);
+      // count the execution, respecting the guard of the dirty call
+      IRTemp old = newIRTemp(sb->tyenv, Ity_I64);
+      addStmtToIRSB(sb, IRStmt_WrTmp(old, IRExpr_Load(Iend_LE,Ity_I64,dg_instrstats_addr(&helper->executed))));
+      IRExpr* increment = d->guard ? IRExpr_Unop(Iop_1Uto64, d->guard) : IRExpr_Const(IRConst_U64(1));
+      addStmtToIRSB(sb, IRStmt_Store(Iend_LE, dg_instrstats_addr(&helper->executed),
+        IRExpr_Binop(Iop_Add64, IRExpr_RdTmp(old), increment)));
+    } else {
+      dg_instrstats_stmt(st);
+    }
+    addStmtToIRSB(sb, st);
+  }
+  return sb;
+}
+
+//! Sort helpers by decreasing number of executions, then emissions.
+static Int dg_instrstats_cmp(const void* a, const void* b){
+  const DgInstrStatsHelper* ha = (const DgInstrStatsHelper*)a;
+  const DgInstrStatsHelper* hb = (const DgInstrStatsHelper*)b;
+  if(ha->executed!=hb->executed) return ha->executed>hb->executed ? -1 : 1;
+  if(ha->emitted!=hb->emitted) return ha->emitted>hb->emitted ? -1 : 1;
+  return 0;
+}
+
+void dg_instrstats_print(HChar mode){
+  const HChar* modename = mode=='d' ? "forward" : (mode=='b' ? "recording" : "bit-trick finding");
+  VG_(message)(Vg_UserMsg, "Instrumentation statistics (%s mode):\n", modename);
+  VG_(message)(Vg_UserMsg, "  superblocks instrumented: %llu\n", dg_instrstats_superblocks);
+  VG_(message)(Vg_UserMsg, "  statements in:            %llu\n", dg_instrstats_stmts_in);
+  VG_(message)(Vg_UserMsg, "  statements out:           %llu\n", dg_instrstats_stmts_out);
+  VG_(message)(Vg_UserMsg, "  shadow statements:        %llu\n", dg_instrstats_stmts_out-dg_instrstats_stmts_in);
+  if(dg_instrstats_stmts_in>0){
+    ULong growth = 100*dg_instrstats_stmts_out/dg_instrstats_stmts_in;
+    VG_(message)(Vg_UserMsg, "  IRSB growth factor:       %llu.%02llu\n", growth/100, growth%100);
+  }
+  VG_(ssort)(dg_instrstats_helpers, dg_instrstats_nhelpers, sizeof(DgInstrStatsHelper), dg_instrstats_cmp);
+  VG_(message)(Vg_UserMsg, "  %-6s %12s %16s  %s\n", "kind", "emitted", "executed", "helper");
+  for(Int i=0; i<dg_instrstats_nhelpers; i++){
+    DgInstrStatsHelper* helper = &dg_instrstats_helpers[i];
+    if(helper->dirty){
+      VG_(message)(Vg_UserMsg, "  %-6s %12llu %16llu  %s\n", "dirty", helper->emitted, helper->executed, helper->name);
+    } else {
+      VG_(message)(Vg_UserMsg, "  %-6s %12llu %16s  %s\n", "ccall", helper->emitted, "-", helper->name);
+    }
+  }
+}
@@ -0,0 +1,68 @@
+/*--------------------------------------------------------------------*/
+/*--- Instrumentation statistics.                  dg_instrstats.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef DG_INSTRSTATS_H
+#define DG_INSTRSTATS_H
+
+#include "pub_tool_basics.h"
+#include "pub_tool_tooliface.h"
+
+/*! \page instrstats Instrumentation statistics
+ *
+ *  With --instr-stats=yes, Derivgrind counts
+ *  - the statements of every superblock before and after instrumentation,
+ *  - the dirty calls and clean helper calls (ccalls) emitted into the
+ *    instrumented superblocks, by helper name, and
+ *  - how often each dirty call is executed.
+ *
+ *  For the latter, every dirty call is preceded by the increment of a
+ *  counter in memory. The counters slightly distort the run time, but
+ *  not the relative numbers. The statistics are printed at exit.
+ */
+
+/*! Whether to collect instrumentation statistics.
+ */
+extern Bool instr_stats;
+
+/*! Update the statistics with an instrumented superblock, and add
+ *  counters for the execution of dirty calls.
+ *  \param sb_in - Original superblock.
+ *  \param sb_out - Instrumented superblock.
+ *  \returns Instrumented superblock with counters.
+ */
+IRSB* dg_instrstats_superblock(IRSB* sb_in, IRSB* sb_out);
+
+/*! Print the statistics.
+ *  \param mode - Mode of Derivgrind ('d', 'b' or 't').
+ */
+void dg_instrstats_print(HChar mode);
+
+#endif // DG_INSTRSTATS_H
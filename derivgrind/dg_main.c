@@ -38,10 +38,18 @@
 #include "pub_tool_threadstate.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_options.h"
+#include "pub_tool_aspacemgr.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_transtab.h"
+#include "pub_tool_debuginfo.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_seqmatch.h"
 #include "valgrind.h"
 #include "derivgrind.h"
 
 #include "dg_utils.h"
+#include "dg_instrstats.h"
+#include "dg_shadow.h"
 
 #include "dot/dg_dot_shadow.h"
 #include "bar/dg_bar_shadow.h"
@@ -108,10 +116,200 @@ const ULong* recording_stop_indices = NULL;
  */
 Bool tape_in_ram = False;
 
+/*! If true, record a separate tape for every thread.
+ */
+extern Bool tape_per_thread;
+
+/*! Namespace in the upper bits of all indices.
+ */
+extern Long index_namespace;
+
+/*! If true, count tape blocks per superblock.
+ */
+extern Bool bar_record_profile;
+
+/*! If true, use the slots layout for shadow memory in recording mode.
+ */
+extern Bool bar_shadow_slots;
+
+/*! If true, use 4-byte indices in a single shadow layer.
+ */
+extern Bool bar_index32;
+
+/*! If true, store partial derivatives on the tape in single precision.
+ */
+extern Bool bar_partials_f32;
+
 /*! Warnlevel for bit-trick finder.
  */
 const HChar* bittrick_warnlevel = NULL;
 
+/*! If true, translate without AD instrumentation until the first AD input
+ *  is registered (--activate=on-first-input).
+ */
+Bool activate_on_first_input = False;
+
+/*! If false, superblocks are translated without AD instrumentation.
+ *
+ *  See DG_START and DG_STOP in derivgrind.h.
+ */
+static Bool dg_active = True;
+
+/*! Switch AD instrumentation on or off.
+ *
+ *  All existing translations are discarded, so every superblock is
+ *  translated again, with or without instrumentation, before it runs next.
+ *  Client requests end a superblock, so this takes effect immediately.
+ */
+static void dg_set_active(Bool active){
+  if(active==dg_active) return;
+  dg_active = active;
+  VG_(discard_translations_safely)((Addr)0x1000, ~(SizeT)0xfff, "derivgrind");
+}
+
+/*! Compact shadow memory whenever its storage has grown by this number of
+ *  megabytes since the last compaction, 0 to disable (--shadow-compact).
+ */
+Long shadow_compact_mb = 0;
+/*! Size of the shadow memory arena region reserved at startup in
+ *  megabytes (--shadow-prealloc).
+ */
+Long shadow_prealloc_mb = 0;
+/*! Number of leaves with allocated storage after the last compaction.
+ */
+static ULong shadow_compact_live = 0;
+
+/*! Counters of shadow memory leaves, see dg_dot_shadowStats.
+ */
+static void dg_shadow_stats(ULong* live, ULong* peak, ULong* compacted, ULong* bytes){
+  if(mode=='d') dg_dot_shadowStats(live,peak,compacted,bytes);
+  else dg_bar_shadowStats(live,peak,compacted,bytes);
+}
+
+/*! Release the storage of shadow memory leaves that contain only zeros.
+ *  \returns Number of released leaves.
+ */
+static ULong dg_shadow_compact(void){
+  ULong released = mode=='d' ? dg_dot_shadowCompact() : dg_bar_shadowCompact();
+  ULong peak, compacted, bytes;
+  dg_shadow_stats(&shadow_compact_live,&peak,&compacted,&bytes);
+  return released;
+}
+
+/*! Compact shadow memory if its storage has grown by --shadow-compact
+ *  megabytes since the last compaction.
+ *
+ *  Called whenever a thread starts to run client code, where no
+ *  pointers into the storage of leaves are held.
+ */
+static void dg_shadow_compact_if_grown(ThreadId tid, ULong blocks_dispatched){
+  ULong live, peak, compacted, bytes;
+  dg_shadow_stats(&live,&peak,&compacted,&bytes);
+  if(live>shadow_compact_live && (live-shadow_compact_live)*bytes >= ((ULong)shadow_compact_mb<<20)){
+    dg_shadow_compact();
+  }
+}
+
+/*! Comma-separated list of function name patterns excluded from AD instrumentation.
+ */
+const HChar* no_instrument_str = NULL;
+/*! File with further function name patterns, one per line.
+ */
+const HChar* no_instrument_file = NULL;
+/*! Patterns from --no-instrument and --no-instrument-file, NULL-terminated.
+ */
+static const HChar** no_instrument_patterns = NULL;
+
+/*! Append the patterns in the list str, separated by any of the
+ *  characters in delim, to no_instrument_patterns.
+ *
+ *  Leading and trailing whitespace, empty patterns and lines
+ *  starting with '#' are ignored. str is modified.
+ */
+static void dg_add_no_instrument_patterns(HChar* str, const HChar* delim){
+  Int n = 0;
+  if(no_instrument_patterns){
+    while(no_instrument_patterns[n]) n++;
+  }
+  HChar* ssaveptr;
+  HChar* pattern = VG_(strtok_r)(str, delim, &ssaveptr);
+  while(pattern){
+    while(VG_(isspace)(*pattern)) pattern++;
+    HChar* end = pattern + VG_(strlen)(pattern);
+    while(end>pattern && VG_(isspace)(end[-1])) end--;
+    *end = '\0';
+    if(*pattern!='\0' && *pattern!='#'){
+      no_instrument_patterns = VG_(realloc)("No-instrument patterns",no_instrument_patterns,(n+2)*sizeof(HChar*));
+      no_instrument_patterns[n++] = VG_(strdup)("No-instrument pattern",pattern);
+      no_instrument_patterns[n] = NULL;
+    }
+    pattern = VG_(strtok_r)(NULL, delim, &ssaveptr);
+  }
+}
+
+/*! Read the patterns in the file --no-instrument-file.
+ */
+static void dg_read_no_instrument_file(const HChar* filename){
+  Int fd = VG_(fd_open)(filename,VKI_O_RDONLY,0);
+  if(fd<0){
+    VG_(printf)("Cannot open --no-instrument-file '%s'.\n", filename);
+    tl_assert(False);
+  }
+  Int size = 0, capacity = 4096;
+  HChar* content = VG_(malloc)("No-instrument file",capacity);
+  while(True){
+    Int nread = VG_(read)(fd,content+size,capacity-size-1);
+    if(nread<=0) break;
+    size += nread;
+    if(size==capacity-1){
+      capacity *= 2;
+      content = VG_(realloc)("No-instrument file",content,capacity);
+    }
+  }
+  VG_(close)(fd);
+  content[size] = '\0';
+  dg_add_no_instrument_patterns(content,"\n");
+  VG_(free)(content);
+}
+
+/*! Check whether the function containing addr is excluded by --no-instrument.
+ */
+static Bool dg_is_no_instrument(Addr addr){
+  if(!no_instrument_patterns) return False;
+  const HChar* fnname;
+  if(!VG_(get_fnname)(VG_(current_DiEpoch)(), addr, &fnname)) return False;
+  for(Int i=0; no_instrument_patterns[i]; i++){
+    if(VG_(string_match)(no_instrument_patterns[i],fnname)) return True;
+  }
+  return False;
+}
+
+/*! Called whenever an AD input is registered, activates the
+ *  instrumentation with --activate=on-first-input.
+ */
+static void dg_input_registered(void){
+  if(activate_on_first_input){
+    activate_on_first_input = False;
+    dg_set_active(True);
+  }
+}
+
+/*! Like dg_input_registered, but only if a shadow of size bytes at shadow
+ *  is non-zero.
+ *
+ *  The math and MPI wrappers set dot values and flags after every call,
+ *  mostly zeros while the instrumentation is still off, which must not
+ *  count as registering an input.
+ */
+static void dg_input_registered_if_nonzero(const void* shadow, UWord size){
+  for(UWord i=0; i<size; i++){
+    if(((const UChar*)shadow)[i]!=0){
+      dg_input_registered();
+      return;
+    }
+  }
+}
+
 static void dg_post_clo_init(void)
 {
   if(typegrind && mode!='b'){
@@ -124,6 +322,51 @@ static void dg_post_clo_init(void)
     tl_assert(False);
   }
 
+  if(tape_per_thread && mode!='b'){
+    VG_(printf)("Option --tape-per-thread=yes can only be used in recording mode (--record=path).\n");
+    tl_assert(False);
+  }
+
+  if(bar_record_profile && mode!='b'){
+    VG_(printf)("Option --record-profile=yes can only be used in recording mode (--record=path).\n");
+    tl_assert(False);
+  }
+
+  if(bar_shadow_slots && mode!='b' && mode!='t'){
+    VG_(printf)("Option --shadow-layout=slots can only be used in recording mode (--record=path) or bit-trick-finding mode (--trick=...).\n");
+    tl_assert(False);
+  }
+
+  if(bar_index32 && mode!='b'){
+    VG_(printf)("Option --index-bits=32 can only be used in recording mode (--record=path).\n");
+    tl_assert(False);
+  }
+
+  if(bar_index32 && (tape_per_thread || index_namespace!=0 || bar_shadow_slots)){
+    VG_(printf)("Option --index-bits=32 cannot be combined with --tape-per-thread=yes, --index-namespace or --shadow-layout=slots.\n");
+    tl_assert(False);
+  }
+
+  if(bar_partials_f32 && mode!='b'){
+    VG_(printf)("Option --tape-partials=f32 can only be used in recording mode (--record=path).\n");
+    tl_assert(False);
+  }
+
+  if(bar_partials_f32 && (tape_per_thread || index_namespace!=0)){
+    VG_(printf)("Option --tape-partials=f32 cannot be combined with --tape-per-thread=yes or --index-namespace.\n");
+    tl_assert(False);
+  }
+
+  if(index_namespace!=0 && mode!='b'){
+    VG_(printf)("Option --index-namespace can only be used in recording mode (--record=path).\n");
+    tl_assert(False);
+  }
+
+  if(index_namespace!=0 && tape_per_thread){
+    VG_(printf)("Options --index-namespace and --tape-per-thread=yes cannot be combined.\n");
+    tl_assert(False);
+  }
+
   if(recording_stop_indices_str && mode!='b'){
     VG_(printf)("Option --record-stop can only be used in recording mode (--record=path).\n");
     tl_assert(False);
@@ -147,6 +390,24 @@ static void dg_post_clo_init(void)
     VG_(free)(recording_stop_indices_str_copy);
   }
 
+  if(activate_on_first_input){
+    dg_active = False;
+  }
+
+  if(shadow_compact_mb>0){
+    VG_(track_start_client_code)(dg_shadow_compact_if_grown);
+  }
+  dg_shadow_arena_prealloc((ULong)shadow_prealloc_mb<<20);
+
+  if(no_instrument_str){
+    HChar* no_instrument_str_copy = VG_(strdup)("No-instrument patterns",no_instrument_str);
+    dg_add_no_instrument_patterns(no_instrument_str_copy,",");
+    VG_(free)(no_instrument_str_copy);
+  }
+  if(no_instrument_file){
+    dg_read_no_instrument_file(no_instrument_file);
+  }
+
   dg_disable = VG_(malloc)("dg-disable",(VG_N_THREADS+1)*sizeof(Long));
   for(UInt i=0; i<VG_N_THREADS+1; i++){
     dg_disable[i] = 0;
@@ -172,6 +433,22 @@ static Bool dg_process_cmd_line_option(const HChar* arg)
    else if VG_BOOL_CLO(arg, "--record-values", bar_record_values) { }
    else if VG_STR_CLO(arg, "--record-stop", recording_stop_indices_str) { }
    else if VG_BOOL_CLO(arg, "--tape-in-ram", tape_in_ram) { }
+   else if VG_BOOL_CLO(arg, "--tape-per-thread", tape_per_thread) { }
+   else if VG_BINT_CLO(arg, "--index-namespace", index_namespace, 0, 65534) { }
+   else if VG_BOOL_CLO(arg, "--record-profile", bar_record_profile) { }
+   else if VG_BOOL_CLO(arg, "--instr-stats", instr_stats) { }
+   else if VG_XACT_CLO(arg, "--shadow-layout=split", bar_shadow_slots, False) { }
+   else if VG_XACT_CLO(arg, "--shadow-layout=slots", bar_shadow_slots, True) { }
+   else if VG_XACT_CLO(arg, "--index-bits=64", bar_index32, False) { }
+   else if VG_XACT_CLO(arg, "--index-bits=32", bar_index32, True) { }
+   else if VG_XACT_CLO(arg, "--tape-partials=f64", bar_partials_f32, False) { }
+   else if VG_XACT_CLO(arg, "--tape-partials=f32", bar_partials_f32, True) { }
+   else if VG_BINT_CLO(arg, "--shadow-compact", shadow_compact_mb, 0, 1<<20) { }
+   else if VG_BINT_CLO(arg, "--shadow-prealloc", shadow_prealloc_mb, 0, 1<<20) { }
+   else if VG_STR_CLO(arg, "--no-instrument", no_instrument_str) { }
+   else if VG_STR_CLO(arg, "--no-instrument-file", no_instrument_file) { }
+   else if VG_XACT_CLO(arg, "--activate=always", activate_on_first_input, False) { }
+   else if VG_XACT_CLO(arg, "--activate=on-first-input", activate_on_first_input, True) { }
    else return False;
    return True;
 }
@@ -181,10 +458,26 @@ static void dg_print_usage(void)
    VG_(printf)(
 "    --warn-unwrapped=no|yes    warn about unwrapped expressions\n"
 "    --diffquotdebug=no|yes     print values and dot values of intermediate results\n"
+"    --instr-stats=no|yes       print statistics about instrumentation and dirty calls at exit\n"
+"    --activate=always|on-first-input  run without AD instrumentation until the first\n"
+"                               input is registered, or until DG_START [always]\n"
+"    --no-instrument=<p1>,..,<pk>  do not differentiate functions whose names match one of\n"
+"                               the patterns (with * and ?), clear shadows of their outputs\n"
+"    --no-instrument-file=<file>  read further patterns from file, one per line, # comments\n"
 "    --record=<directory>       switch to recording mode and store tape and indices in specified dir\n"
 "    --typegrind=no|yes         record index ff...f for results of unwrapped operations\n"
-"    --record-values=no|yes     record values of elementary operations for debugging purposes\n"
+"    --record-values=no|yes     record values and operation codes of elementary operations,\n"
+"                               for debugging purposes and tape-evaluation --hvp\n"
 "    --record-stop=<i1>,..,<ik> stop recording in debugger when the given indices are assigned\n"
+"    --tape-per-thread=no|yes   record a separate tape dg-tape.<tid> for every thread\n"
+"    --record-profile=no|yes    count tape blocks per function, write callgrind.out.derivgrind\n"
+"    --shadow-layout=split|slots  keep both index halves of every 8 bytes next to each other [split]\n"
+"    --shadow-compact=<MB>      release all-zero shadow memory leaves whenever shadow memory\n"
+"                               has grown by MB megabytes, 0 for never [0]\n"
+"    --shadow-prealloc=<MB>     reserve MB megabytes for shadow memory leaves at startup [0]\n"
+"    --index-bits=64|32         size of indices, 32 halves shadow memory for short recordings [64]\n"
+"    --tape-partials=f64|f32    precision of partial derivatives stored on the tape [f64]\n"
+"    --index-namespace=<n>      store n in the upper 16 bits of all indices (used by derivgrind-launch)\n"
    );
 }
 
@@ -204,7 +497,7 @@ Bool dg_handle_gdb_monitor_command(ThreadId tid, HChar* req){
   VG_(strcpy)(s, req);
   HChar* ssaveptr; //!< internal state of strtok_r
 
-  const HChar commands[] = "help get set fget fset lget lset index mark fmark lmark flagsget"; //!< list of possible commands
+  const HChar commands[] = "help get set fget fset lget lset index mark fmark lmark flagsget compact"; //!< list of possible commands
   HChar* wcmd = VG_(strtok_r)(s, " ", &ssaveptr); //!< User command
   int key = VG_(keyword_id)(commands, wcmd, kwd_report_duplicated_matches);
   switch(key){
@@ -229,7 +522,9 @@ Bool dg_handle_gdb_monitor_command(ThreadId tid, HChar* req){
         "  fmark <addr>      \n"
         "  lmark <addr>      \n"
         "monitor commands in bit-trick-finding mode:\n"
-        "  flagsget <addr> <size>  - Prints flags of address range"
+        "  flagsget <addr> <size>  - Prints flags of address range\n"
+        "monitor commands in all modes:\n"
+        "  compact           - Releases all-zero shadow memory leaves\n"
       );
       return True;
     case 1: case 3: case 5: { // get, fget, lget
@@ -298,6 +593,7 @@ Bool dg_handle_gdb_monitor_command(ThreadId tid, HChar* req){
         }
       }
       dg_dot_shadowSet((void*)address,(void*)&shadow,size);
+      dg_input_registered();
       return True;
     }
     case 7: case 8: case 9: case 10: { // index, mark, fmark, lmark
@@ -325,9 +621,10 @@ Bool dg_handle_gdb_monitor_command(ThreadId tid, HChar* req){
           VG_(gdb_printf)("Warning: Variable depends on other inputs, previous index was %llu.\n",index);
         }
         ULong setIndex = tapeAddStatement_noActivityAnalysis(0,0,0.,0.);
-        if(bar_record_values && setIndex!=0) valuesAddStatement(value);
+        if(bar_record_values && setIndex!=0) valuesAddStatement(value,DG_OPCODE_LINEAR);
         dg_bar_shadowSet((void*)address,(void*)&setIndex,(void*)&setIndex+4,4);
         VG_(gdb_printf)("index: %llu\n",setIndex);
+        dg_input_registered();
         return True;
       }
     }
@@ -349,6 +646,14 @@ Bool dg_handle_gdb_monitor_command(ThreadId tid, HChar* req){
       }
       return True;
     }
+    case 12: { // compact
+      ULong released = dg_shadow_compact();
+      ULong live, peak, compacted, bytes;
+      dg_shadow_stats(&live,&peak,&compacted,&bytes);
+      VG_(gdb_printf)("released %llu leaves, %llu leaves (%llu MB) live, peak %llu leaves\n",
+        released, live, (live*bytes)>>20, peak);
+      return True;
+    }
     default:
       VG_(printf)("Error in dg_handle_gdb_monitor_command.\n");
       return False;
@@ -356,6 +661,63 @@ Bool dg_handle_gdb_monitor_command(ThreadId tid, HChar* req){
 
 }
 
+/*! Mark an array of floating-point variables as AD inputs or outputs.
+ *
+ *  This does the same as DG_INPUTF or DG_OUTPUTF for each element, but
+ *  reads or writes the shadow of the whole array at once, and writes all
+ *  indices to the index file at once.
+ *  \param[in] addr - Start address of the array.
+ *  \param[in] count - Number of elements.
+ *  \param[in] size - Size of an element, 4 (float) or 8 (double).
+ *  \param[in] output - False for inputs, True for outputs.
+ */
+static void dg_bar_register_array(Addr addr, ULong count, UWord size, Bool output){
+  if(size!=4 && size!=8){
+    VG_(printf)("DG_INPUT_ARRAY and DG_OUTPUT_ARRAY only support float and double, got elements of size %lu.\n", size);
+    tl_assert(False);
+  }
+  if(count==0) return;
+  // shadow layers of the array; the index is stored in the first four
+  // bytes of each element, the upper four bytes of a double are zero
+  UChar* shadowLo = VG_(malloc)("Array shadow Lo", count*size);
+  UChar* shadowHi = VG_(malloc)("Array shadow Hi", count*size);
+  ULong* indices = VG_(malloc)("Array indices", count*sizeof(ULong));
+  if(output){
+    dg_bar_shadowGet((void*)addr,shadowLo,shadowHi,count*size);
+  } else {
+    VG_(memset)(shadowLo,0,count*size);
+    VG_(memset)(shadowHi,0,count*size);
+  }
+  for(ULong i=0; i<count; i++){
+    void* elem = (void*)(addr+i*size);
+    double value = size==4 ? (double)*(float*)elem : *(double*)elem;
+    if(output){
+      ULong oldindex = (ULong)*(UInt*)&shadowLo[i*size] | (ULong)*(UInt*)&shadowHi[i*size]<<32;
+      indices[i] = tapeAddStatement_noActivityAnalysis(oldindex,0,1.,0.);
+    } else {
+      indices[i] = tapeAddStatement_noActivityAnalysis(0,0,0.,0.);
+      *(UInt*)&shadowLo[i*size] = (UInt)indices[i];
+      *(UInt*)&shadowHi[i*size] = (UInt)(indices[i]>>32);
+    }
+    if(bar_record_values && indices[i]!=0) valuesAddStatement(value,DG_OPCODE_LINEAR);
+  }
+  if(!output){
+    dg_bar_shadowSet((void*)addr,shadowLo,shadowHi,count*size);
+  }
+  dg_bar_tape_write_indices(output,indices,count);
+  VG_(free)(shadowLo);
+  VG_(free)(shadowHi);
+  VG_(free)(indices);
+}
+
+/*! Zero the shadow of memory that is released by the client,
+ *  so its leaves can return their storage to the allocator.
+ */
+static void dg_clear_shadow(Addr addr, SizeT size){
+  if(mode=='d') dg_dot_shadowClear((void*)addr,size);
+  else dg_bar_shadowClear((void*)addr,size);
+}
+
 /*! React to client requests like gdb monitor commands.
  */
 static
@@ -381,6 +743,7 @@ Bool dg_handle_client_request(ThreadId tid, UWord* arg, UWord* ret){
     void* daddr = (void*) arg[2];
     UWord size = arg[3];
     dg_dot_shadowSet(addr,daddr,size);
+    dg_input_registered_if_nonzero(daddr,size);
     *ret = 1; return True;
   } else if(arg[0]==VG_USERREQ__DISABLE) {
     *ret = dg_disable[tid]; // return previous value
@@ -411,8 +774,9 @@ Bool dg_handle_client_request(ThreadId tid, UWord* arg, UWord* ret){
       *newindexaddr = tapeAddStatement(*index1addr,*index2addr,*diff1addr,*diff2addr);
     } else {
       *newindexaddr = tapeAddStatement_noActivityAnalysis(*index1addr,*index2addr,*diff1addr,*diff2addr);
+      dg_input_registered();
     }
-    if(bar_record_values && *newindexaddr!=0) valuesAddStatement(*valueaddr);
+    if(bar_record_values && *newindexaddr!=0) valuesAddStatement(*valueaddr,(UChar)arg[2]); // opcode from DG_NEW_INDEX_OPCODE
     *ret = 1; return True;
   } else if(arg[0]==VG_USERREQ__INDEX_TO_FILE){
     if(mode!='b') return True;
@@ -425,6 +789,11 @@ Bool dg_handle_client_request(ThreadId tid, UWord* arg, UWord* ret){
       tl_assert(False);
     }
     return True;
+  } else if(arg[0]==VG_USERREQ__INPUT_ARRAY || arg[0]==VG_USERREQ__OUTPUT_ARRAY){
+    if(mode!='b') return True;
+    dg_bar_register_array((Addr)arg[1], arg[2], arg[3], arg[0]==VG_USERREQ__OUTPUT_ARRAY);
+    if(arg[0]==VG_USERREQ__INPUT_ARRAY) dg_input_registered();
+    *ret = 1; return True;
   } else if(arg[0]==VG_USERREQ__GET_FLAGS){
     if(mode!='t') return True;
     void* addr = (void*) arg[1];
@@ -439,9 +808,38 @@ Bool dg_handle_client_request(ThreadId tid, UWord* arg, UWord* ret){
     void* Daddr = (void*) arg[3];
     UWord size = arg[4];
     dg_bar_shadowSet(addr,Aaddr,Daddr,size);
+    dg_input_registered_if_nonzero(Aaddr,size);
+    dg_input_registered_if_nonzero(Daddr,size);
+  } else if(arg[0]==VG_USERREQ__MEMMOVE || arg[0]==VG_USERREQ__MEMSET){
+    void* dst = (void*) arg[1];
+    UWord size = arg[3];
+    *ret = 0;
+    if(size==0){ *ret = 1; return True; }
+    // Let the client do it if we might fault on the addresses.
+    if(!VG_(am_is_valid_for_client)((Addr)dst,size,VKI_PROT_WRITE)) return True;
+    if(arg[0]==VG_USERREQ__MEMMOVE){
+      void* src = (void*) arg[2];
+      if(!VG_(am_is_valid_for_client)((Addr)src,size,VKI_PROT_READ)) return True;
+      VG_(memmove)(dst,src,size);
+      if(mode=='d') dg_dot_shadowCopy(dst,src,size);
+      else dg_bar_shadowCopy(dst,src,size);
+    } else {
+      VG_(memset)(dst,(Int)arg[2],size);
+      if(mode=='d') dg_dot_shadowClear(dst,size);
+      else dg_bar_shadowClear(dst,size);
+    }
+    *ret = 1; return True;
   } else if(arg[0]==VG_USERREQ__GET_MODE){
     *ret = (UWord)mode;
     return True;
+  } else if(arg[0]==VG_USERREQ__CLEAR){
+    dg_clear_shadow((Addr)arg[1],arg[2]);
+    *ret = 1; return True;
+  } else if(arg[0]==VG_USERREQ__START || arg[0]==VG_USERREQ__STOP){
+    activate_on_first_input = False;
+    *ret = dg_active; // return previous state
+    dg_set_active(arg[0]==VG_USERREQ__START);
+    return True;
   } else {
     VG_(printf)("Unhandled user request.\n");
     return True;
@@ -512,6 +910,26 @@ static void dg_original_statement(DiffEnv* diffenv, IRStmt* st_orig){
  *
  */
 
+/*! With --record-profile=yes, attribute subsequently recorded tape blocks to a
+ *  new section starting at addr, if addr belongs to another function than the
+ *  previous guest instruction of the superblock.
+ *  \param[in,out] fn - Function of the current section, NULL at the start of
+ *    the superblock.
+ */
+static void dg_bar_profile_section(IRSB* sb_out, Addr addr, HChar** fn){
+  const HChar* fnname;
+  if(!VG_(get_fnname)(VG_(current_DiEpoch)(), addr, &fnname)) fnname = "???";
+  if(*fn && VG_(strcmp)(*fn,fnname)==0) return;
+  if(*fn) VG_(free)(*fn);
+  *fn = VG_(strdup)("Profiled function", fnname);
+  DgBarProfileCounter* counter = dg_bar_profile_new_counter(addr);
+  #ifdef BUILD_32BIT
+  addStmtToIRSB(sb_out, IRStmt_Store(Iend_LE, IRExpr_Const(IRConst_U32((Addr)&dg_bar_profile_current)), IRExpr_Const(IRConst_U32((Addr)counter))));
+  #else
+  addStmtToIRSB(sb_out, IRStmt_Store(Iend_LE, IRExpr_Const(IRConst_U64((Addr)&dg_bar_profile_current)), IRExpr_Const(IRConst_U64((Addr)counter))));
+  #endif
+}
+
 /*! Instrument an IRSB.
  */
 static
@@ -522,6 +940,9 @@ IRSB* dg_instrument ( VgCallbackClosure* closure,
                       const VexArchInfo* archinfo_host,
                       IRType gWordTy, IRType hWordTy )
 {
+  // leave the superblock as it is until activation
+  if(!dg_active) return sb_in;
+
   int i;
   DiffEnv diffenv;
   IRSB* sb_out = deepCopyIRSBExceptStmts(sb_in);
@@ -544,12 +965,26 @@ IRSB* dg_instrument ( VgCallbackClosure* closure,
 
   diffenv.sb_out = sb_out;
 
+  // definitions of original temporaries, for dg_constant_value
+  diffenv.tmp_definitions = VG_(malloc)("Temporary definitions", nTmp*sizeof(IRExpr*));
+  for(IRTemp t=0; t<nTmp; t++) diffenv.tmp_definitions[t] = NULL;
+  for(i=0; i<sb_in->stmts_used; i++){
+    IRStmt* st = sb_in->stmts[i];
+    if(st->tag==Ist_WrTmp) diffenv.tmp_definitions[st->Ist.WrTmp.tmp] = st->Ist.WrTmp.data;
+  }
+
   // copy until IMark
   i = 0;
   while (i < sb_in->stmts_used && sb_in->stmts[i]->tag != Ist_IMark) {
      addStmtToIRSB(sb_out, sb_in->stmts[i]);
      i++;
   }
+  // clear shadows instead of differentiating in excluded functions;
+  // decided per guest instruction because VEX may chase calls and
+  // returns, so one superblock can span excluded and other functions
+  Bool passive = False;
+  // function of the current section for --record-profile=yes
+  HChar* profile_fn = NULL;
   for (/* use current i*/; i < sb_in->stmts_used; i++) {
     stmt_counter++;
     IRStmt* st_orig = sb_in->stmts[i];
@@ -557,13 +992,29 @@ IRSB* dg_instrument ( VgCallbackClosure* closure,
 
     diffenv.cas_succeeded = IRTemp_INVALID;
 
-    if(mode=='d') dg_dot_handle_statement(&diffenv,st_orig);
-    else if(mode=='b') dg_bar_handle_statement(&diffenv,st_orig);
-    else if(mode=='t') dg_trick_handle_statement(&diffenv,st_orig);
+    if(st_orig->tag==Ist_IMark){
+      passive = dg_is_no_instrument(st_orig->Ist.IMark.addr);
+      if(mode=='b' && bar_record_profile){
+        dg_bar_profile_section(sb_out, st_orig->Ist.IMark.addr, &profile_fn);
+      }
+    }
+    if(passive){
+      if(mode=='d') dg_dot_handle_statement_passive(&diffenv,st_orig);
+      else if(mode=='b') dg_bar_handle_statement_passive(&diffenv,st_orig);
+      else if(mode=='t') dg_trick_handle_statement_passive(&diffenv,st_orig);
+    } else {
+      if(mode=='d') dg_dot_handle_statement(&diffenv,st_orig);
+      else if(mode=='b') dg_bar_handle_statement(&diffenv,st_orig);
+      else if(mode=='t') dg_trick_handle_statement(&diffenv,st_orig);
+    }
     dg_original_statement(&diffenv,st_orig);
 
   }
   //VG_(printf)("from stmt %d sb :",stmt_counter); ppIRSB(sb_out); VG_(printf)("\n");
+  if(profile_fn) VG_(free)(profile_fn);
+  VG_(free)(diffenv.tmp_definitions);
+
+  if(instr_stats) sb_out = dg_instrstats_superblock(sb_in, sb_out);
 
   return sb_out;
 }
@@ -575,9 +1026,26 @@ static void dg_fini(Int exitcode)
   } else if(mode=='b') {
     dg_bar_finalize();
     dg_bar_tape_finalize();
+    if(dg_bar_tape_full){
+      VG_(message)(Vg_UserMsg, "The tape is incomplete. Please record again with --index-bits=64.\n");
+    }
   } else if(mode=='t'){
     dg_trick_finalize();
   }
+  if(instr_stats){
+    dg_instrstats_print(mode);
+    if(mode=='b') dg_bar_tape_print_stats();
+    ULong live, peak, compacted, bytes;
+    dg_shadow_stats(&live,&peak,&compacted,&bytes);
+    VG_(message)(Vg_UserMsg, "  shadow leaves live:       %llu (%llu MB)\n", live, (live*bytes)>>20);
+    VG_(message)(Vg_UserMsg, "  shadow leaves peak:       %llu (%llu MB)\n", peak, (peak*bytes)>>20);
+    VG_(message)(Vg_UserMsg, "  shadow leaves compacted:  %llu\n", compacted);
+    ULong read_hits, read_misses, write_hits, write_misses;
+    if(mode=='d') dg_dot_shadowCacheStats(&read_hits,&read_misses,&write_hits,&write_misses);
+    else dg_bar_shadowCacheStats(&read_hits,&read_misses,&write_hits,&write_misses);
+    VG_(message)(Vg_UserMsg, "  leaf cache read hits:     %llu of %llu\n", read_hits, read_hits+read_misses);
+    VG_(message)(Vg_UserMsg, "  leaf cache write hits:    %llu of %llu\n", write_hits, write_hits+write_misses);
+  }
 }
 
 static void dg_pre_clo_init(void)
@@ -600,6 +1068,9 @@ static void dg_pre_clo_init(void)
 
    VG_(needs_client_requests)     (dg_handle_client_request);
 
+   VG_(track_die_mem_munmap)      (dg_clear_shadow);
+   VG_(track_die_mem_brk)         (dg_clear_shadow);
+
    VG_(needs_command_line_options)(dg_process_cmd_line_option,
                                    dg_print_usage,
                                    dg_print_debug_usage);
@@ -0,0 +1,150 @@
+/*--------------------------------------------------------------------*/
+/*--- Replacements for memcpy and friends.     dg_replace_strmem.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_tool_basics.h"
+#include "pub_tool_redir.h"
+#include "pub_tool_clreq.h"
+#include "derivgrind.h"
+
+/*! \page strmem_replacement Replacement of memcpy, memmove and memset.
+ *
+ *  GLIBC's memcpy and friends use wide SIMD loads and stores. Each of them
+ *  is instrumented with a dirty call accessing the shadow memory through
+ *  a small buffer, which makes copy-heavy code rather slow.
+ *
+ *  We therefore replace these functions, like the str/mem replacements of
+ *  Memcheck in shared/vg_replace_strmem.c. Our versions forward the whole
+ *  operation to Derivgrind via the DG_MEMMOVE and DG_MEMSET client requests.
+ *  Derivgrind copies the data with its own memmove, and copies or zeroes
+ *  the shadow memory leaf by leaf.
+ *
+ *  If the client request fails, e.g. because an address range is not
+ *  accessible, the replacements fall back to a plain byte-wise loop on the
+ *  simulated CPU, so that the client gets its segmentation fault.
+ *
+ *  The behavioural equivalence class tags are those of vg_replace_strmem.c.
+ *  Like Memcheck, we give memcpy the semantics of memmove.
+ *
+ *  Furthermore, we wrap free to zero the shadow of released heap blocks by
+ *  the DG_CLEAR client request. Otherwise, their dot values or indices
+ *  would stay in shadow memory until the block is reused.
+ */
+
+/*! Copy len bytes from src to dst, like memmove.
+ */
+static __inline__ void dg_memmove(void* dst, const void* src, SizeT len){
+  if(DG_MEMMOVE(dst,src,len)) return;
+  if(dst<src){
+    HChar* d = (HChar*)dst;
+    const HChar* s = (const HChar*)src;
+    while(len--) *d++ = *s++;
+  } else if(dst>src){
+    HChar* d = (HChar*)dst + len;
+    const HChar* s = (const HChar*)src + len;
+    while(len--) *--d = *--s;
+  }
+}
+
+#define MEMMOVE(soname, fnname) \
+  void* VG_REPLACE_FUNCTION_EZZ(20181,soname,fnname) \
+           ( void *dst, const void *src, SizeT len ); \
+  void* VG_REPLACE_FUNCTION_EZZ(20181,soname,fnname) \
+           ( void *dst, const void *src, SizeT len ) \
+  { \
+    dg_memmove(dst,src,len); \
+    return dst; \
+  }
+
+#define MEMPCPY(soname, fnname) \
+  void* VG_REPLACE_FUNCTION_EZZ(20290,soname,fnname) \
+           ( void *dst, const void *src, SizeT len ); \
+  void* VG_REPLACE_FUNCTION_EZZ(20290,soname,fnname) \
+           ( void *dst, const void *src, SizeT len ) \
+  { \
+    dg_memmove(dst,src,len); \
+    return (void*)((HChar*)dst + len); \
+  }
+
+#define MEMCPY_CHK(soname, fnname) \
+  void* VG_REPLACE_FUNCTION_EZZ(20300,soname,fnname) \
+           ( void *dst, const void *src, SizeT len, SizeT dstlen ); \
+  void* VG_REPLACE_FUNCTION_EZZ(20300,soname,fnname) \
+           ( void *dst, const void *src, SizeT len, SizeT dstlen ) \
+  { \
+    if(dstlen<len){ \
+      VALGRIND_PRINTF_BACKTRACE("*** memcpy_chk: buffer overflow detected ***: program terminated\n"); \
+      _exit(127); \
+    } \
+    dg_memmove(dst,src,len); \
+    return dst; \
+  }
+
+#define MEMSET(soname, fnname) \
+  void* VG_REPLACE_FUNCTION_EZZ(20210,soname,fnname) \
+           ( void *s, Int c, SizeT n ); \
+  void* VG_REPLACE_FUNCTION_EZZ(20210,soname,fnname) \
+           ( void *s, Int c, SizeT n ) \
+  { \
+    if(!DG_MEMSET(s,c,n)){ \
+      HChar* a = (HChar*)s; \
+      while(n--) *a++ = (HChar)c; \
+    } \
+    return s; \
+  }
+
+#define FREE(soname, fnname) \
+  void VG_WRAP_FUNCTION_ZU(soname,fnname) ( void* p ); \
+  void VG_WRAP_FUNCTION_ZU(soname,fnname) ( void* p ) \
+  { \
+    OrigFn fn; \
+    VALGRIND_GET_ORIG_FN(fn); \
+    if(p) DG_CLEAR(p,malloc_usable_size(p)); \
+    CALL_FN_v_W(fn,p); \
+  }
+
+extern void _exit(int);
+extern SizeT malloc_usable_size(void*);
+
+#if defined(VGO_linux)
+ MEMMOVE(VG_Z_LIBC_SONAME, memcpyZAGLIBCZu2Zd2Zd5) /* memcpy@GLIBC_2.2.5 */
+ MEMMOVE(VG_Z_LIBC_SONAME, memcpyZAZAGLIBCZu2Zd14) /* memcpy@@GLIBC_2.14 */
+ MEMMOVE(VG_Z_LIBC_SONAME, memcpy)
+ MEMMOVE(VG_Z_LIBC_SONAME, __GI_memcpy)
+ MEMMOVE(VG_Z_LIBC_SONAME, __memcpy_sse2)
+ MEMMOVE(VG_Z_LIBC_SONAME, __memcpy_avx_unaligned_erms)
+ MEMMOVE(VG_Z_LIBC_SONAME, memmove)
+ MEMMOVE(VG_Z_LIBC_SONAME, __GI_memmove)
+ MEMPCPY(VG_Z_LIBC_SONAME, mempcpy)
+ MEMPCPY(VG_Z_LIBC_SONAME, __GI_mempcpy)
+ MEMCPY_CHK(VG_Z_LIBC_SONAME, __memcpy_chk)
+ MEMSET(VG_Z_LIBC_SONAME, memset)
+ FREE(VG_Z_LIBC_SONAME, free)
+#endif
@@ -32,6 +32,7 @@
 /*! \file dg_shadow.c
  *  Shadow memory stuff for Derivgrind.
  */
+#include "pub_tool_aspacemgr.h"
 #include "dot/dg_dot_shadow.h"
 #include "bar/dg_bar_shadow.h"
 
@@ -155,4 +156,74 @@ void dg_add_print_stmt(ULong tag, IRSB* sb_out, IRExpr* expr){
 #include "pub_tool_libcfile.h"
 #include "pub_tool_vki.h"
 
+/*! \page shadow_arena Arena for shadow memory leaves
+ *
+ *  The storage of shadow memory leaves (see dg_shadow_leaf.hpp) is not
+ *  taken from the Valgrind heap, but handed out from large regions mapped
+ *  by Derivgrind. The regions are aligned to 2 MiB, so the kernel can back
+ *  them by transparent huge pages, which reduces the number of page faults
+ *  and TLB misses of shadow accesses spread over many leaves. Storage of
+ *  released leaves is kept in free lists and reused before the arena grows.
+ *
+ *  The free lists are bounded by DG_SHADOW_FREE_LIMIT bytes per leaf size.
+ *  Beyond that, released storage is unmapped, so the resident memory
+ *  shrinks again after the client has freed buffers or compaction has
+ *  released zero leaves. The bound trades a few megabytes of memory kept
+ *  for reuse against the cost of unmapping and faulting in fresh pages
+ *  when a client repeatedly allocates and frees active buffers. Unmapped
+ *  storage leaves a hole in its arena region that the arena does not
+ *  fill again, but the address space manager may use it for other mappings.
+ *
+ *  With --shadow-prealloc=<MB>, a region of that size is reserved at
+ *  startup, so a client with a known shadow memory footprint does not map
+ *  further regions while it runs.
+ */
+
+//! Alignment of arena regions.
+#define DG_SHADOW_ARENA_ALIGN (2ul<<20)
+//! Size of arena regions mapped on demand.
+#define DG_SHADOW_ARENA_REGION (64ul<<20)
 
+//! Next free byte and end of the current arena region.
+static Addr dg_shadow_arena_next = 0, dg_shadow_arena_end = 0;
+
+/*! Map a new arena region of at least size bytes.
+ *
+ *  The remainder of the previous region is abandoned; it is smaller than
+ *  a leaf, unless a leaf is larger than DG_SHADOW_ARENA_REGION.
+ */
+static void dg_shadow_arena_map(ULong size){
+  size = VG_ROUNDUP(size, DG_SHADOW_ARENA_ALIGN);
+  // map one more alignment unit, so an aligned region of size bytes fits in
+  void* region = VG_(am_shadow_alloc)(size + DG_SHADOW_ARENA_ALIGN);
+  if(!region){
+    VG_(out_of_memory_NORETURN)("derivgrind:shadow-arena", size);
+  }
+  dg_shadow_arena_next = VG_ROUNDUP((Addr)region, DG_SHADOW_ARENA_ALIGN);
+  dg_shadow_arena_end = dg_shadow_arena_next + size;
+}
+
+void* dg_shadow_arena_alloc(ULong size){
+  if(dg_shadow_arena_next + size > dg_shadow_arena_end){
+    dg_shadow_arena_map(size > DG_SHADOW_ARENA_REGION ? size : DG_SHADOW_ARENA_REGION);
+  }
+  void* storage = (void*)dg_shadow_arena_next;
+  dg_shadow_arena_next += size;
+  return storage;
+}
+
+void dg_shadow_arena_free(void* storage, ULong size){
+  // leaves are multiples of the page size and never straddle regions
+  tl_assert(VG_IS_PAGE_ALIGNED((Addr)storage) && VG_IS_PAGE_ALIGNED(size));
+  SysRes res = VG_(am_munmap_valgrind)((Addr)storage, size);
+  if(sr_isError(res)){
+    VG_(printf)("Failed to unmap shadow leaf storage at %p.\n", storage);
+    tl_assert(False);
+  }
+}
+
+void dg_shadow_arena_prealloc(ULong size){
+  if(size>0){
+    dg_shadow_arena_map(size);
+  }
+}
@@ -59,4 +59,29 @@ void dg_add_diffquotdebug(IRSB* sb_out, IRExpr* value, IRExpr* dotvalue);
 
 void dg_add_diffquotdebug_fini(void);
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Bytes of released leaf storage kept for reuse, per leaf size.
+#define DG_SHADOW_FREE_LIMIT (16ul<<20)
+
+/*! Hand out size bytes of zero-initialized storage for a shadow memory
+ *  leaf from the arena.
+ */
+void* dg_shadow_arena_alloc(ULong size);
+
+/*! Unmap the storage of a released leaf that does not fit into the
+ *  free list anymore.
+ */
+void dg_shadow_arena_free(void* storage, ULong size);
+
+/*! Reserve an arena region of size bytes upfront (--shadow-prealloc).
+ */
+void dg_shadow_arena_prealloc(ULong size);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // DG_SHADOW_H
@@ -0,0 +1,236 @@
+/*--------------------------------------------------------------------*/
+/*--- Storage of shadow memory leaves.           dg_shadow_leaf.hpp ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef DG_SHADOW_LEAF_HPP
+#define DG_SHADOW_LEAF_HPP
+
+/*! \file dg_shadow_leaf.hpp
+ *  Separately allocated storage of shadow memory leaves.
+ *
+ *  The ShadowMap of flexible-shadow allocates a leaf on the first write
+ *  access, and keeps it until the end. Therefore, the leaves of Derivgrind
+ *  only hold a pointer to their storage, which is taken from the shadow
+ *  arena (see dg_shadow.c) on the first write access and can be put on a
+ *  bounded free list or unmapped once the shadowed memory is released.
+ *  Unallocated storage reads as zeros.
+ *
+ *  All allocated storage is kept in a list, so leaves that have been
+ *  overwritten by zeros can be found and released by compaction.
+ *
+ *  Consecutive shadow accesses mostly hit the same few leaves. Therefore,
+ *  shadowLeafRead and shadowLeafWrite look up the storage in a small cache
+ *  before walking through the layers of the ShadowMap.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_libcbase.h"
+#include "dg_shadow.h"
+
+/*! Direct-mapped cache from leaf numbers (address divided by the number
+ *  of bytes shadowed by a leaf) to leaf storage.
+ */
+struct ShadowLeafCache {
+  static const ULong nEntries = 8;
+  Addr keys[nEntries];
+  UChar* data[nEntries]; //!< nullptr for invalid entries
+  ULong hits, misses;
+
+  void clear(){
+    for(ULong i=0; i<nEntries; i++) data[i] = nullptr;
+  }
+  //! Cached storage for the leaf number key, or nullptr.
+  UChar* find(Addr key){
+    ULong entry = key%nEntries;
+    if(data[entry] && keys[entry]==key){
+      hits++;
+      return data[entry];
+    }
+    misses++;
+    return nullptr;
+  }
+  void insert(Addr key, UChar* storage){
+    ULong entry = key%nEntries;
+    keys[entry] = key;
+    data[entry] = storage;
+  }
+};
+
+/*! Storage of size bytes of a shadow memory leaf.
+ */
+template<ULong size>
+struct ShadowLeafStorage {
+  UChar* data;
+  //! Position in allocatedList.
+  ULong slot;
+  //! Shared storage of all unallocated leaves, always zero.
+  static UChar zeros[size];
+  //! All leaves with allocated storage.
+  static ShadowLeafStorage** allocatedList;
+  static ULong nAllocated, capacity;
+  //! Maximal number of leaves with allocated storage at the same time.
+  static ULong peakAllocated;
+  //! Number of leaves released by compaction.
+  static ULong nCompacted;
+  //! Released storage, linked by its first word.
+  static UChar* freeList;
+  //! Number of entries of freeList, at most DG_SHADOW_FREE_LIMIT/size.
+  static ULong nFree;
+  /*! Caches for shadowLeafRead and shadowLeafWrite. As they might hold
+   *  the shared zeros or storage that is going to be released, they are
+   *  cleared whenever storage is allocated or released.
+   */
+  static ShadowLeafCache readCache, writeCache;
+
+  constexpr ShadowLeafStorage() : data(zeros), slot(0) {}
+
+  //! Whether storage has been allocated for the leaf.
+  bool allocated() const {
+    return data!=nullptr && data!=zeros; // a zero-filled leaf has data==nullptr
+  }
+  //! Storage for read accesses.
+  UChar* read() const {
+    return allocated() ? data : zeros;
+  }
+  //! Storage for write accesses, allocated and zeroed if necessary.
+  UChar* write(){
+    if(!allocated()){
+      if(freeList){
+        data = freeList;
+        freeList = *(UChar**)data;
+        nFree--;
+        VG_(memset)(data,0,size);
+      } else {
+        data = (UChar*)dg_shadow_arena_alloc(size); // freshly mapped, zero
+      }
+      if(nAllocated==capacity){
+        capacity = capacity ? 2*capacity : 1024;
+        allocatedList = (ShadowLeafStorage**)VG_(realloc)("Shadow leaf list",allocatedList,capacity*sizeof(ShadowLeafStorage*));
+      }
+      slot = nAllocated;
+      allocatedList[nAllocated++] = this;
+      if(nAllocated>peakAllocated) peakAllocated = nAllocated;
+      readCache.clear();
+      writeCache.clear();
+    }
+    return data;
+  }
+  /*! Put the storage on the free list, or unmap it if the free list is
+   *  full, so the leaf reads as zeros again.
+   */
+  void release(){
+    if(allocated()){
+      if((nFree+1)*size <= DG_SHADOW_FREE_LIMIT){
+        *(UChar**)data = freeList;
+        freeList = data;
+        nFree++;
+      } else {
+        dg_shadow_arena_free(data,size);
+      }
+      data = zeros;
+      // fill the gap with the last entry of the list
+      allocatedList[slot] = allocatedList[--nAllocated];
+      allocatedList[slot]->slot = slot;
+      readCache.clear();
+      writeCache.clear();
+    }
+  }
+  /*! Whether the storage contains only zeros.
+   *
+   *  The OR-reduction over blocks of eight words has no branches and can be
+   *  vectorized by the compiler; we only leave the loop between blocks.
+   */
+  bool isZero() const {
+    const ULong* words = (const ULong*)read();
+    for(ULong i=0; i<size/8; i+=8){
+      ULong acc = 0;
+      for(ULong j=0; j<8; j++) acc |= words[i+j];
+      if(acc) return false;
+    }
+    return true;
+  }
+  /*! Release the storage of all leaves containing only zeros.
+   *  \returns Number of released leaves.
+   */
+  static ULong compact(){
+    ULong released = 0;
+    for(ULong i=nAllocated; i>0; i--){ // release() moves the last entry to position i-1
+      if(allocatedList[i-1]->isZero()){
+        allocatedList[i-1]->release();
+        released++;
+      }
+    }
+    nCompacted += released;
+    return released;
+  }
+};
+template<ULong size> UChar ShadowLeafStorage<size>::zeros[size];
+template<ULong size> ShadowLeafStorage<size>** ShadowLeafStorage<size>::allocatedList = nullptr;
+template<ULong size> ULong ShadowLeafStorage<size>::nAllocated = 0;
+template<ULong size> ULong ShadowLeafStorage<size>::capacity = 0;
+template<ULong size> ULong ShadowLeafStorage<size>::peakAllocated = 0;
+template<ULong size> ULong ShadowLeafStorage<size>::nCompacted = 0;
+template<ULong size> UChar* ShadowLeafStorage<size>::freeList = nullptr;
+template<ULong size> ULong ShadowLeafStorage<size>::nFree = 0;
+template<ULong size> ShadowLeafCache ShadowLeafStorage<size>::readCache;
+template<ULong size> ShadowLeafCache ShadowLeafStorage<size>::writeCache;
+
+/*! Storage for read accesses to the shadow of addr.
+ *  \tparam shadowed - Number of bytes shadowed by a leaf.
+ */
+template<ULong shadowed, typename Map>
+inline UChar* shadowLeafRead(Map* map, Addr addr){
+  using Storage = decltype(map->leaf_for_read(addr)->storage);
+  Addr key = addr/shadowed;
+  UChar* data = Storage::readCache.find(key);
+  if(!data){
+    data = map->leaf_for_read(addr)->storage.read();
+    Storage::readCache.insert(key,data);
+  }
+  return data;
+}
+
+/*! Storage for write accesses to the shadow of addr.
+ *  \tparam shadowed - Number of bytes shadowed by a leaf.
+ */
+template<ULong shadowed, typename Map>
+inline UChar* shadowLeafWrite(Map* map, Addr addr){
+  using Storage = decltype(map->leaf_for_write(addr)->storage);
+  Addr key = addr/shadowed;
+  UChar* data = Storage::writeCache.find(key);
+  if(!data){
+    data = map->leaf_for_write(addr)->storage.write();
+    Storage::writeCache.insert(key,data);
+  }
+  return data;
+}
+
+#endif // DG_SHADOW_LEAF_HPP
@@ -32,6 +32,8 @@
 #include "dg_utils.h"
 
 #include "pub_tool_libcassert.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_aspacemgr.h"
 
 
 IRExpr* mkIRConst_zero(IRType type){
@@ -268,3 +270,117 @@ void addressesOfCAS(IRCAS const* det, IRSB* sb_out, IRExpr** addr_Lo, IRExpr** a
     }
   }
 }
+
+//! Write the bytes of a constant into value, if it has at most 8 bytes.
+static Bool dg_value_of_const(IRConst* con, UChar* value){
+  switch(con->tag){
+    case Ico_U8: *(UChar*)value = con->Ico.U8; return True;
+    case Ico_U16: *(UShort*)value = con->Ico.U16; return True;
+    case Ico_U32: *(UInt*)value = con->Ico.U32; return True;
+    case Ico_U64: *(ULong*)value = con->Ico.U64; return True;
+    case Ico_F32: *(float*)value = con->Ico.F32; return True;
+    case Ico_F32i: *(UInt*)value = con->Ico.F32i; return True;
+    case Ico_F64: *(double*)value = con->Ico.F64; return True;
+    case Ico_F64i: *(ULong*)value = con->Ico.F64i; return True;
+    default: return False; // V128, V256 only represent byte masks
+  }
+}
+
+Bool dg_constant_value(DiffEnv* diffenv, IRExpr* expr, UChar* value, Bool* loaded){
+  if(expr->tag==Iex_RdTmp){
+    if(expr->Iex.RdTmp.tmp>=diffenv->tmp_offset) return False; // shadow temporary
+    expr = diffenv->tmp_definitions[expr->Iex.RdTmp.tmp];
+    if(!expr) return False;
+  }
+  if(expr->tag==Iex_Const){
+    return dg_value_of_const(expr->Iex.Const.con,value);
+  }
+  if(expr->tag==Iex_Load){
+    UChar addr_bytes[8] = {0};
+    if(!dg_constant_value(diffenv,expr->Iex.Load.addr,addr_bytes,loaded)) return False;
+    #ifdef BUILD_32BIT
+    Addr addr = *(UInt*)addr_bytes;
+    #else
+    Addr addr = *(ULong*)addr_bytes;
+    #endif
+    SizeT size = sizeofIRType(expr->Iex.Load.ty);
+    // the client might still mprotect the mapping and modify it later,
+    // so the caller has to check the value at runtime
+    NSegment const* seg = VG_(am_find_nsegment)(addr);
+    if(!seg || seg->kind!=SkFileC || !seg->hasR || seg->hasW || addr+size-1>seg->end) return False;
+    VG_(memcpy)(value,(void*)addr,size);
+    *loaded = True;
+    return True;
+  }
+  return False;
+}
+
+//! Recognize a unit of 4 or 8 bytes of a mask.
+static Dg_MaskOp dg_bitwise_mask_unit(HChar op, ULong unit, int unitsize){
+  ULong ones = unitsize==8 ? 0xfffffffffffffffful : 0xfffffffful;
+  ULong signbit = unitsize==8 ? 0x8000000000000000ul : 0x80000000ul;
+  switch(op){
+    case 'a':
+      if(unit==ones) return DG_MASK_COPY;
+      if(unit==(ones^signbit)) return DG_MASK_ABS;
+      break;
+    case 'o':
+      if(unit==0) return DG_MASK_COPY;
+      if(unit==signbit) return DG_MASK_NEGABS;
+      break;
+    case 'x':
+      if(unit==signbit) return DG_MASK_NEG;
+      break;
+  }
+  return DG_MASK_UNKNOWN;
+}
+
+//! Check at runtime whether mask still has the given value, returns an Ity_I1 temporary.
+static IRExpr* dg_mask_unchanged(DiffEnv* diffenv, IRExpr* mask, Int size, ULong* value){
+  IRExpr* unchanged = NULL;
+  if(size==4){
+    unchanged = IRExpr_Binop(Iop_CmpEQ32,mask,IRExpr_Const(IRConst_U32(((UInt*)value)[0])));
+  } else if(size==8){
+    unchanged = IRExpr_Binop(Iop_CmpEQ64,mask,IRExpr_Const(IRConst_U64(value[0])));
+  } else { // compare V128 and V256 masks in units of 8 bytes
+    const IROp parts128[2] = {Iop_V128to64, Iop_V128HIto64};
+    const IROp parts256[4] = {Iop_V256to64_0, Iop_V256to64_1, Iop_V256to64_2, Iop_V256to64_3};
+    for(Int unit=0; unit<size/8; unit++){
+      IRExpr* part = IRExpr_Unop(size==16 ? parts128[unit] : parts256[unit], mask);
+      IRExpr* equal = IRExpr_Binop(Iop_CmpEQ64,part,IRExpr_Const(IRConst_U64(value[unit])));
+      unchanged = unchanged ? IRExpr_Binop(Iop_And1,unchanged,equal) : equal;
+    }
+  }
+  IRTemp t = newIRTemp(diffenv->sb_out->tyenv,Ity_I1);
+  addStmtToIRSB(diffenv->sb_out, IRStmt_WrTmp(t,unchanged));
+  return IRExpr_RdTmp(t);
+}
+
+Bool dg_bitwise_mask(DiffEnv* diffenv, HChar op, IRExpr* mask, int fpsize, int* unitsize, Dg_MaskOp* maskops, IRExpr** unchanged){
+  ULong value[4];
+  Bool loaded = False;
+  if(!dg_constant_value(diffenv,mask,(UChar*)value,&loaded)) return False;
+  Int size = sizeofIRType(typeOfIRExpr(diffenv->sb_out->tyenv,mask));
+  *unchanged = NULL;
+  for(*unitsize = (fpsize==8 && size>=8) ? 8 : 4; *unitsize>=4; *unitsize /= 2){
+    Bool recognized = True;
+    for(Int unit=0; unit<size / *unitsize; unit++){
+      ULong bits = *unitsize==8 ? value[unit] : ((UInt*)value)[unit];
+      maskops[unit] = dg_bitwise_mask_unit(op,bits,*unitsize);
+      if(maskops[unit]==DG_MASK_UNKNOWN) recognized = False;
+    }
+    if(recognized){
+      if(loaded) *unchanged = dg_mask_unchanged(diffenv,mask,size,value);
+      return True;
+    }
+  }
+  return False;
+}
+
+IRExpr* dg_compare_to_zero(IRExpr* unit, int unitsize, IRCmpFResult cmp){
+  IRExpr* unit_f = unitsize==8 ? IRExpr_Unop(Iop_ReinterpI64asF64,unit)
+                   : IRExpr_Unop(Iop_F32toF64,IRExpr_Unop(Iop_ReinterpI32asF32,unit));
+  return IRExpr_Binop(Iop_CmpEQ32,
+    IRExpr_Binop(Iop_CmpF64,unit_f,IRExpr_Const(IRConst_F64(0.))),
+    IRExpr_Const(IRConst_U32(cmp)) );
+}
@@ -85,6 +85,10 @@ typedef struct {
    *  subsequent instrumentation steps.
    */
   IRTemp cas_succeeded;
+  /*! Expression assigned to each original temporary by a WrTmp
+   *  statement of the input IRSB, or NULL.
+   */
+  IRExpr** tmp_definitions;
 } DiffEnv;
 
 // Some valid pieces of VEX IR cannot be translated back to machine code by
@@ -153,5 +157,56 @@ IRExpr* reinterpretType(DiffEnv* diffenv, IRExpr* expr,IRType type);
  */
 void addressesOfCAS(IRCAS const* det, IRSB* sb_out, IRExpr** addr_Lo, IRExpr** addr_Hi);
 
+/*! Determine the value of an expression at translation time.
+ *
+ *  This succeeds for constants, and for loads from constant addresses in
+ *  read-only file mappings of the client, like the .rodata section holding
+ *  the masks of vectorized fabs. Temporaries are resolved through
+ *  diffenv->tmp_definitions.
+ *  \param[in] diffenv - Differentiation environment.
+ *  \param[in] expr - Expression of at most 32 bytes.
+ *  \param[out] value - Receives the bytes of the value.
+ *  \param[out] loaded - Set to True if the value was read from client memory.
+ *    As the client can mprotect the mapping and modify it, such a value must
+ *    be checked at runtime.
+ *  \returns Whether the value could be determined.
+ */
+Bool dg_constant_value(DiffEnv* diffenv, IRExpr* expr, UChar* value, Bool* loaded);
+
+/*! Derivative operation of a bitwise logical operation with a mask,
+ *  see \ref ad_handling_bitwise.
+ */
+typedef enum {
+  DG_MASK_UNKNOWN, //!< not recognized, use the runtime handlers
+  DG_MASK_COPY,    //!< "and" with 0b1..1 or "or" with 0b0..0
+  DG_MASK_NEG,     //!< "xor" with 0b10..0
+  DG_MASK_ABS,     //!< "and" with 0b01..1
+  DG_MASK_NEGABS   //!< "or" with 0b10..0
+} Dg_MaskOp;
+
+/*! Recognize a bitwise logical operation with a mask known at translation time.
+ *
+ *  The mask is split into units of 8 bytes or, if that fails or fpsize==4,
+ *  of 4 bytes. Every unit must be one of the masks in Dg_MaskOp.
+ *  \param[in] diffenv - Differentiation environment.
+ *  \param[in] op - 'a', 'o' or 'x' for "and", "or" or "xor".
+ *  \param[in] mask - Operand that might be a mask.
+ *  \param[in] fpsize - Smallest unit size to be considered, 4 or 8.
+ *  \param[out] unitsize - Size of the units, 4 or 8.
+ *  \param[out] maskops - Operation of every unit, up to 8 entries.
+ *  \param[out] unchanged - NULL if the mask is a constant. If it was read
+ *    from client memory, an Ity_I1 expression that is true if the mask still
+ *    has this value at runtime; otherwise the runtime handlers must be used.
+ *  \returns Whether the mask was recognized.
+ */
+Bool dg_bitwise_mask(DiffEnv* diffenv, HChar op, IRExpr* mask, int fpsize, int* unitsize, Dg_MaskOp* maskops, IRExpr** unchanged);
+
+/*! Compare a unit of 4 or 8 bytes, interpreted as floating-point number, with zero.
+ *  \param[in] unit - I32 or I64 expression.
+ *  \param[in] unitsize - 4 or 8.
+ *  \param[in] cmp - Ircr_LT or Ircr_GT.
+ *  \returns Ity_I1 expression, true if unit compares to zero as specified.
+ */
+IRExpr* dg_compare_to_zero(IRExpr* unit, int unitsize, IRCmpFResult cmp);
 
 #endif // DG_UTILS_H
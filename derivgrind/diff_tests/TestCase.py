@@ -72,7 +72,7 @@ class TestCase:
   """Basic data for a Derivgrind regression test case."""
   def __init__(self, name):
     self.name = name # Name of TestCase
-    self.mode = 'd' # 'd': direct forward mode, 'b': recording plus reverse and forward tape evaluation
+    self.mode = 'd' # 'd': direct forward mode, 'b': recording plus reverse and forward tape evaluation, 't': bit-trick finding
     self.stmtd = None # Code to be run in C/C++ main function for double regression test
     self.stmtf = None # Code to be run in C/C++ main function for float regression test
     self.stmtl = None # Code to be run in C/C++ main function for long double regression test
@@ -92,12 +92,18 @@ class TestCase:
     self.test_vals = {} # Expected values of output variables computed by stmt
     self.test_dots = {} # Expected dot values of output variables computed by stmt
     self.test_bars = {} # Expected bar values of input variables computed by stmt
+    self.test_hvps = {} # Expected Hessian-vector products (dots times Hessian of bars-weighted outputs) for input variables, in recording mode
     self.cflags = "" # Additional flags for the C compiler
     self.cflags_clang = None # Additional flags for the C compiler, if clang is used
     self.fflags = "" # Additional flags for the Fortran compiler
     self.ldflags = "" # Additional flags for the linker, e.g. "-lm"
     self.type = TYPE_DOUBLE # TYPE_DOUBLE, TYPE_FLOAT, TYPE_LONG_DOUBLE (for C/C++), TYPE_REAL4, TYPE_REAL8 (for Fortran)
     self.arch = 32 # 32 bit (x86) or 64 bit (amd64)
+    self.tape_per_thread = False # Record a separate tape per thread, and merge them before the evaluation.
+    self.array_io = False # In recording mode, register inputs and outputs by DG_INPUT_ARRAY and DG_OUTPUT_ARRAY (C/C++ only).
+    self.vgflags = [] # Additional command-line options for Derivgrind
+    self.test_output = {} # Maps strings to how often they are expected in Valgrind's output, or None for at least once
+    self.test_files = {} # Maps names of files in the temporary directory to lists of regular expressions that must match their contents
     self.disable = lambda mode, arch, language, typename : False # if True, test will not be run
     self.compiler = "gcc" # gcc, g++, gfortran, python
     self.install_dir = install_dir # Valgrind installation directory
@@ -366,7 +372,13 @@ class ClientRequestTestCase(TestCase):
       if self.mode=='d':
         self.code += "".join([f"    {self.type['ctype']} _derivative_of_{var} = {self.dots[var]}; DG_SET_DOTVALUE(&{var},&_derivative_of_{var},{self.type['size']});\n" for var in self.dots])
       elif self.mode=='b':
-        self.code += "".join([f"    DG_INPUTF({var});\n" for var in self.test_bars])
+        if self.array_io:
+          # the indices are copied back to the variables along with the values
+          self.code += f"    {self.type['ctype']} _inputs[] = {{ {', '.join(self.test_bars)} }};\n"
+          self.code += f"    DG_INPUT_ARRAY(_inputs,{len(self.test_bars)},{self.type['ctype']});\n"
+          self.code += "".join([f"    {var} = _inputs[{i}];\n" for i,var in enumerate(self.test_bars)])
+        else:
+          self.code += "".join([f"    DG_INPUTF({var});\n" for var in self.test_bars])
       self.code += "  }\n"
       self.code += "  " + self.stmt + "\n"
       self.code += "  {\n"
@@ -405,8 +417,12 @@ class ClientRequestTestCase(TestCase):
           self.code += f""" }} """
       elif self.mode=='b':
         # register output variables
-        for var in self.bars:
-          self.code += f"DG_OUTPUTF({var});\n"
+        if self.array_io:
+          self.code += f"{self.type['ctype']} _outputs[] = {{ {', '.join(self.bars)} }};\n"
+          self.code += f"DG_OUTPUT_ARRAY(_outputs,{len(self.bars)},{self.type['ctype']});\n"
+        else:
+          for var in self.bars:
+            self.code += f"DG_OUTPUTF({var});\n"
       self.code += "  }\n"
       self.code += "  return ret;\n}\n"
     elif self.compiler=='gfortran':
@@ -535,11 +551,32 @@ class ClientRequestTestCase(TestCase):
     else:
       commands = [self.temp_dir+"/TestCase_exec"]
     maybereverse = ["--record="+self.temp_dir] if self.mode=='b' else []
-    valgrind = subprocess.run([self.install_dir+"/bin/valgrind", "--tool=derivgrind"]+maybereverse+commands,capture_output=True,env=environ)
+    maybetapeperthread = ["--tape-per-thread=yes"] if self.tape_per_thread else []
+    maybevalues = ["--record-values=yes"] if self.mode=='b' and self.test_hvps else []
+    maybetrick = ["--trick=yes"] if self.mode=='t' else []
+    valgrind = subprocess.run([self.install_dir+"/bin/valgrind", "--tool=derivgrind"]+maybereverse+maybetrick+maybetapeperthread+maybevalues+self.vgflags+commands,capture_output=True,env=environ)
     if valgrind.returncode!=0:
       self.errmsg +="VALGRIND STDOUT:\n"+valgrind.stdout.decode('utf-8')+"\n\nVALGRIND STDERR:\n"+valgrind.stderr.decode('utf-8')+"\n\n"
+    # check messages of Derivgrind and files it has written
+    output = valgrind.stdout.decode('utf-8')+valgrind.stderr.decode('utf-8')
+    for expected in self.test_output:
+      count = output.count(expected)
+      if (self.test_output[expected]==None and count==0) or (self.test_output[expected]!=None and count!=self.test_output[expected]):
+        self.errmsg += f"OUTPUT DISAGREES: '{expected}' found {count} times\n\nVALGRIND STDERR:\n"+valgrind.stderr.decode('utf-8')+"\n\n"
+    for filename in self.test_files:
+      try:
+        with open(self.temp_dir+"/"+filename,"r") as f:
+          content = f.read()
+      except OSError:
+        content = None
+        self.errmsg += f"FILE MISSING: {filename}\n"
+      for expected in self.test_files[filename] if content!=None else []:
+        if not re.search(expected, content, re.MULTILINE):
+          self.errmsg += f"FILE CONTENT DISAGREES: '{expected}' not found in {filename}\n"
     # for recording mode, evaluate tape
     if self.mode=='b':
+      if self.tape_per_thread:
+        tape_merge = subprocess.run([self.install_dir+"/bin/tape-evaluation",self.temp_dir,"--merge"],env=environ)
       # reverse evaluation of tape
       with open(self.temp_dir+"/dg-output-bars","w") as outputbars:
         # NumPy testcases are repeated 16 times
@@ -567,6 +604,15 @@ class ClientRequestTestCase(TestCase):
             dot = float(outputdots.readline())
             if dot < self.test_dots[var]-self.type["tol"] or dot > self.test_dots[var]+self.type["tol"]:
               self.errmsg += f"RECORDING-MODE DOT VALUES DISAGREE: {var} stored={self.test_dots[var]} computed={dot}\n"
+      # Hessian-vector product, using the recorded values and opcodes
+      if self.test_hvps:
+        tape_evaluation = subprocess.run([self.install_dir+"/bin/tape-evaluation",self.temp_dir,"--hvp"],env=environ)
+        with open(self.temp_dir+"/dg-input-hvp","r") as inputhvps:
+          for var in self.test_hvps: # same order as in test_bars
+            for i in range(repetitions):
+              hvp = float(inputhvps.readline())
+              if hvp < self.test_hvps[var]-self.type["tol"] or hvp > self.test_hvps[var]+self.type["tol"]:
+                self.errmsg += f"RECORDING-MODE HESSIAN-VECTOR PRODUCTS DISAGREE: {var} stored={self.test_hvps[var]} computed={hvp}\n"
     
 
   def run(self):
@@ -595,6 +641,15 @@ class PerformanceTestCase(TestCase):
     super().__init__(name)
     self.disable_codi = False # CoDiPack must be disabled for x86 tests with more than about 2.5 GB memory consumption for the tape.
     self.tape_in_ram = False # Write tape to RAM instead of file system.
+    self.threads = None # Number of OpenMP threads, for benchmarks compiled with -fopenmp.
+    self.performance = None # Averaged performance figures, set by averagePerformance.
+
+  def benchmarkEnv(self):
+    """Environment for running the benchmark."""
+    environ = os.environ.copy()
+    if self.threads!=None:
+      environ["OMP_NUM_THREADS"] = str(self.threads)
+    return environ
 
   def runCoDi(self,nrep):
     """Build with CoDiPack types and run."""
@@ -619,7 +674,7 @@ class PerformanceTestCase(TestCase):
       self.errmsg += "COMPILATION WITHOUT AD FAILED:\n" + comp.stdout.decode('utf-8') + comp.stderr.decode('utf-8')
     self.results_noad = []
     for irep in range(nrep+2): # measurements for the first two iterations are not taken into account
-      exe = subprocess.run(["/usr/bin/time", "-f", "time_output %e %M", f"{self.temp_dir}/main_noad", f"{self.temp_dir}/dg-performance-result-noad.json"]+self.benchmarkargs.split(), capture_output=True)
+      exe = subprocess.run(["/usr/bin/time", "-f", "time_output %e %M", f"{self.temp_dir}/main_noad", f"{self.temp_dir}/dg-performance-result-noad.json"]+self.benchmarkargs.split(), capture_output=True, env=self.benchmarkEnv())
       if exe.returncode!=0:
         self.errmsg += "EXECUTION WITHOUT AD FAILED:\n" + "STDOUT:\n" + exe.stdout.decode('utf-8') + "\nSTDERR:\n" + exe.stderr.decode('utf-8')
       with open(self.temp_dir+"/dg-performance-result-noad.json") as f:
@@ -636,14 +691,16 @@ class PerformanceTestCase(TestCase):
 
   def runDG(self, nrep):
     """Build with Derivgrind client request types and run repeatedly."""
-    comp = subprocess.run(["g++", self.benchmark, "-o", f"{self.temp_dir}/main_dg", f"-I{self.install_dir}/include", "-DDG_DOT" if self.mode=='d' else "-DDG_BAR"]+self.cflags.split() + (["-m32"] if self.arch==32 else []), capture_output=True)
+    dgflag = {'d':"-DDG_DOT", 'b':"-DDG_BAR", 't':"-DDG_TRICK"}[self.mode]
+    comp = subprocess.run(["g++", self.benchmark, "-o", f"{self.temp_dir}/main_dg", f"-I{self.install_dir}/include", dgflag]+self.cflags.split() + (["-m32"] if self.arch==32 else []), capture_output=True)
     if comp.returncode!=0:
       self.errmsg += "COMPILATION FOR DERIVGRIND FAILED:\n" + comp.stderr.decode('utf-8')
     self.results_dg = []
     for irep in range(nrep+2): # measurements for the first two iterations are not taken into account
       maybereverse = ["--record="+self.temp_dir] if self.mode=='b' else []
+      maybetrick = ["--trick=yes"] if self.mode=='t' else []
       maybetapeinram = ["--tape-in-ram=yes"] if self.tape_in_ram else []
-      exe = subprocess.run(["/usr/bin/time", "-f", "time_output %e %M", self.install_dir+"/bin/valgrind", "--tool=derivgrind"]+maybereverse+maybetapeinram+[f"{self.temp_dir}/main_dg", f"{self.temp_dir}/dg-performance-result-dg.json"]+self.benchmarkargs.split(), capture_output=True)
+      exe = subprocess.run(["/usr/bin/time", "-f", "time_output %e %M", self.install_dir+"/bin/valgrind", "--tool=derivgrind"]+maybereverse+maybetrick+maybetapeinram+self.vgflags+[f"{self.temp_dir}/main_dg", f"{self.temp_dir}/dg-performance-result-dg.json"]+self.benchmarkargs.split(), capture_output=True, env=self.benchmarkEnv())
       if exe.returncode!=0:
         self.errmsg += "EXECUTION WITH DERIVGRIND FAILED:\n" + "STDOUT:\n" + exe.stdout.decode('utf-8') + "\nSTDERR:\n" + exe.stderr.decode('utf-8')
       with open(self.temp_dir+"/dg-performance-result-dg.json") as f:
@@ -666,16 +723,14 @@ class PerformanceTestCase(TestCase):
             os.remove(self.temp_dir+"/dg-perf-tapeeval-time")
           except OSError:
             pass
-          eva = subprocess.run([self.install_dir+"/bin/tape-evaluation", self.temp_dir], capture_output=True)
+          eva_begin = time.perf_counter()
+          eva = subprocess.run([self.install_dir+"/bin/tape-evaluation", self.temp_dir, "--time"], capture_output=True)
+          result["reverse_outer_time_in_s"] = time.perf_counter() - eva_begin
+          result["tape_file_size_in_b"] = os.path.getsize(self.temp_dir+"/dg-tape")
           if eva.returncode!=0:
             self.errmsg += "EVALUATION OF DERIVGRIND TAPE FAILED:\n" + "STDOUT:\n" + eva.stdout.decode('utf-8') + "\nSTDERR:\n" + eva.stderr.decode('utf-8')
           result["input_bar"] = [float(bar) for bar in np.loadtxt(self.temp_dir+"/dg-input-bars")]
-          try:
-            result["reverse_time_in_s"] = np.loadtxt(self.temp_dir+"/dg-perf-tapeeval-time")
-          except OSError:
-            # need to set measure_evaluation_time to true, or
-            # increase bufsize, in tape-evaluation.cpp, and recompile
-            result["reverse_time_in_s"] = 0
+          result["reverse_time_in_s"] = np.loadtxt(self.temp_dir+"/dg-perf-tapeeval-time")
           # run tape-evaluation another time for statistics
           eva = subprocess.run([self.install_dir+"/bin/tape-evaluation", self.temp_dir, "--stats"], capture_output=True)
           if eva.returncode!=0:
@@ -685,6 +740,7 @@ class PerformanceTestCase(TestCase):
           result["tape_size_in_b"] = (nZero+nOne+nTwo)*32
         else:
           result["number_of_jacobians"] = 0
+          result["tape_size_in_b"] = 0
       self.results_dg.append(result)
 
   def verifyGradient(self):
@@ -715,8 +771,6 @@ class PerformanceTestCase(TestCase):
     dg_reverse_time_in_s = 0
     if self.mode=='b':
       dg_reverse_time_in_s = np.mean([res["reverse_time_in_s"] for res in self.results_dg[2:]]) 
-      # The tape evaluator does not measure the run-time by default, in which case dg_reverse_time_in_s is 0.
-      # To enable the time measurement, edit tape-evaluator.cpp.
     if not self.disable_codi and self.mode=='b':
       codi_reverse_time_in_s = np.mean([res["reverse_time_in_s"] for res in self.results_codi[2:]])
       codi_tape_size_in_b = np.mean([res["tape_size_in_b"] for res in self.results_codi[2:]])
@@ -729,6 +783,30 @@ class PerformanceTestCase(TestCase):
       codi_number_of_jacobians = 0
       dg_tape_size_in_b = 0
       dg_number_of_jacobians = 0
+    dg_reverse_outer_time_in_s = 0
+    dg_tape_file_size_in_b = 0
+    if self.mode=='b' and not self.tape_in_ram:
+      dg_reverse_outer_time_in_s = np.mean([res["reverse_outer_time_in_s"] for res in self.results_dg[2:]])
+      dg_tape_file_size_in_b = np.mean([res["tape_file_size_in_b"] for res in self.results_dg[2:]])
+    # Machine-readable summary, written by run_tests.py --perf-json=file.
+    self.performance = {
+      "benchmark": self.benchmark,
+      "benchmarkargs": self.benchmarkargs,
+      "mode": self.mode,
+      "arch": self.arch,
+      "cflags": self.cflags,
+      "threads": self.threads,
+      "slowdown": dg_forward_time_in_s / noad_forward_time_in_s,
+      "outer_slowdown": dg_forward_outer_time_in_s / noad_forward_outer_time_in_s,
+      "noad_forward_time_in_s": noad_forward_time_in_s,
+      "dg_forward_time_in_s": dg_forward_time_in_s,
+      "noad_peak_rss_in_kb": noad_forward_outer_maxrss_in_kb,
+      "dg_peak_rss_in_kb": dg_forward_outer_maxrss_in_kb,
+      "dg_tape_file_size_in_b": dg_tape_file_size_in_b,
+      "dg_tape_evaluation_time_in_s": dg_reverse_outer_time_in_s,
+      "codi_tape_size_in_b": codi_tape_size_in_b,
+      "codi_reverse_time_in_s": codi_reverse_time_in_s,
+    }
     # Choose which output you prefer
     #return f"{noad_forward_time_in_s} {noad_forward_vmhwm_in_kb} {dg_forward_time_in_s} {dg_forward_vmhwm_in_kb}"
     #return f"{int(dg_forward_time_in_s / noad_forward_time_in_s)}x"
@@ -737,13 +815,13 @@ class PerformanceTestCase(TestCase):
   def run(self):
     print("##### Running performance test '"+self.name+"'... #####", flush=True)
     self.errmsg = ""
-    if self.errmsg=="" and not self.disable_codi:
+    if self.errmsg=="" and not self.disable_codi and self.mode!='t':
       self.runCoDi(self.benchmarkreps)
     if self.errmsg=="":
       self.runNoAD(self.benchmarkreps)
     if self.errmsg=="":
       self.runDG(self.benchmarkreps)
-    if self.errmsg=="" and not self.disable_codi and not self.tape_in_ram:
+    if self.errmsg=="" and not self.disable_codi and not self.tape_in_ram and self.mode!='t':
       if not self.verifyGradient():
         self.errmsg="DERIVATIVES DISAGREE\n"
     if self.errmsg=="":
@@ -754,3 +832,104 @@ class PerformanceTestCase(TestCase):
       print(self.errmsg)
       return False
 
+
+class SyntheticTapeTestCase(TestCase):
+  """Methods to evaluate a synthetic tape written by tape-generate, and compare with the known derivatives."""
+  def __init__(self,name):
+    super().__init__(name)
+    self.generateargs = "" # Shape, number of blocks and options for tape-generate
+    self.jacobianargs = None # If not None, also run tape-jacobian with these options and check the row sums
+
+  def run(self):
+    print("##### Running synthetic tape test '"+self.name+"'... #####", flush=True)
+    self.errmsg = ""
+    path = self.temp_dir+"/synthetic"
+    gen = subprocess.run([self.install_dir+"/bin/tape-generate", path]+self.generateargs.split(), capture_output=True)
+    if gen.returncode!=0:
+      self.errmsg += "GENERATION OF SYNTHETIC TAPE FAILED:\n" + "STDOUT:\n" + gen.stdout.decode('utf-8') + "\nSTDERR:\n" + gen.stderr.decode('utf-8')
+    if self.errmsg=="":
+      expected = {}
+      with open(path+"/dg-synthetic-expected") as f:
+        for line in f:
+          key, value = line.split()
+          expected[key] = float(value)
+      for direction in [[], ["--forward"]]:
+        eva = subprocess.run([self.install_dir+"/bin/tape-evaluation", path]+direction, capture_output=True)
+        if eva.returncode!=0:
+          self.errmsg += "EVALUATION OF SYNTHETIC TAPE FAILED:\n" + "STDOUT:\n" + eva.stdout.decode('utf-8') + "\nSTDERR:\n" + eva.stderr.decode('utf-8')
+    if self.errmsg=="":
+      input_bar_sum = np.sum(np.loadtxt(path+"/dg-input-bars", ndmin=1))
+      if abs(input_bar_sum - expected["input-bar-sum"]) > self.type["tol"]*expected["input-bar-sum"]:
+        self.errmsg += f"INPUT BARS SUM UP TO {input_bar_sum} INSTEAD OF {expected['input-bar-sum']}\n"
+      output_dots = np.loadtxt(path+"/dg-output-dots", ndmin=1)
+      if np.max(np.abs(output_dots - expected["output-dot"])) > self.type["tol"]:
+        self.errmsg += f"OUTPUT DOTS {output_dots} INSTEAD OF {expected['output-dot']}\n"
+    if self.errmsg=="" and self.jacobianargs!=None:
+      jac = subprocess.run([self.install_dir+"/bin/tape-jacobian", path]+self.jacobianargs.split(), capture_output=True)
+      if jac.returncode!=0:
+        self.errmsg += "SPARSE JACOBIAN OF SYNTHETIC TAPE FAILED:\n" + "STDOUT:\n" + jac.stdout.decode('utf-8') + "\nSTDERR:\n" + jac.stderr.decode('utf-8')
+      else:
+        # The rows of the Jacobian sum up to the output dots for unit input dots.
+        data = np.fromfile(path+"/dg-jacobian", dtype=np.uint64)
+        rows, cols, nnz = [int(x) for x in data[:3]]
+        if "--coo" in self.jacobianargs:
+          records = data[3:].reshape(nnz,3)
+          rowindex = records[:,0].astype(np.int64)
+          values = records[:,2].copy().view(np.float64)
+        else:
+          rowstart = data[3:3+rows+1].astype(np.int64)
+          rowindex = np.repeat(np.arange(rows), np.diff(rowstart))
+          values = data[3+rows+1+nnz:].copy().view(np.float64)
+        rowsums = np.bincount(rowindex, weights=values, minlength=rows)
+        if np.max(np.abs(rowsums - expected["output-dot"])) > self.type["tol"]:
+          self.errmsg += f"JACOBIAN ROW SUMS {rowsums} INSTEAD OF {expected['output-dot']}\n"
+    if self.errmsg=="":
+      print("OK.\n")
+      return True
+    else:
+      print("FAIL:")
+      print(self.errmsg)
+      return False
+
+
+class MPITestCase(TestCase):
+  """Methods to run an MPI program with several ranks under derivgrind-launch, to test the MPI wrappers."""
+  def __init__(self,name):
+    super().__init__(name)
+    self.ranks = 2 # Number of MPI ranks
+    self.code = "" # C source code of the MPI program, which should check dot values and return non-zero on failure in forward mode
+
+  def run(self):
+    print("##### Running MPI test '"+self.name+"'... #####", flush=True)
+    self.errmsg = ""
+    with open(self.temp_dir+"/TestCase_src.c", "w") as f:
+      f.write(self.code)
+    compile_process = subprocess.run(["mpicc", "-g", "-O0", self.temp_dir+"/TestCase_src.c", "-o", self.temp_dir+"/TestCase_exec", "-I"+self.install_dir+"/include"] + self.cflags.split(), capture_output=True)
+    if compile_process.returncode!=0:
+      self.errmsg += "COMPILATION FAILED:\n" + compile_process.stderr.decode('utf-8')
+    if self.errmsg=="":
+      path = self.temp_dir+"/mpi"
+      maybereverse = ["--record="+path] if self.mode=='b' else []
+      mpirun = subprocess.run(["mpirun", "-np", str(self.ranks), self.install_dir+"/bin/derivgrind-launch"]+maybereverse+self.vgflags+[self.temp_dir+"/TestCase_exec"], capture_output=True)
+      if mpirun.returncode!=0:
+        self.errmsg += "MPIRUN STDOUT:\n"+mpirun.stdout.decode('utf-8')+"\n\nMPIRUN STDERR:\n"+mpirun.stderr.decode('utf-8')+"\n\n"
+    if self.errmsg=="" and self.mode=='b':
+      merge = subprocess.run([self.install_dir+"/bin/tape-evaluation", path, "--merge-ranks"], capture_output=True)
+      if merge.returncode!=0:
+        self.errmsg += "MERGE FAILED:\n" + merge.stderr.decode('utf-8')
+      with open(path+"/dg-output-bars","w") as outputbars:
+        for var in self.bars:
+          print(str(self.bars[var]), file=outputbars)
+      subprocess.run([self.install_dir+"/bin/tape-evaluation", path])
+      with open(path+"/dg-input-bars","r") as inputbars:
+        for var in self.test_bars:
+          bar = float(inputbars.readline())
+          if bar < self.test_bars[var]-self.type["tol"] or bar > self.test_bars[var]+self.type["tol"]:
+            self.errmsg += f"RECORDING-MODE BAR VALUES DISAGREE: {var} stored={self.test_bars[var]} computed={bar}\n"
+    if self.errmsg=="":
+      print("OK.\n")
+      return True
+    else:
+      print("FAIL:")
+      print(self.errmsg)
+      return False
@@ -0,0 +1,136 @@
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/*
+ * Note that if you combine this file with CoDiPack (-DCODI_DOT or -DCODI_BAR),
+ * the result will also be subject to the license terms of CoDiPack, which are those
+ * of the GNU General Public License version 3 or later. 
+ */
+
+/*! \file cg.cpp
+ * Conjugate gradient method with a sparse matrix, as a benchmark for Derivgrind.
+ *
+ * Usage: cg <result file> <n> <iterations>. The matrix is the five-point
+ * Laplacian on an n x n grid plus a diagonal shift, stored in CSR format.
+ * The shifts and the right-hand side are inputs. A fixed number of CG
+ * iterations is performed, so that the recorded tape does not depend on
+ * a stopping criterion. The output is the sum of the entries of the solution.
+ *
+ * Compile the program with a flag -Dx_y where x=DG,CODI specifies the AD tool
+ * and y=DOT,BAR specifies the mode, or with -DDG_TRICK.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "performanceTestResults.hpp"
+
+//! Sparse matrix in compressed sparse row format.
+struct CsrMatrix {
+  std::vector<size_t> rowStart;
+  std::vector<size_t> column;
+  std::vector<DOUBLE> value;
+};
+
+//! y = A x
+void spmv(CsrMatrix const& A, std::vector<DOUBLE> const& x, std::vector<DOUBLE>& y){
+  size_t rows = x.size();
+  OMP_PARALLEL_FOR
+  for(size_t i=0; i<rows; ++i){
+    DOUBLE sum = 0.0;
+    for(size_t k=A.rowStart[i]; k<A.rowStart[i+1]; ++k){
+      sum += A.value[k] * x[A.column[k]];
+    }
+    y[i] = sum;
+  }
+}
+
+//! Scalar product, sequential for reproducible rounding.
+DOUBLE dot(std::vector<DOUBLE> const& x, std::vector<DOUBLE> const& y){
+  DOUBLE sum = 0.0;
+  for(size_t i=0; i<x.size(); ++i){
+    sum += x[i]*y[i];
+  }
+  return sum;
+}
+
+int main(int nArgs, char** args) {
+  size_t n = nArgs>2 ? std::atoi(args[2]) : 50;
+  size_t iterations = nArgs>3 ? std::atoi(args[3]) : 20;
+  size_t rows = n*n;
+
+  // == Assemble matrix. ==
+  std::vector<DOUBLE> shift(rows), rhs(rows);
+  for(size_t i=0; i<rows; ++i){
+    shift[i] = 0.1 + 0.05*std::sin(0.7*i);
+    rhs[i] = std::cos(0.3*i);
+  }
+  std::vector<InputRange> inputs = {{shift.data(),rows},{rhs.data(),rows}};
+  registerInputs(inputs);
+
+  auto begin = performanceClock();
+  CsrMatrix A;
+  A.rowStart.push_back(0);
+  for(size_t ix=0; ix<n; ++ix){
+    for(size_t iy=0; iy<n; ++iy){
+      size_t i = ix*n+iy;
+      if(ix>0){ A.column.push_back(i-n); A.value.push_back(-1.0); }
+      if(iy>0){ A.column.push_back(i-1); A.value.push_back(-1.0); }
+      A.column.push_back(i); A.value.push_back(4.0 + shift[i]);
+      if(iy<n-1){ A.column.push_back(i+1); A.value.push_back(-1.0); }
+      if(ix<n-1){ A.column.push_back(i+n); A.value.push_back(-1.0); }
+      A.rowStart.push_back(A.column.size());
+    }
+  }
+
+  // == Solve. ==
+  std::vector<DOUBLE> x(rows, 0.0), r(rhs), p(rhs), Ap(rows);
+  DOUBLE rr = dot(r,r);
+  for(size_t it=0; it<iterations; ++it){
+    spmv(A,p,Ap);
+    DOUBLE alpha = rr / dot(p,Ap);
+    OMP_PARALLEL_FOR
+    for(size_t i=0; i<rows; ++i){
+      x[i] += alpha*p[i];
+      r[i] -= alpha*Ap[i];
+    }
+    DOUBLE rrNew = dot(r,r);
+    DOUBLE beta = rrNew / rr;
+    rr = rrNew;
+    OMP_PARALLEL_FOR
+    for(size_t i=0; i<rows; ++i){
+      p[i] = r[i] + beta*p[i];
+    }
+  }
+  DOUBLE w = 0.0;
+  for(size_t i=0; i<rows; ++i){
+    w += x[i];
+  }
+  auto end = performanceClock();
+
+  writePerformanceResults(args[1], begin, end, w, inputs);
+}
@@ -0,0 +1,109 @@
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/*
+ * Note that if you combine this file with CoDiPack (-DCODI_DOT or -DCODI_BAR),
+ * the result will also be subject to the license terms of CoDiPack, which are those
+ * of the GNU General Public License version 3 or later. 
+ */
+
+/*! \file fft.cpp
+ * Radix-2 fast Fourier transform, as a benchmark for Derivgrind.
+ *
+ * Usage: fft <result file> <log2 n> <reps>. A real signal of length n is
+ * the input. It is transformed reps times in-place by the iterative
+ * Cooley-Tukey algorithm. The output is the spectral energy.
+ *
+ * Compile the program with a flag -Dx_y where x=DG,CODI specifies the AD tool
+ * and y=DOT,BAR specifies the mode, or with -DDG_TRICK.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "performanceTestResults.hpp"
+
+//! In-place FFT of the complex signal (re,im), whose length is a power of two.
+void fft(std::vector<DOUBLE>& re, std::vector<DOUBLE>& im){
+  size_t n = re.size();
+  // bit-reversal permutation
+  for(size_t i=1, j=0; i<n; ++i){
+    size_t bit = n>>1;
+    for(; j&bit; bit>>=1) j ^= bit;
+    j ^= bit;
+    if(i<j){
+      std::swap(re[i],re[j]);
+      std::swap(im[i],im[j]);
+    }
+  }
+  // butterflies
+  for(size_t len=2; len<=n; len<<=1){
+    double angle = -2*M_PI/len;
+    OMP_PARALLEL_FOR
+    for(size_t start=0; start<n; start+=len){
+      for(size_t k=0; k<len/2; ++k){
+        double wr = std::cos(angle*k), wi = std::sin(angle*k);
+        size_t a = start+k, b = start+k+len/2;
+        DOUBLE tr = wr*re[b] - wi*im[b];
+        DOUBLE ti = wr*im[b] + wi*re[b];
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] = re[a] + tr;
+        im[a] = im[a] + ti;
+      }
+    }
+  }
+}
+
+int main(int nArgs, char** args) {
+  size_t n = size_t(1) << (nArgs>2 ? std::atoi(args[2]) : 12);
+  size_t reps = nArgs>3 ? std::atoi(args[3]) : 1;
+
+  std::vector<DOUBLE> signal(n);
+  for(size_t i=0; i<n; ++i){
+    signal[i] = std::sin(0.01*i) + 0.5*std::cos(0.37*i);
+  }
+  std::vector<InputRange> inputs = {{signal.data(),n}};
+  registerInputs(inputs);
+
+  auto begin = performanceClock();
+  std::vector<DOUBLE> re(signal), im(n, 0.0);
+  for(size_t rep=0; rep<reps; ++rep){
+    fft(re,im);
+    for(size_t i=0; i<n; ++i){ // keep magnitudes bounded
+      re[i] /= std::sqrt(double(n));
+      im[i] /= std::sqrt(double(n));
+    }
+  }
+  DOUBLE w = 0.0;
+  for(size_t i=0; i<n; ++i){
+    w += re[i]*re[i] + im[i]*im[i];
+  }
+  auto end = performanceClock();
+
+  writePerformanceResults(args[1], begin, end, w, inputs);
+}
@@ -0,0 +1,87 @@
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/*
+ * Note that if you combine this file with CoDiPack (-DCODI_DOT or -DCODI_BAR),
+ * the result will also be subject to the license terms of CoDiPack, which are those
+ * of the GNU General Public License version 3 or later. 
+ */
+
+/*! \file matmul.cpp
+ * Dense matrix-matrix product, as a benchmark for Derivgrind.
+ *
+ * Usage: matmul <result file> <n> <reps>. Both n x n factors are inputs,
+ * the output is the mean squared entry of the product, which is computed
+ * reps times.
+ *
+ * Compile the program with a flag -Dx_y where x=DG,CODI specifies the AD tool
+ * and y=DOT,BAR specifies the mode, or with -DDG_TRICK.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "performanceTestResults.hpp"
+
+int main(int nArgs, char** args) {
+  size_t n = nArgs>2 ? std::atoi(args[2]) : 100;
+  size_t reps = nArgs>3 ? std::atoi(args[3]) : 1;
+
+  std::vector<DOUBLE> a(n*n), b(n*n), c(n*n);
+  for(size_t i=0; i<n; ++i){
+    for(size_t j=0; j<n; ++j){
+      a[i*n+j] = std::sin(0.1*i+0.2*j);
+      b[i*n+j] = std::cos(0.3*i-0.1*j);
+    }
+  }
+  std::vector<InputRange> inputs = {{a.data(),n*n},{b.data(),n*n}};
+  registerInputs(inputs);
+
+  auto begin = performanceClock();
+  for(size_t rep=0; rep<reps; ++rep){
+    OMP_PARALLEL_FOR
+    for(size_t i=0; i<n; ++i){
+      for(size_t j=0; j<n; ++j){
+        c[i*n+j] = 0.0;
+      }
+      // i-k-j loop order, so that the innermost loop can be vectorized
+      for(size_t k=0; k<n; ++k){
+        for(size_t j=0; j<n; ++j){
+          c[i*n+j] += a[i*n+k] * b[k*n+j];
+        }
+      }
+    }
+  }
+  DOUBLE w = 0.0;
+  for(size_t i=0; i<n*n; ++i){
+    w += c[i]*c[i];
+  }
+  w /= double(n*n);
+  auto end = performanceClock();
+
+  writePerformanceResults(args[1], begin, end, w, inputs);
+}
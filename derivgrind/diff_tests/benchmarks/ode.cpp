@@ -0,0 +1,95 @@
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/*
+ * Note that if you combine this file with CoDiPack (-DCODI_DOT or -DCODI_BAR),
+ * the result will also be subject to the license terms of CoDiPack, which are those
+ * of the GNU General Public License version 3 or later. 
+ */
+
+/*! \file ode.cpp
+ * Runge-Kutta integration of nonlinear oscillators, as a benchmark for Derivgrind.
+ *
+ * Usage: ode <result file> <oscillators> <timesteps>. Every oscillator
+ * follows x'' = -k sin(x) - c exp(-x^2) x'. The initial states and the
+ * stiffnesses k are inputs, the output is the sum of the final positions.
+ * The right-hand side calls the math library in every stage.
+ *
+ * Compile the program with a flag -Dx_y where x=DG,CODI specifies the AD tool
+ * and y=DOT,BAR specifies the mode, or with -DDG_TRICK.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "performanceTestResults.hpp"
+
+static const double damping = 0.1;
+
+//! Right-hand side of the first-order system for one oscillator.
+inline void rhs(DOUBLE const& k, DOUBLE const& x, DOUBLE const& v, DOUBLE& dx, DOUBLE& dv){
+  using std::sin; using std::exp;
+  dx = v;
+  dv = -k*sin(x) - damping*exp(-x*x)*v;
+}
+
+int main(int nArgs, char** args) {
+  size_t m = nArgs>2 ? std::atoi(args[2]) : 100;
+  size_t timesteps = nArgs>3 ? std::atoi(args[3]) : 100;
+  double dt = 0.01;
+
+  std::vector<DOUBLE> x0(m), v0(m), k(m);
+  for(size_t i=0; i<m; ++i){
+    x0[i] = 0.5 + 0.4*std::sin(1.3*i);
+    v0[i] = 0.1*std::cos(0.7*i);
+    k[i] = 1.0 + 0.5*std::sin(0.1*i);
+  }
+  std::vector<InputRange> inputs = {{x0.data(),m},{v0.data(),m},{k.data(),m}};
+  registerInputs(inputs);
+
+  auto begin = performanceClock();
+  std::vector<DOUBLE> x(x0), v(v0);
+  OMP_PARALLEL_FOR
+  for(size_t i=0; i<m; ++i){
+    for(size_t step=0; step<timesteps; ++step){
+      DOUBLE k1x, k1v, k2x, k2v, k3x, k3v, k4x, k4v;
+      rhs(k[i], x[i], v[i], k1x, k1v);
+      rhs(k[i], x[i]+0.5*dt*k1x, v[i]+0.5*dt*k1v, k2x, k2v);
+      rhs(k[i], x[i]+0.5*dt*k2x, v[i]+0.5*dt*k2v, k3x, k3v);
+      rhs(k[i], x[i]+dt*k3x, v[i]+dt*k3v, k4x, k4v);
+      x[i] += dt/6*(k1x+2*k2x+2*k3x+k4x);
+      v[i] += dt/6*(k1v+2*k2v+2*k3v+k4v);
+    }
+  }
+  DOUBLE w = 0.0;
+  for(size_t i=0; i<m; ++i){
+    w += x[i];
+  }
+  auto end = performanceClock();
+
+  writePerformanceResults(args[1], begin, end, w, inputs);
+}
@@ -55,6 +55,10 @@ static const double one = 1.;
   #include <valgrind/derivgrind.h>
   #define DOUBLE double
   #define HANDLE_INPUT(var) DG_INPUTF(var)
+#elif defined(DG_TRICK) 
+  #include <valgrind/derivgrind.h>
+  #define DOUBLE double
+  #define HANDLE_INPUT(var) DG_MARK_FLOAT(var)
 #elif defined(CODI_DOT)
   #include "codi.hpp"
   #define DOUBLE codi::RealForward
@@ -68,4 +72,14 @@ static const double one = 1.;
   #define HANDLE_INPUT(var) 
 #endif 
 
+/*! Put in front of a loop that is parallelized in the OpenMP variant
+ * of a benchmark (compiled with -fopenmp). CoDiPack types cannot be used
+ * in parallel regions, so the CoDiPack builds stay sequential.
+ */
+#if defined(_OPENMP) && !defined(CODI_DOT) && !defined(CODI_BAR)
+  #define OMP_PARALLEL_FOR _Pragma("omp parallel for")
+#else
+  #define OMP_PARALLEL_FOR
+#endif
+
 #endif // PERFORMANCETESTMACROS_HPP
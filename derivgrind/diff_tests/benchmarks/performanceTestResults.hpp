@@ -0,0 +1,161 @@
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/*
+ * Note that if you combine this file with CoDiPack (-DCODI_DOT or -DCODI_BAR),
+ * the result will also be subject to the license terms of CoDiPack, which are those
+ * of the GNU General Public License version 3 or later.
+ */
+
+#ifndef PERFORMANCETESTRESULTS_HPP
+#define PERFORMANCETESTRESULTS_HPP
+
+/*! \file performanceTestResults.hpp
+ * Common driver code for the benchmark kernels of the performance tests.
+ *
+ * A kernel registers its inputs with registerInputs, measures the time
+ * of the computation of a scalar output, and passes everything to
+ * writePerformanceResults. The JSON file written by the latter is read
+ * by PerformanceTestCase in diff_tests/TestCase.py.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "performanceTestMacros.hpp"
+
+#if defined(CODI_BAR)
+  typedef typename DOUBLE::Tape PerformanceTape;
+#endif
+
+//! Contiguous range of input variables of a benchmark.
+struct InputRange {
+  DOUBLE* data;
+  size_t size;
+};
+
+/*! Mark all variables in the ranges as AD inputs.
+ */
+inline void registerInputs(std::vector<InputRange> const& inputs){
+  #if defined(CODI_BAR)
+    PerformanceTape& tape = DOUBLE::getTape();
+    tape.setActive();
+  #endif
+  for(InputRange const& range : inputs){
+    for(size_t i=0; i<range.size; ++i){
+      HANDLE_INPUT(range.data[i]);
+    }
+  }
+}
+
+/*! Peak resident set size (VmHWM) of the process in kB.
+ */
+inline int measureVmHWM(){
+  std::ifstream status("/proc/self/status");
+  std::string key;
+  while(status >> key){
+    if(key=="VmHWM:"){
+      int mem;
+      status >> mem;
+      return mem;
+    }
+    status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+}
+
+//! Current time for the run-time measurement of the forward computation.
+inline std::chrono::steady_clock::time_point performanceClock(){
+  return std::chrono::steady_clock::now();
+}
+
+/*! Write forward run-time, memory, output and derivative information into
+ * the JSON file filename.
+ *
+ * In recording mode with CoDiPack, the tape is evaluated here and the
+ * gradient with respect to all inputs is written.
+ */
+inline void writePerformanceResults(const char* filename,
+    std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end,
+    DOUBLE& w, std::vector<InputRange> const& inputs){
+  double time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+  int mem = measureVmHWM();
+
+  #if defined(DG_TRICK)
+    DG_DISABLE(1,0); // printing the output involves bit-tricks
+  #endif
+  std::ofstream resfile(filename);
+  resfile << "{" << std::endl;
+  resfile << "\"forward_time_in_s\": " << time/1e6 << ",\n"
+          << "\"forward_vmhwm_in_kb\": " << mem << ",\n"
+          << std::setprecision(16)
+          << "\"output\" : [ " << w << " ]";
+  #if defined(DG_DOT)
+    double w_d;
+    DG_GET_DOTVALUE(&w, &w_d, 8);
+    resfile << ",\n \"output_dot\" : [" << w_d << " ]";
+  #elif defined(DG_BAR)
+    DG_OUTPUTF(w);
+  #elif defined(DG_TRICK)
+    DG_DISABLE(0,1);
+  #elif defined(CODI_DOT)
+    resfile << ",\n \"output_dot\" : [" << w.getGradient() << " ]";
+  #elif defined(CODI_BAR)
+    PerformanceTape& tape = DOUBLE::getTape();
+    tape.registerOutput(w);
+    tape.setPassive();
+    w.setGradient(one);
+    {
+      std::chrono::steady_clock::time_point begin = performanceClock();
+      tape.evaluate();
+      std::chrono::steady_clock::time_point end = performanceClock();
+      double time = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+      resfile << ",\n \"reverse_time_in_s\": " << time/1e6 ;
+    }
+    resfile << ",\n \"number_of_jacobians\" : " << tape.getParameter(codi::TapeParameters::JacobianSize);
+    resfile << ",\n \"tape_size_in_b\" : " <<
+      (5 * tape.getParameter(codi::TapeParameters::StatementSize) +
+       12 * tape.getParameter(codi::TapeParameters::JacobianSize) );
+    resfile << ",\n \"input_bar\" : [";
+    bool first = true;
+    for(InputRange const& range : inputs){
+      for(size_t i=0; i<range.size; ++i){
+        resfile << (first ? "" : ", ") << range.data[i].getGradient();
+        first = false;
+      }
+    }
+    resfile << "]";
+    tape.reset();
+  #endif
+  resfile << "\n}";
+}
+
+#endif // PERFORMANCETESTRESULTS_HPP
@@ -0,0 +1,114 @@
+/*
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/*
+ * Note that if you combine this file with CoDiPack (-DCODI_DOT or -DCODI_BAR),
+ * the result will also be subject to the license terms of CoDiPack, which are those
+ * of the GNU General Public License version 3 or later. 
+ */
+
+/*! \file stencil.cpp
+ * Explicit finite-volume solver for the 2D shallow water equations, as a
+ * benchmark for Derivgrind.
+ *
+ * Usage: stencil <result file> <n> <timesteps>. The Lax-Friedrichs scheme
+ * is applied on a periodic n x n grid. The initial water height is the
+ * input, the output is the potential energy after the last time step.
+ *
+ * Compile the program with a flag -Dx_y where x=DG,CODI specifies the AD tool
+ * and y=DOT,BAR specifies the mode, or with -DDG_TRICK.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "performanceTestResults.hpp"
+
+static const double g = 9.81;
+
+//! Conserved variables on the grid.
+struct State {
+  std::vector<DOUBLE> h, hu, hv;
+  State(size_t size) : h(size), hu(size, 0.0), hv(size, 0.0) {}
+};
+
+int main(int nArgs, char** args) {
+  size_t n = nArgs>2 ? std::atoi(args[2]) : 64;
+  size_t timesteps = nArgs>3 ? std::atoi(args[3]) : 20;
+  double dx = 1.0/n;
+  double dt = 0.1*dx; // CFL condition for wave speeds up to about 3
+
+  State s(n*n), t(n*n);
+  for(size_t ix=0; ix<n; ++ix){
+    for(size_t iy=0; iy<n; ++iy){
+      double x = (ix+0.5)*dx-0.5, y = (iy+0.5)*dx-0.5;
+      s.h[ix*n+iy] = 0.5 + 0.1*std::exp(-50*(x*x+y*y));
+    }
+  }
+  std::vector<InputRange> inputs = {{s.h.data(),n*n}};
+  registerInputs(inputs);
+
+  auto begin = performanceClock();
+  State* cur = &s;
+  State* next = &t;
+  for(size_t step=0; step<timesteps; ++step){
+    State& c = *cur;
+    State& m = *next;
+    OMP_PARALLEL_FOR
+    for(size_t ix=0; ix<n; ++ix){
+      size_t xm = (ix+n-1)%n, xp = (ix+1)%n;
+      for(size_t iy=0; iy<n; ++iy){
+        size_t ym = (iy+n-1)%n, yp = (iy+1)%n;
+        size_t i = ix*n+iy, W = xm*n+iy, E = xp*n+iy, S = ix*n+ym, N = ix*n+yp;
+        // fluxes in x direction at the western and eastern neighbour
+        DOUBLE uW = c.hu[W]/c.h[W], uE = c.hu[E]/c.h[E];
+        DOUBLE vS = c.hv[S]/c.h[S], vN = c.hv[N]/c.h[N];
+        DOUBLE fhW = c.hu[W], fhE = c.hu[E];
+        DOUBLE fhuW = c.hu[W]*uW + 0.5*g*c.h[W]*c.h[W];
+        DOUBLE fhuE = c.hu[E]*uE + 0.5*g*c.h[E]*c.h[E];
+        DOUBLE fhvW = c.hv[W]*uW, fhvE = c.hv[E]*uE;
+        // fluxes in y direction at the southern and northern neighbour
+        DOUBLE ghS = c.hv[S], ghN = c.hv[N];
+        DOUBLE ghuS = c.hu[S]*vS, ghuN = c.hu[N]*vN;
+        DOUBLE ghvS = c.hv[S]*vS + 0.5*g*c.h[S]*c.h[S];
+        DOUBLE ghvN = c.hv[N]*vN + 0.5*g*c.h[N]*c.h[N];
+        double r = 0.5*dt/dx;
+        m.h[i]  = 0.25*(c.h[W]+c.h[E]+c.h[S]+c.h[N])     - r*(fhE-fhW)   - r*(ghN-ghS);
+        m.hu[i] = 0.25*(c.hu[W]+c.hu[E]+c.hu[S]+c.hu[N]) - r*(fhuE-fhuW) - r*(ghuN-ghuS);
+        m.hv[i] = 0.25*(c.hv[W]+c.hv[E]+c.hv[S]+c.hv[N]) - r*(fhvE-fhvW) - r*(ghvN-ghvS);
+      }
+    }
+    std::swap(cur,next);
+  }
+  DOUBLE w = 0.0;
+  for(size_t i=0; i<n*n; ++i){
+    w += 0.5*g*cur->h[i]*cur->h[i]*dx*dx;
+  }
+  auto end = performanceClock();
+
+  writePerformanceResults(args[1], begin, end, w, inputs);
+}
@@ -31,23 +31,26 @@
 import numpy as np
 import copy
 import TestCase
-from TestCase import InteractiveTestCase, ClientRequestTestCase, PerformanceTestCase, TYPE_DOUBLE, TYPE_FLOAT, TYPE_LONG_DOUBLE, TYPE_REAL4, TYPE_REAL8, TYPE_PYTHONFLOAT, TYPE_NUMPYFLOAT64, TYPE_NUMPYFLOAT32
+from TestCase import InteractiveTestCase, ClientRequestTestCase, PerformanceTestCase, SyntheticTapeTestCase, MPITestCase, TYPE_DOUBLE, TYPE_FLOAT, TYPE_LONG_DOUBLE, TYPE_REAL4, TYPE_REAL8, TYPE_PYTHONFLOAT, TYPE_NUMPYFLOAT64, TYPE_NUMPYFLOAT32
 import sys
 import os
 import fnmatch
 import tempfile
+import json
 
 selected_install_dir = "../../install"
 selected_temp_dir = None
 selected_codi_dir = os.path.dirname(__file__)+"/../externals/CoDiPack/include/"
 selected_testcase = None
-if len(sys.argv)>5:
+selected_perf_json = None
+if len(sys.argv)>6:
   print("Usage: "+sys.argv[0]+" [options]                   - Run all testcases.")
   print("       "+sys.argv[0]+" [options] name_of_testcase  - Run single testcase.")
   print("Options:")
   print("  --prefix=path    Valgrind installation directory.")
   print("  --tempdir=path   Directory for temporary files produced by tests.")
   print("  --codidir=path   Include directory of CoDiPack for performance tests.")
+  print("  --perf-json=file Write results of performance tests to JSON file.")
   exit(1)
 for i in range(1,len(sys.argv)):
   arg = sys.argv[i]
@@ -57,6 +60,8 @@ for i in range(1,len(sys.argv)):
     selected_temp_dir = arg[len('--tempdir='):]
   elif arg.startswith('--codidir='):
     selected_codi_dir = arg[len('--codidir='):]
+  elif arg.startswith('--perf-json='):
+    selected_perf_json = arg[len('--perf-json='):]
   else:
     selected_testcase = arg
 TestCase.install_dir = selected_install_dir
@@ -230,6 +235,42 @@ division.test_dots = {'c':1.5}
 division.test_bars = {'a':0.5,'b':-0.25}
 regression_templates.append(division)
 
+# partial derivatives are exactly representable in single precision
+division_partials_f32 = copy.deepcopy(division)
+division_partials_f32.name = "division_partials_f32"
+division_partials_f32.vgflags = ["--tape-partials=f32"]
+division_partials_f32.disable = lambda mode, arch, compiler, typename: mode=='dot'
+regression_templates.append(division_partials_f32)
+
+# inputs and outputs registered by DG_INPUT_ARRAY and DG_OUTPUT_ARRAY
+division_array = copy.deepcopy(division)
+division_array.name = "division_array"
+division_array.array_io = True
+division_array.disable = lambda mode, arch, compiler, typename: mode!='bar' or compiler not in ['gcc','g++','clang','clang++'] or typename not in ['double','float']
+regression_templates.append(division_array)
+
+# instrumentation starts at the client request registering the first input
+division_lazy = copy.deepcopy(division)
+division_lazy.name = "division_lazy"
+division_lazy.vgflags = ["--activate=on-first-input"]
+regression_templates.append(division_lazy)
+
+# math wrappers setting zero dot values before the first input do not activate the instrumentation
+division_lazy_math = ClientRequestTestCase("division_lazy_math")
+division_lazy_math.include = "#include <math.h>\nstatic int active_before_input;\n__attribute__((constructor)) static void math_before_input(void){ volatile double x = 0.5; x = sin(x); active_before_input = DG_STOP; }"
+division_lazy_math.ldflags = '-lm'
+division_lazy_math.stmtd = "if(active_before_input){ printf(\"ACTIVATED BEFORE INPUT\\n\"); ret = 1; } DG_START; double c = a*a;"
+division_lazy_math.stmtf = "if(active_before_input){ printf(\"ACTIVATED BEFORE INPUT\\n\"); ret = 1; } DG_START; float c = a*a;"
+division_lazy_math.vals = {'a':3.0}
+division_lazy_math.dots = {'a':1.0}
+division_lazy_math.bars = {'c':1.0}
+division_lazy_math.test_vals = {'c':9.0}
+division_lazy_math.test_dots = {'c':6.0}
+division_lazy_math.test_bars = {'a':6.0}
+division_lazy_math.vgflags = ["--activate=on-first-input"]
+division_lazy_math.disable = lambda mode, arch, compiler, typename: compiler not in ['gcc','clang']
+regression_templates.append(division_lazy_math)
+
 division_const_l = ClientRequestTestCase("division_const_l")
 division_const_l.stmtd = "double c = 0.3 / a;"
 division_const_l.stmtf = "float c = 0.3f / a;"
@@ -286,6 +327,122 @@ negative_0.test_dots = {'c':1.0}
 negative_0.test_bars = {'a':1.0}
 regression_templates.append(negative_0)
 
+# the result of passive_twice is not differentiated
+no_instrument = ClientRequestTestCase("no_instrument")
+no_instrument.include = "__attribute__((noinline)) double passive_twice(double x){ return 2*x; }"
+no_instrument.stmtd = "double c = a*passive_twice(a);"
+no_instrument.stmtf = "float c = a*(float)passive_twice(a);"
+no_instrument.vals = {'a':1.5}
+no_instrument.dots = {'a':2.0}
+no_instrument.bars = {'c':1.0}
+no_instrument.test_vals = {'c':4.5}
+no_instrument.test_dots = {'c':6.0}
+no_instrument.test_bars = {'a':3.0}
+no_instrument.vgflags = ["--no-instrument=passive_twice*"]
+regression_templates.append(no_instrument)
+
+# the tiny excluded function is chased into from the calling superblock,
+# so passiveness must be decided per instruction rather than per superblock
+no_instrument_chased = ClientRequestTestCase("no_instrument_chased")
+no_instrument_chased.include = "__attribute__((noinline)) double passive_copy(double x){ return x; }"
+no_instrument_chased.stmtd = "double c = a*passive_copy(a)*3.0;"
+no_instrument_chased.stmtf = "float c = a*(float)passive_copy(a)*3.0f;"
+no_instrument_chased.vals = {'a':1.5}
+no_instrument_chased.dots = {'a':2.0}
+no_instrument_chased.bars = {'c':1.0}
+no_instrument_chased.test_vals = {'c':6.75}
+no_instrument_chased.test_dots = {'c':9.0}
+no_instrument_chased.test_bars = {'a':4.5}
+no_instrument_chased.vgflags = ["--no-instrument=passive_copy*", "--vex-guest-chase=yes"]
+regression_templates.append(no_instrument_chased)
+
+# an excluded function calls an instrumented one, VEX chases the call;
+# the result of the excluded function is passive
+no_instrument_calls_active = ClientRequestTestCase("no_instrument_calls_active")
+no_instrument_calls_active.include = "__attribute__((noinline)) double active_square(double x){ return x*x; }\n__attribute__((noinline)) double passive_caller(double x){ return active_square(x)+1.0; }"
+no_instrument_calls_active.stmtd = "double c = a*passive_caller(a);"
+no_instrument_calls_active.stmtf = "float c = a*(float)passive_caller(a);"
+no_instrument_calls_active.vals = {'a':2.0}
+no_instrument_calls_active.dots = {'a':1.0}
+no_instrument_calls_active.bars = {'c':1.0}
+no_instrument_calls_active.test_vals = {'c':10.0}
+no_instrument_calls_active.test_dots = {'c':5.0}
+no_instrument_calls_active.test_bars = {'a':5.0}
+no_instrument_calls_active.vgflags = ["--no-instrument=passive_caller*", "--vex-guest-chase=yes"]
+regression_templates.append(no_instrument_calls_active)
+
+# tape blocks are charged to the function recording them, even if it is chased
+record_profile = ClientRequestTestCase("record_profile")
+record_profile.include = "__attribute__((noinline)) double profiled_square(double x){ return x*x; }"
+record_profile.stmtd = "double c = profiled_square(a)*3.0;"
+record_profile.stmtf = "float c = (float)profiled_square(a)*3.0f;"
+record_profile.vals = {'a':2.0}
+record_profile.dots = {'a':1.0}
+record_profile.bars = {'c':1.0}
+record_profile.test_vals = {'c':12.0}
+record_profile.test_dots = {'c':12.0}
+record_profile.test_bars = {'a':12.0}
+record_profile.vgflags = ["--record-profile=yes"]
+record_profile.test_files = {"callgrind.out.derivgrind": [r"^events: TapeBlocks TapeBytes$", r"^fn=profiled_square.*\n0x[0-9a-f]+ \d+ 1 \d+$", r"^fn=main$"]}
+record_profile.disable = lambda mode, arch, compiler, typename: mode!='bar' or compiler not in ['gcc','g++','clang','clang++']
+regression_templates.append(record_profile)
+
+# operations between DG_STOP and DG_START are not differentiated
+stop_start = ClientRequestTestCase("stop_start")
+stop_start.stmtd = "volatile double p = 0.0; DG_STOP; p = a*3.0; DG_START; double c = a*a + a*p;"
+stop_start.stmtf = "volatile float p = 0.0f; DG_STOP; p = a*3.0f; DG_START; float c = a*a + a*p;"
+stop_start.vals = {'a':2.0}
+stop_start.dots = {'a':1.0}
+stop_start.bars = {'c':1.0}
+stop_start.test_vals = {'c':16.0}
+stop_start.test_dots = {'c':10.0}
+stop_start.test_bars = {'a':10.0}
+stop_start.disable = lambda mode, arch, compiler, typename: compiler not in ['gcc','g++','clang','clang++']
+regression_templates.append(stop_start)
+
+# free zeroes the shadow, so a reused heap block carries no stale derivative
+free_reuse = ClientRequestTestCase("free_reuse")
+free_reuse.include = "#include <stdlib.h>"
+free_reuse.stmtd = "volatile double* buf = (volatile double*)malloc(4*sizeof(double)); buf[3] = a*a; double s = buf[3]; free((void*)buf); buf = (volatile double*)malloc(4*sizeof(double)); double c = s + buf[3]; free((void*)buf);"
+free_reuse.stmtf = "volatile float* buf = (volatile float*)malloc(8*sizeof(float)); buf[7] = a*a; float s = buf[7]; free((void*)buf); buf = (volatile float*)malloc(8*sizeof(float)); float c = s + buf[7]; free((void*)buf);"
+free_reuse.vals = {'a':3.0}
+free_reuse.dots = {'a':1.0}
+free_reuse.bars = {'c':1.0}
+free_reuse.test_vals = {'c':18.0}
+free_reuse.test_dots = {'c':6.0}
+free_reuse.test_bars = {'a':6.0}
+free_reuse.disable = lambda mode, arch, compiler, typename: compiler not in ['gcc','g++','clang','clang++']
+regression_templates.append(free_reuse)
+
+# compaction releases the zeroed shadow of a freed buffer, but keeps live dot values and indices
+shadow_compact = ClientRequestTestCase("shadow_compact")
+shadow_compact.include = "#include <stdlib.h>"
+shadow_compact.stmtd = "volatile double* buf = (volatile double*)malloc(1<<22); for(int i=0; i<(1<<19); i++) buf[i] = a*1.0; double s = 0.0; for(int i=0; i<(1<<19); i+=(1<<16)) s += buf[i]; free((void*)buf); buf = (volatile double*)malloc(1<<22); for(int i=0; i<(1<<19); i++) buf[i] = a*1.0; double c = s + buf[12345]*a; free((void*)buf);"
+shadow_compact.stmtf = "volatile float* buf = (volatile float*)malloc(1<<22); for(int i=0; i<(1<<20); i++) buf[i] = a*1.0f; float s = 0.0f; for(int i=0; i<(1<<20); i+=(1<<17)) s += buf[i]; free((void*)buf); buf = (volatile float*)malloc(1<<22); for(int i=0; i<(1<<20); i++) buf[i] = a*1.0f; float c = s + buf[12345]*a; free((void*)buf);"
+shadow_compact.vals = {'a':2.0}
+shadow_compact.dots = {'a':1.0}
+shadow_compact.bars = {'c':1.0}
+shadow_compact.test_vals = {'c':20.0}
+shadow_compact.test_dots = {'c':12.0}
+shadow_compact.test_bars = {'a':12.0}
+shadow_compact.vgflags = ["--shadow-compact=1"]
+shadow_compact.disable = lambda mode, arch, compiler, typename: compiler not in ['gcc','g++','clang','clang++']
+regression_templates.append(shadow_compact)
+
+shadow_compact_zeroed = ClientRequestTestCase("shadow_compact_zeroed")
+shadow_compact_zeroed.include = "#include <stdlib.h>"
+shadow_compact_zeroed.stmtd = "volatile double* buf = (volatile double*)malloc(1<<22); for(int i=0; i<(1<<19); i++) buf[i] = a*1.0; for(int i=0; i<(1<<18); i++) buf[i] = 0.0; volatile double* buf2 = (volatile double*)malloc(1<<22); for(int i=0; i<(1<<19); i++) buf2[i] = a*2.0; buf[777] = a*a; double c = buf[777] + buf[12345]*a + buf[(1<<18)+5]*a + buf2[4242]*a; free((void*)buf); free((void*)buf2);"
+shadow_compact_zeroed.stmtf = "volatile float* buf = (volatile float*)malloc(1<<22); for(int i=0; i<(1<<20); i++) buf[i] = a*1.0f; for(int i=0; i<(1<<19); i++) buf[i] = 0.0f; volatile float* buf2 = (volatile float*)malloc(1<<22); for(int i=0; i<(1<<20); i++) buf2[i] = a*2.0f; buf[777] = a*a; float c = buf[777] + buf[12345]*a + buf[(1<<19)+5]*a + buf2[4242]*a; free((void*)buf); free((void*)buf2);"
+shadow_compact_zeroed.vals = {'a':2.0}
+shadow_compact_zeroed.dots = {'a':1.0}
+shadow_compact_zeroed.bars = {'c':1.0}
+shadow_compact_zeroed.test_vals = {'c':16.0}
+shadow_compact_zeroed.test_dots = {'c':16.0}
+shadow_compact_zeroed.test_bars = {'a':16.0}
+shadow_compact_zeroed.vgflags = ["--shadow-compact=1"]
+shadow_compact_zeroed.disable = lambda mode, arch, compiler, typename: compiler not in ['gcc','g++','clang','clang++']
+regression_templates.append(shadow_compact_zeroed)
+
 ### Advances arithmetic and trigonometric operations ###
 
 abs_plus = ClientRequestTestCase("abs_plus")
@@ -324,6 +481,41 @@ abs_minus.test_dots = {'c':-2.0}
 abs_minus.test_bars = {'a':-2.0}
 regression_templates.append(abs_minus)
 
+# with optimization, GCC implements these by andpd, xorpd and orps with masks
+# from .rodata, which are differentiated without calling a helper
+sign_mask_abs = ClientRequestTestCase("sign_mask_abs")
+sign_mask_abs.include = "#include <math.h>"
+sign_mask_abs.ldflags = '-lm'
+sign_mask_abs.cflags = "-O2"
+sign_mask_abs.stmtd = "double c = fabs(a)*3.0;"
+sign_mask_abs.stmtf = "float c = fabsf(a)*3.0f;"
+sign_mask_abs.vals = {'a':-2.0}
+sign_mask_abs.dots = {'a':1.0}
+sign_mask_abs.bars = {'c':1.0}
+sign_mask_abs.test_vals = {'c':6.0}
+sign_mask_abs.test_dots = {'c':-3.0}
+sign_mask_abs.test_bars = {'a':-3.0}
+sign_mask_abs.disable = lambda mode, arch, compiler, typename: compiler not in ['gcc','g++','clang','clang++']
+regression_templates.append(sign_mask_abs)
+
+sign_mask_neg = copy.deepcopy(sign_mask_abs)
+sign_mask_neg.name = "sign_mask_neg"
+sign_mask_neg.stmtd = "double c = -(a*a);"
+sign_mask_neg.stmtf = "float c = -(a*a);"
+sign_mask_neg.test_vals = {'c':-4.0}
+sign_mask_neg.test_dots = {'c':4.0}
+sign_mask_neg.test_bars = {'a':4.0}
+regression_templates.append(sign_mask_neg)
+
+sign_mask_negabs = copy.deepcopy(sign_mask_abs)
+sign_mask_negabs.name = "sign_mask_negabs"
+sign_mask_negabs.stmtd = "double c = -fabs(a)*3.0;"
+sign_mask_negabs.stmtf = "float c = -fabsf(a)*3.0f;"
+sign_mask_negabs.test_vals = {'c':-6.0}
+sign_mask_negabs.test_dots = {'c':3.0}
+sign_mask_negabs.test_bars = {'a':3.0}
+regression_templates.append(sign_mask_negabs)
+
 copysign = ClientRequestTestCase("copysign")
 copysign.include = "#include <math.h>"
 copysign.ldflags = '-lm'
@@ -790,6 +982,32 @@ memset.test_dots = {'a':0.0}
 memset.test_bars = {'a':0.0}
 regression_templates.append(memset)
 
+# spans several shadow memory leaves
+memcpy_large = ClientRequestTestCase("memcpy_large")
+memcpy_large.include = "#include <string.h>\n#include <stdlib.h>"
+memcpy_large.stmtd = "size_t n=100000; double* aa=(double*)calloc(n,sizeof(double)); double* ac=(double*)malloc(n*sizeof(double)); aa[0] = a; aa[n-1] = 2*a; memcpy(ac,aa,n*sizeof(double)); double c=ac[0], d=ac[n-1]; memmove(ac+1,ac,(n-1)*sizeof(double)); double e=ac[1]; free(aa); free(ac);"
+memcpy_large.stmtf = "size_t n=100000; float* aa=(float*)calloc(n,sizeof(float)); float* ac=(float*)malloc(n*sizeof(float)); aa[0] = a; aa[n-1] = 2*a; memcpy(ac,aa,n*sizeof(float)); float c=ac[0], d=ac[n-1]; memmove(ac+1,ac,(n-1)*sizeof(float)); float e=ac[1]; free(aa); free(ac);"
+memcpy_large.stmtl = "size_t n=100000; long double* aa=(long double*)calloc(n,sizeof(long double)); long double* ac=(long double*)malloc(n*sizeof(long double)); aa[0] = a; aa[n-1] = 2*a; memcpy(ac,aa,n*sizeof(long double)); long double c=ac[0], d=ac[n-1]; memmove(ac+1,ac,(n-1)*sizeof(long double)); long double e=ac[1]; free(aa); free(ac);"
+memcpy_large.vals = {'a':-12.34}
+memcpy_large.dots = {'a':-56.78}
+memcpy_large.bars = {'c':1,'d':3,'e':5}
+memcpy_large.test_vals = {'c':-12.34,'d':-24.68,'e':-12.34}
+memcpy_large.test_dots = {'c':-56.78,'d':-113.56,'e':-56.78}
+memcpy_large.test_bars = {'a':12.0}
+regression_templates.append(memcpy_large)
+
+memcpy_large_slots = copy.deepcopy(memcpy_large)
+memcpy_large_slots.name = "memcpy_large_slots"
+memcpy_large_slots.vgflags = ["--shadow-layout=slots"]
+memcpy_large_slots.disable = lambda mode, arch, compiler, typename: mode=='dot'
+regression_templates.append(memcpy_large_slots)
+
+memcpy_large_index32 = copy.deepcopy(memcpy_large)
+memcpy_large_index32.name = "memcpy_large_index32"
+memcpy_large_index32.vgflags = ["--index-bits=32"]
+memcpy_large_index32.disable = lambda mode, arch, compiler, typename: mode=='dot'
+regression_templates.append(memcpy_large_index32)
+
 
 ### Control structures ###
 
@@ -1139,6 +1357,12 @@ omp_reduction.test_bars = {'a':omp_test_sum_grad}
 omp_reduction.disable = lambda mode, arch, compiler, typename: arch=='x86' and (compiler=='gcc' or compiler=='g++')
 regression_templates.append(omp_reduction)
 
+omp_reduction_pertape = copy.deepcopy(omp_reduction)
+omp_reduction_pertape.name = "omp_reduction_pertape"
+omp_reduction_pertape.tape_per_thread = True
+omp_reduction_pertape.disable = lambda mode, arch, compiler, typename: mode=='dot' or (arch=='x86' and (compiler=='gcc' or compiler=='g++'))
+regression_templates.append(omp_reduction_pertape)
+
 ### Misusing integer and logic operations for floating-point arithmetics ###
 exponentadd = ClientRequestTestCase("exponentadd")
 exponentadd.stmtd = "double c = a; *((char*)&c+6) += 0x10;"
@@ -1313,6 +1537,43 @@ for nx in range(200,5001,200):
   burgers_mem.benchmarkargs = f"{nx} {nt}"
   performance_templates.append(burgers_mem)
 
+# Benchmark suite of representative kernels, to track performance
+# across Derivgrind versions. Every kernel also has an OpenMP variant.
+benchmark_suite = {
+  "matmul": "60 2",     # n, repetitions
+  "cg": "40 20",        # grid size, iterations
+  "stencil": "48 20",   # grid size, time steps
+  "fft": "11 2",        # log2 of signal length, repetitions
+  "ode": "200 100",     # oscillators, time steps
+}
+for kernel, args in benchmark_suite.items():
+  suite = PerformanceTestCase(f"suite_{kernel}")
+  suite.benchmark = f"benchmarks/{kernel}.cpp"
+  suite.benchmarkargs = args
+  suite.benchmarkreps = 5
+  performance_templates.append(suite)
+  suite_omp = copy.deepcopy(suite)
+  suite_omp.name = f"suite_{kernel}_omp"
+  suite_omp.cflags = "-fopenmp"
+  suite_omp.threads = 4
+  performance_templates.append(suite_omp)
+
+### Hessian-vector products from the values and opcodes recorded with --record-values=yes ###
+# The math functions of NumPy are not wrapped with operation codes.
+for template, test_hvps in [
+    (multiplication, {'a':4.0, 'b':3.0}),
+    (division, {'a':-1.0, 'b':-0.25}),
+    (sqrt, {'a':-1./32}),
+    (sinh, {'a':np.sinh(2.0)}),
+    (log, {'a':-1./400}),
+    (asin, {'a':0.9*(1-0.9**2)**-1.5}),
+  ]:
+  hvp = copy.deepcopy(template)
+  hvp.name = template.name+"_hvp"
+  hvp.test_hvps = test_hvps
+  hvp.disable = lambda mode, arch, compiler, typename : mode=='dot' or compiler=='python'
+  regression_templates.append(hvp)
+
 ### Take "cross product" of regression test templates with other configuation options ###
 regression_tests = []
 for test_mode in ["dot", "bar"]:
@@ -1377,13 +1638,47 @@ for test_mode in ["dot", "bar"]:
           if test.stmt!=None and not test.disable(test_mode, test_arch, test_compiler, test_type):
             regression_tests.append(test)
 
+### Bit-trick finder ###
+trick_templates = []
+
+# the same bit-trick is hit twice, but reported once
+trick_exponent = ClientRequestTestCase("exponent")
+trick_exponent.include = "#include <string.h>"
+trick_exponent.stmtd = """DG_MARK_FLOAT(a);
+  double c = 0.;
+  for(int i=1; i<=2; i++){
+    double t = a*i;
+    unsigned long long bits; memcpy(&bits,&t,8);
+    bits += 1ull<<52; // multiply by two via the exponent
+    memcpy(&t,&bits,8);
+    c += 3.0*t;
+  }"""
+trick_exponent.vals = {'a':1.0}
+trick_exponent.test_vals = {'c':18.0}
+trick_exponent.test_output = {"Active discrete data used as floating-point operand.":1, "Bit-trick summary: 1 distinct locations.":1}
+trick_templates.append(trick_exponent)
+
+trick_tests = []
+for test_arch in ["x86", "amd64"]:
+  for trick_template in trick_templates:
+    test = copy.deepcopy(trick_template)
+    test.name = "trick_"+test_arch+"_gcc_double_"+trick_template.name
+    test.mode = 't'
+    test.arch = 32 if test_arch=="x86" else 64
+    test.compiler = "gcc"
+    test.stmt = test.stmtd
+    test.type = TYPE_DOUBLE
+    trick_tests.append(test)
+
 ### Take "cross product" of performance test templates with other configuration options
 performance_tests = []
-for test_mode in ["dot", "bar"]:
+for test_mode in ["dot", "bar", "trick"]:
   for test_arch in ["x86", "amd64"]:
     for test_compiler in ["g++", "clang++"]:
-      for test_optimizationflags in ["o3", "o0"]:
+      for test_optimizationflags in ["o3", "o0", "o3avx2"]:
         for performance_template in performance_templates:
+          if test_optimizationflags=="o3avx2" and test_arch=="x86":
+            continue # Valgrind supports AVX only on amd64
           test = copy.deepcopy(performance_template)
           test.name = "perf_"+test_mode+"_"+test_arch+"_"+test_compiler+"_"+test_optimizationflags+"_"+performance_template.name
 
@@ -1397,21 +1692,148 @@ for test_mode in ["dot", "bar"]:
 
           if test_mode=='dot':
             test.mode='d'
-          else:
+          elif test_mode=='bar':
             test.mode='b'
+          else:
+            test.mode='t'
 
           if test_optimizationflags=='o3':
             test.cflags += " -O3"
+          elif test_optimizationflags=='o3avx2':
+            test.cflags += " -O3 -mavx2"
           else:
             test.cflags += " -O0"
 
           if test.benchmarkreps==0:
-            test.benchmarkreps = 100 if test_optimizationflags=='o3' else 10
+            test.benchmarkreps = 10 if test_optimizationflags=='o0' else 100
 
           performance_tests.append(test)
 
 
-testlist = regression_tests + performance_tests
+### Synthetic tapes, to test the tape evaluation without recording ###
+synthetic_tests = []
+for name, generateargs in [
+    ("chain", "chain 100000 --outputs=3"),
+    ("tree", "tree 100001"),
+    ("dag", "dag 100000 --unary=0.2 --outputs=10"),
+    ("dag_local", "dag 100000 --locality=50 --distribution=geometric"),
+    ("dag_index32", "dag 100000 --index-bits=32 --outputs=4"),
+    ("dag_partials32", "dag 100000 --index-bits=32 --partial-bits=32 --unary=0.5"),
+    ("dag_large", "dag 10000000 --locality=1000 --outputs=100"),
+  ]:
+  test = SyntheticTapeTestCase("synthetic_"+name)
+  test.generateargs = generateargs
+  synthetic_tests.append(test)
+for name, generateargs, jacobianargs in [
+    ("jacobian_forward", "dag 20000 --inputs=300 --outputs=40 --locality=30", "--forward"),
+    ("jacobian_reverse", "dag 20000 --inputs=40 --outputs=300 --locality=30 --unary=0.3", "--reverse"),
+    ("jacobian_coo", "dag 20000 --inputs=300 --outputs=300 --locality=100 --distribution=geometric", "--coo"),
+  ]:
+  test = SyntheticTapeTestCase("synthetic_"+name)
+  test.generateargs = generateargs
+  test.jacobianargs = jacobianargs
+  synthetic_tests.append(test)
+
+### MPI wrappers ###
+# Rank 0 sends b=a*a to rank 1, which computes c=2*b. Before, it receives
+# a message by MPI_Irecv, which is not wrapped, and then an integer with
+# MPI_ANY_TAG, which must not match the shadow message of the first message.
+mpi_tests = []
+for test_mode in ["dot", "bar"]:
+  test = MPITestCase("mpi_"+test_mode+"_sendrecv")
+  test.mode = 'd' if test_mode=="dot" else 'b'
+  test.type = TYPE_DOUBLE
+  test.code = """
+#include <stdio.h>
+#include <mpi.h>
+#include <valgrind/derivgrind.h>
+int main(int argc, char** argv){
+  int ret = 0, rank;
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  char mode = DG_GET_MODE;
+  if(rank==0){
+    double a = 3.0, one = 1.0;
+    if(mode=='d') DG_SET_DOTVALUE(&a, &one, 8);
+    else DG_INPUTF(a);
+    double b = a*a;
+    MPI_Send(&b, 1, MPI_DOUBLE, 1, 5, MPI_COMM_WORLD);
+    int flag = 42;
+    MPI_Send(&flag, 1, MPI_INT, 1, 6, MPI_COMM_WORLD);
+    MPI_Send(&b, 1, MPI_DOUBLE, 1, 7, MPI_COMM_WORLD);
+  } else {
+    double b;
+    MPI_Request request;
+    MPI_Irecv(&b, 1, MPI_DOUBLE, 0, 5, MPI_COMM_WORLD, &request);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    int flag = 0;
+    MPI_Recv(&flag, 1, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if(flag!=42){ printf("WRONG MESSAGE RECEIVED: %d\\n", flag); ret = 1; }
+    MPI_Recv(&b, 1, MPI_DOUBLE, 0, 7, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    double c = 2*b;
+    if(mode=='d'){
+      double dot = 0.;
+      DG_GET_DOTVALUE(&c, &dot, 8);
+      if(dot<12.0-1e-8 || dot>12.0+1e-8){ printf("DOT VALUES DISAGREE: %lf\\n", dot); ret = 1; }
+    } else DG_OUTPUTF(c);
+  }
+  MPI_Finalize();
+  return ret;
+}
+"""
+  test.bars = {'c':1.0}
+  test.test_bars = {'a':12.0}
+  mpi_tests.append(test)
+
+for test_mode in ["dot", "bar"]:
+  test = MPITestCase("mpi_"+test_mode+"_nonblocking")
+  test.mode = 'd' if test_mode=="dot" else 'b'
+  test.type = TYPE_DOUBLE
+  test.code = """
+#include <stdio.h>
+#include <mpi.h>
+#include <valgrind/derivgrind.h>
+int check_dot(double* x, double expected){
+  double dot = 0.;
+  DG_GET_DOTVALUE(x, &dot, 8);
+  if(dot<expected-1e-8 || dot>expected+1e-8){ printf("DOT VALUES DISAGREE: %lf\\n", dot); return 1; }
+  return 0;
+}
+int main(int argc, char** argv){
+  int ret = 0, rank;
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  char mode = DG_GET_MODE;
+  if(rank==0){
+    double a = 3.0, one = 1.0;
+    if(mode=='d') DG_SET_DOTVALUE(&a, &one, 8);
+    else DG_INPUTF(a);
+    double b = a*a, w;
+    MPI_Request request;
+    MPI_Isend(&b, 1, MPI_DOUBLE, 1, 1, MPI_COMM_WORLD, &request);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(&b, 1, MPI_DOUBLE, 1, 3, &w, 1, MPI_DOUBLE, 1, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    double c = w;
+    if(mode=='d') ret |= check_dot(&c, 12.0);
+    else DG_OUTPUTF(c);
+  } else {
+    double x, z;
+    MPI_Request request;
+    MPI_Irecv(&x, 1, MPI_DOUBLE, 0, 1, MPI_COMM_WORLD, &request);
+    MPI_Waitall(1, &request, MPI_STATUSES_IGNORE);
+    double y = 2*x;
+    MPI_Sendrecv(&y, 1, MPI_DOUBLE, 0, 2, &z, 1, MPI_DOUBLE, 0, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if(mode=='d') ret |= check_dot(&z, 6.0);
+  }
+  MPI_Finalize();
+  return ret;
+}
+"""
+  test.bars = {'c':1.0}
+  test.test_bars = {'a':12.0}
+  mpi_tests.append(test)
+
+testlist = regression_tests + trick_tests + mpi_tests + performance_tests + synthetic_tests
 
 
 ### Run testcases ###
@@ -1432,6 +1854,11 @@ for testname,testresult in outcomes:
     number_of_failed_tests += 1
 print(f"Ran {len(outcomes)} tests, {number_of_failed_tests} failed.")
 
+if selected_perf_json:
+  performance = {test.name: test.performance for test in performance_tests if test.performance!=None}
+  with open(selected_perf_json, "w") as f:
+    json.dump(performance, f, indent=2)
+
 exit(number_of_failed_tests)
 
   
@@ -222,6 +222,43 @@ static void* dg_dot_ite(DiffEnv* diffenv, IRExpr* cond, void* dtrue, void* dfals
   return IRExpr_ITE(cond,dtrue,dfalse);
 }
 
+/*! Forward-mode AD handling of a bitwise logical operation whose mask is
+ *  known at translation time, without calling dg_dot_bitwise_*.
+ *  \param[in] op - 'a', 'o' or 'x' for "and", "or" or "xor".
+ *  \param[in] fpsize - Smallest unit size to be considered, 4 or 8.
+ *  \param[out] unchanged - See dg_bitwise_mask.
+ *  \returns Dot value of the result, or NULL if no mask was recognized.
+ */
+static IRExpr* dg_dot_bitwise_constant_mask(DiffEnv* diffenv, HChar op, int fpsize, IRExpr* arg1, IRExpr* d1, IRExpr* arg2, IRExpr* d2, IRExpr** unchanged){
+  int unitsize;
+  Dg_MaskOp maskops[8];
+  IRExpr *y, *yd;
+  if(dg_bitwise_mask(diffenv,op,arg1,fpsize,&unitsize,maskops,unchanged)){
+    y = arg2; yd = d2;
+  } else if(dg_bitwise_mask(diffenv,op,arg2,fpsize,&unitsize,maskops,unchanged)){
+    y = arg1; yd = d1;
+  } else {
+    return NULL;
+  }
+  int nunits = sizeofIRType(typeOfIRExpr(diffenv->sb_out->tyenv,y)) / unitsize;
+  IRExpr* signbit = unitsize==8 ? IRExpr_Const(IRConst_U64(0x8000000000000000ul)) : IRExpr_Const(IRConst_U32(0x80000000u));
+  IROp xor = unitsize==8 ? Iop_Xor64 : Iop_Xor32;
+  IRExpr* dotvalue_arr[8];
+  for(int unit=0; unit<nunits; unit++){
+    IRExpr* y_unit = getSIMDComponent(y,unitsize,nunits,unit,diffenv);
+    IRExpr* yd_unit = getSIMDComponent(yd,unitsize,nunits,unit,diffenv);
+    IRExpr* minus_yd_unit = IRExpr_Binop(xor,yd_unit,signbit);
+    switch(maskops[unit]){
+      case DG_MASK_COPY: dotvalue_arr[unit] = yd_unit; break;
+      case DG_MASK_NEG: dotvalue_arr[unit] = minus_yd_unit; break;
+      case DG_MASK_ABS: dotvalue_arr[unit] = IRExpr_ITE(dg_compare_to_zero(y_unit,unitsize,Ircr_LT),minus_yd_unit,yd_unit); break;
+      case DG_MASK_NEGABS: dotvalue_arr[unit] = IRExpr_ITE(dg_compare_to_zero(y_unit,unitsize,Ircr_GT),minus_yd_unit,yd_unit); break;
+      default: tl_assert(False);
+    }
+  }
+  return assembleSIMDVector(dotvalue_arr,unitsize,nunits,diffenv);
+}
+
 void* dg_dot_operation(DiffEnv* diffenv, IROp op,
                          IRExpr* arg1, IRExpr* arg2, IRExpr* arg3, IRExpr* arg4,
                          void* d1, void* d2, void* d3, void* d4){
@@ -249,6 +286,10 @@ void dg_dot_handle_statement(DiffEnv* diffenv, IRStmt* st_orig){
   add_statement_modified(diffenv,dg_dot_expressionhandling,st_orig);
 }
 
+void dg_dot_handle_statement_passive(DiffEnv* diffenv, IRStmt* st_orig){
+  add_statement_passive(diffenv,dg_dot_expressionhandling,st_orig);
+}
+
 void dg_dot_initialize(void){
   dg_dot_shadow_mem_buffer = VG_(malloc)("dg_dot_shadow_mem_buffer",sizeof(V256));
   dg_dot_shadowInit();
@@ -41,6 +41,13 @@
  */
 void dg_dot_handle_statement(DiffEnv* diffenv, IRStmt* st_orig);
 
+/*! Add passive forward-mode instrumentation to output IRSB, for functions
+ *  excluded by --no-instrument.
+ *  \param[in,out] diffenv - General data.
+ *  \param[in] st_orig - Original statement.
+ */
+void dg_dot_handle_statement_passive(DiffEnv* diffenv, IRStmt* st_orig);
+
 /*! Initialize forward-mode data structures.
  */
 void dg_dot_initialize(void);
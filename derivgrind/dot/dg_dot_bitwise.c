@@ -68,6 +68,13 @@
  *  as inputs and return a V128 (via Iex_VECRET). Its lower/higher 8 bytes are to be stored
  *  in the lower/higher shadow memory layer, respectively.
  *
+ *  Mostly, the mask is a constant or loaded from the read-only data of the client
+ *  program. In this case, it is recognized during instrumentation by dg_bitwise_mask,
+ *  and dg_dot_bitwise_constant_mask and dg_bar_bitwise_constant_mask emit the sign
+ *  change inline. The functions in this file are only called for masks unknown
+ *  at translation time, and for masks read from memory that the client has
+ *  modified since the translation (e.g. after mprotect).
+ *
  */
 
 /*! Building block to apply 32-bit forward-mode AD handling to both
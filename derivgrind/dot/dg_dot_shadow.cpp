@@ -33,6 +33,7 @@
 #include "externals/flexible-shadow/flexible-shadow-valgrindstdlib.hpp"
 #include <pub_tool_libcbase.h>
 #include "dg_utils.h"
+#include "dg_shadow_leaf.hpp"
 
 #ifndef SHADOW_LAYERS_32
   #define SHADOW_LAYERS_32 18,14
@@ -47,8 +48,11 @@
   #define SHADOW_LAYERS SHADOW_LAYERS_64
 #endif
 
+//! Number of bytes shadowed by a leaf.
+static const ULong leafSize = 1ul<<(SHADOW_LAYERS);
+
 struct ShadowLeafDot {
-  UChar data[1ul<<(SHADOW_LAYERS)];
+  ShadowLeafStorage<leafSize> storage;
   static ShadowLeafDot distinguished;
 };
 ShadowLeafDot ShadowLeafDot::distinguished;
@@ -58,33 +62,102 @@ using ShadowMapTypeDot = ShadowMap<Addr,ShadowLeafDot,ValgrindStandardLibraryInt
 ShadowMapTypeDot* sm_dot2;
 
 extern "C" void dg_dot_shadowGet(void* sm_address, void* real_address, int size){
-  ShadowLeafDot* leaf = sm_dot2->leaf_for_read((Addr)sm_address);
+  UChar* data = shadowLeafRead<leafSize>(sm_dot2,(Addr)sm_address);
   Addr contiguousSize = sm_dot2->contiguousElements((Addr)sm_address);
   ULong index = sm_dot2->index((Addr)sm_address);
   if(contiguousSize >= size){
-    VG_(memcpy)(real_address, &leaf->data[index], size);
+    VG_(memcpy)(real_address, &data[index], size);
   } else {
-    VG_(memcpy)(real_address, &leaf->data[index], contiguousSize);
+    VG_(memcpy)(real_address, &data[index], contiguousSize);
     dg_dot_shadowGet((void*)((Addr)sm_address+contiguousSize),(void*)((Addr)real_address+contiguousSize),size-contiguousSize);
   }
 }
 
 extern "C" void dg_dot_shadowSet(void* sm_address, void* real_address, int size){
-  ShadowLeafDot* leaf = sm_dot2->leaf_for_write((Addr)sm_address);
+  UChar* data = shadowLeafWrite<leafSize>(sm_dot2,(Addr)sm_address);
   Addr contiguousSize = sm_dot2->contiguousElements((Addr)sm_address);
   ULong index = sm_dot2->index((Addr)sm_address);
   if(contiguousSize >= size){
-    VG_(memcpy)(&leaf->data[index], real_address, size);
+    VG_(memcpy)(&data[index], real_address, size);
   } else {
-    VG_(memcpy)(&leaf->data[index], real_address, contiguousSize);
+    VG_(memcpy)(&data[index], real_address, contiguousSize);
     dg_dot_shadowSet((void*)((Addr)sm_address+contiguousSize),(void*)((Addr)real_address+contiguousSize),size-contiguousSize);
   }
 }
 
-extern "C" void dg_dot_shadowInit(){
-  for(Addr i=0; i<(1ul<<(SHADOW_LAYERS)); i++){
-    ShadowLeafDot::distinguished.data[i] = 0;
+/*! Move a chunk of shadow memory that lies within a single leaf
+ *  both on the source and on the destination side.
+ */
+static void dg_dot_shadowMoveChunk(Addr dst, Addr src, Addr chunk){
+  ShadowLeafDot* leaf_src = sm_dot2->leaf_for_read(src);
+  if(!leaf_src->storage.allocated() && !sm_dot2->leaf_for_read(dst)->storage.allocated())
+    return; // zeros are copied onto zeros, don't allocate a leaf for that
+  UChar* data_dst = shadowLeafWrite<leafSize>(sm_dot2,dst);
+  VG_(memmove)(&data_dst[sm_dot2->index(dst)], &leaf_src->storage.read()[sm_dot2->index(src)], chunk);
+}
+
+extern "C" void dg_dot_shadowCopy(void* sm_dst, void* sm_src, ULong size){
+  Addr dst = (Addr)sm_dst, src = (Addr)sm_src;
+  if(dst==src) return;
+  if(dst<src || dst>=src+size){ // front to back
+    while(size>0){
+      Addr chunk = sm_dot2->contiguousElements(src);
+      Addr chunk_dst = sm_dot2->contiguousElements(dst);
+      if(chunk_dst<chunk) chunk = chunk_dst;
+      if(size<chunk) chunk = size;
+      dg_dot_shadowMoveChunk(dst,src,chunk);
+      dst += chunk; src += chunk; size -= chunk;
+    }
+  } else { // overlapping ranges with dst>src, back to front
+    while(size>0){
+      Addr chunk = sm_dot2->index(src+size-1)+1;
+      Addr chunk_dst = sm_dot2->index(dst+size-1)+1;
+      if(chunk_dst<chunk) chunk = chunk_dst;
+      if(size<chunk) chunk = size;
+      size -= chunk;
+      dg_dot_shadowMoveChunk(dst+size,src+size,chunk);
+    }
   }
+}
+
+extern "C" void dg_dot_shadowClear(void* sm_address, ULong size){
+  Addr addr = (Addr)sm_address;
+  while(size>0){
+    Addr chunk = sm_dot2->contiguousElements(addr);
+    if(size<chunk) chunk = size;
+    ShadowLeafDot* leaf = sm_dot2->leaf_for_read(addr);
+    if(leaf->storage.allocated()){
+      if(chunk==leafSize){ // whole leaf is cleared
+        leaf->storage.release();
+      } else {
+        VG_(memset)(&leaf->storage.write()[sm_dot2->index(addr)], 0, chunk);
+      }
+    }
+    addr += chunk; size -= chunk;
+  }
+}
+
+extern "C" ULong dg_dot_shadowCompact(void){
+  return ShadowLeafStorage<leafSize>::compact();
+}
+
+extern "C" void dg_dot_shadowStats(ULong* live, ULong* peak, ULong* compacted, ULong* bytes){
+  using Storage = ShadowLeafStorage<leafSize>;
+  *live = Storage::nAllocated;
+  *peak = Storage::peakAllocated;
+  *compacted = Storage::nCompacted;
+  *bytes = leafSize;
+}
+
+extern "C" void dg_dot_shadowCacheStats(ULong* read_hits, ULong* read_misses, ULong* write_hits, ULong* write_misses){
+  using Storage = ShadowLeafStorage<leafSize>;
+  *read_hits = Storage::readCache.hits;
+  *read_misses = Storage::readCache.misses;
+  *write_hits = Storage::writeCache.hits;
+  *write_misses = Storage::writeCache.misses;
+}
+
+extern "C" void dg_dot_shadowInit(){
   sm_dot2 = (ShadowMapTypeDot*)VG_(malloc)("Space for primary map",sizeof(ShadowMapTypeDot));
   ShadowMapTypeDot::constructAt(sm_dot2);
 }
@@ -93,4 +166,3 @@ extern "C" void dg_dot_shadowFini(){
   VG_(free)(sm_dot2);
 }
 
-
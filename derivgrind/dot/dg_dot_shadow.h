@@ -32,6 +32,8 @@
 #ifndef DG_DOT_SHADOW_H
 #define DG_DOT_SHADOW_H
 
+#include "pub_tool_basics.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,6 +41,28 @@ extern "C" {
 /*! */
 void dg_dot_shadowGet(void* sm_address, void* real_address, int size);
 void dg_dot_shadowSet(void* sm_address, void* real_address, int size);
+/*! Copy shadow memory of size bytes from sm_src to sm_dst, leaf by leaf.
+ *  Overlapping ranges are handled like memmove does.
+ */
+void dg_dot_shadowCopy(void* sm_dst, void* sm_src, ULong size);
+/*! Zero shadow memory of size bytes at sm_address, leaf by leaf.
+ *  The storage of leaves that are cleared completely is released.
+ */
+void dg_dot_shadowClear(void* sm_address, ULong size);
+/*! Release the storage of all leaves that contain only zeros.
+ *  \returns Number of released leaves.
+ */
+ULong dg_dot_shadowCompact(void);
+/*! Counters of the leaf storage.
+ *  \param[out] live - Number of leaves with allocated storage.
+ *  \param[out] peak - Maximal number of leaves with allocated storage.
+ *  \param[out] compacted - Number of leaves released by dg_dot_shadowCompact.
+ *  \param[out] bytes - Bytes of storage per leaf.
+ */
+void dg_dot_shadowStats(ULong* live, ULong* peak, ULong* compacted, ULong* bytes);
+/*! Hit and miss counters of the leaf caches for reading and writing.
+ */
+void dg_dot_shadowCacheStats(ULong* read_hits, ULong* read_misses, ULong* write_hits, ULong* write_misses);
 void dg_dot_shadowInit(void);
 void dg_dot_shadowFini(void);
 
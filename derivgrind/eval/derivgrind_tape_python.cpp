@@ -49,6 +49,7 @@
 #include "dg_bar_tape_eval.hpp"
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
 
 namespace py = pybind11;
 using ull = unsigned long long;
@@ -59,24 +60,30 @@ static constexpr ull bufsize = 100;
 
 struct LoadedFile {
   std::ifstream file;
+  TapeFormat format;
 
   LoadedFile(std::string filename){
     file.open(filename,std::ios::binary);
     if(!file.good()){
       std::cerr << "Cannot open tape file '" << filename << "/dg-tape'." << std::endl;
     }
+    // dg-tape-format is located next to the tape file
+    std::string::size_type slash = filename.rfind('/');
+    format = TapeFormat::read(slash==std::string::npos ? "." : filename.substr(0,slash));
+    if(format.incomplete){
+      throw std::runtime_error("The tape '"+filename+"' is incomplete, as the recording ran out of indices. Please record again with --index-bits=64.");
+    }
   }
 
   std::function<void(ull,ull,void*)> make_loadfun(){
     return [this](ull i, ull count, void* tape_buf) -> void {
-      file.seekg(i*4*sizeof(double), std::ios::beg);
-      file.read(reinterpret_cast<char*>(tape_buf), count*4*sizeof(double));
+      format.load(file, i, count, reinterpret_cast<ull*>(tape_buf));
     };
   }
 
   ull number_of_blocks(){
     file.seekg(0,std::ios::end);
-    return file.tellg() / 32;
+    return file.tellg() / format.blocksize();
   }
 
 };
@@ -0,0 +1,184 @@
+/*
+   ----------------------------------------------------------------
+   Notice that the following MIT license applies to this one file
+   (dg_bar_tape_bench.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   ----------------------------------------------------------------
+   Notice that the above MIT license applies to this one file
+   (dg_bar_tape_bench.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+*/
+
+#ifndef DG_BAR_TAPE_BENCH_HPP
+#define DG_BAR_TAPE_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "tape-evaluation-utils.hpp"
+#include "dg_bar_tape_eval.hpp"
+
+/*! \file dg_bar_tape_bench.hpp
+ * Benchmark mode of tape-evaluation (--bench).
+ *
+ * Every repetition loads the tape file into memory, and then performs
+ * a forward and a reverse sweep over the loaded tape with Tapefile.
+ * The three phases are timed separately. With --cold, the page cache
+ * of the tape file is dropped before each repetition, so the load time
+ * includes reading from the disk.
+ *
+ * The results are printed as JSON, with the median over all repetitions
+ * converted into blocks per second and GB per second.
+ */
+
+//! Options of the benchmark mode.
+struct BenchSettings {
+  unsigned reps = 5; //!< Number of repetitions.
+  bool cold = false; //!< Drop the page cache of the tape file before each repetition.
+};
+
+//! Run-times of the phases of one repetition in seconds.
+struct BenchTimes {
+  double load, forward, reverse;
+};
+
+//! Seconds elapsed since begin.
+inline double secondsSince(std::chrono::steady_clock::time_point begin){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//! Median of the values.
+inline double median(std::vector<double> values){
+  std::sort(values.begin(), values.end());
+  return values.size()%2 ? values[values.size()/2] : (values[values.size()/2-1]+values[values.size()/2])/2;
+}
+
+/*! Benchmark the evaluation of the tape in the directory path,
+ *  with the same chunk size as the regular evaluation.
+ */
+template<ull bufsize>
+void benchmarkTape(std::string path, BenchSettings settings){
+  std::string tapefilename = path+"/dg-tape";
+  TapeFormat format = TapeFormat::read(path);
+  std::ifstream tapefile(tapefilename, std::ios::binary|std::ios::ate);
+  WARNING(!tapefile.good(), "Error: while opening '"<<tapefilename<<"'.")
+  ull filesize = tapefile.tellg();
+  ull number_of_blocks = filesize / format.blocksize();
+  WARNING(number_of_blocks==0, "Error: The tape '"<<tapefilename<<"' is empty.")
+
+  std::vector<ull> tape(4*number_of_blocks);
+  auto loadfun = [&tape](ull i, ull count, ull* tape_buf) -> void {
+    std::memcpy(tape_buf, tape.data()+4*i, count*4*sizeof(ull));
+  };
+  auto* tapefromram = new Tapefile<bufsize,decltype(loadfun)>(loadfun, number_of_blocks);
+  std::vector<double> derivativevec(number_of_blocks);
+
+  std::vector<BenchTimes> times;
+  for(unsigned rep=0; rep<settings.reps; rep++){
+    BenchTimes t;
+    if(settings.cold){
+      int fd = open(tapefilename.c_str(), O_RDONLY);
+      WARNING(fd<0, "Error: while opening '"<<tapefilename<<"'.")
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    tapefile.clear();
+    format.load(tapefile, 0, number_of_blocks, tape.data());
+    t.load = secondsSince(begin);
+
+    std::fill(derivativevec.begin(), derivativevec.end(), 0.);
+    std::ifstream inputindices(path+"/dg-input-indices");
+    for(ull index; inputindices >> index; ) if(index<number_of_blocks) derivativevec[index] = 1.;
+    begin = std::chrono::steady_clock::now();
+    tapefromram->evaluateForward(derivativevec);
+    t.forward = secondsSince(begin);
+
+    std::fill(derivativevec.begin(), derivativevec.end(), 0.);
+    std::ifstream outputindices(path+"/dg-output-indices");
+    for(ull index; outputindices >> index; ) if(index<number_of_blocks) derivativevec[index] = 1.;
+    begin = std::chrono::steady_clock::now();
+    tapefromram->evaluateBackward(derivativevec);
+    t.reverse = secondsSince(begin);
+    times.push_back(t);
+  }
+  delete tapefromram;
+
+  std::vector<double> load, forward, reverse;
+  for(BenchTimes const& t : times){
+    load.push_back(t.load);
+    forward.push_back(t.forward);
+    reverse.push_back(t.reverse);
+  }
+  double memorysize = 4.*sizeof(ull)*number_of_blocks; // size of the loaded tape
+  std::cout << std::setprecision(6);
+  std::cout << "{\n";
+  std::cout << "  \"tape\": \"" << tapefilename << "\",\n";
+  std::cout << "  \"blocks\": " << number_of_blocks << ",\n";
+  std::cout << "  \"file_size_in_b\": " << filesize << ",\n";
+  std::cout << "  \"bufsize\": " << bufsize << ",\n";
+  std::cout << "  \"cold\": " << (settings.cold ? "true" : "false") << ",\n";
+  std::cout << "  \"repetitions\": [";
+  for(unsigned rep=0; rep<times.size(); rep++){
+    std::cout << (rep ? ",\n    " : "\n    ")
+              << "{\"load_time_in_s\": " << times[rep].load
+              << ", \"forward_time_in_s\": " << times[rep].forward
+              << ", \"reverse_time_in_s\": " << times[rep].reverse << "}";
+  }
+  std::cout << "\n  ],\n";
+  std::cout << "  \"median\": {\n";
+  std::cout << "    \"load_time_in_s\": " << median(load) << ",\n";
+  std::cout << "    \"forward_time_in_s\": " << median(forward) << ",\n";
+  std::cout << "    \"reverse_time_in_s\": " << median(reverse) << ",\n";
+  std::cout << "    \"load_gb_per_s\": " << filesize/median(load)/1e9 << ",\n";
+  std::cout << "    \"forward_blocks_per_s\": " << number_of_blocks/median(forward) << ",\n";
+  std::cout << "    \"forward_gb_per_s\": " << memorysize/median(forward)/1e9 << ",\n";
+  std::cout << "    \"reverse_blocks_per_s\": " << number_of_blocks/median(reverse) << ",\n";
+  std::cout << "    \"reverse_gb_per_s\": " << memorysize/median(reverse)/1e9 << "\n";
+  std::cout << "  }\n";
+  std::cout << "}" << std::endl;
+}
+
+#endif // DG_BAR_TAPE_BENCH_HPP
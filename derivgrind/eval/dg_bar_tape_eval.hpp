@@ -44,6 +44,95 @@
    ----------------------------------------------------------------
 */
 
+#ifndef DG_BAR_TAPE_EVAL_HPP
+#define DG_BAR_TAPE_EVAL_HPP
+
+#include <cstring>
+#include <fstream>
+#include <string>
+
+/*! Layout of the blocks in a tape file, as described by the file
+ *  dg-tape-format in the recording directory.
+ *
+ *  Tapefile works with blocks of four 8-byte words (index1, index2,
+ *  diff1, diff2). Tapes recorded with --index-bits=32 store the indices
+ *  as 4-byte words, and tapes recorded with --tape-partials=f32 store the
+ *  partial derivatives as binary32. They are widened while they are loaded,
+ *  so the evaluation always uses double precision.
+ */
+struct TapeFormat {
+  using ull = unsigned long long;
+  unsigned index_bits = 64; //!< Size of the indices in bits.
+  unsigned partial_bits = 64; //!< Size of the partial derivatives in bits.
+  //! Whether the recording ran out of indices, so dependencies are missing.
+  bool incomplete = false;
+
+  //! Size of a block in the tape file in bytes.
+  ull blocksize() const { return (2*index_bits + 2*partial_bits)/8; }
+
+  //! Whether the blocks in the tape file have the layout used by Tapefile.
+  bool native() const { return index_bits==64 && partial_bits==64; }
+
+  /*! Read dg-tape-format from the recording directory.
+   *  If there is no such file, the tape has the native layout.
+   */
+  static TapeFormat read(std::string path){
+    TapeFormat format;
+    std::ifstream file(path+"/dg-tape-format");
+    std::string key;
+    unsigned value;
+    while(file >> key >> value){
+      if(key=="index-bits") format.index_bits = value;
+      else if(key=="partial-bits") format.partial_bits = value;
+      else if(key=="incomplete") format.incomplete = (value!=0);
+    }
+    return format;
+  }
+
+  /*! Convert count-many blocks, stored at the beginning of tape_buf in this
+   *  format, into the layout used by Tapefile in-place.
+   *
+   *  32-bit indices are sign-extended, so that the 0xff..f index for
+   *  --typegrind=yes is preserved.
+   */
+  void widen(ull count, ull* tape_buf) const {
+    if(native()) return;
+    char* raw = reinterpret_cast<char*>(tape_buf);
+    for(ull b=count; b>0; b--){ // back to front, as widened blocks are larger
+      char block[32];
+      std::memcpy(block, raw+(b-1)*blocksize(), blocksize());
+      ull* out = tape_buf+4*(b-1);
+      const char* in = block;
+      if(index_bits==32){
+        int index1, index2;
+        std::memcpy(&index1, in, 4); std::memcpy(&index2, in+4, 4);
+        out[0] = (ull)(long long)index1; out[1] = (ull)(long long)index2;
+        in += 8;
+      } else {
+        std::memcpy(out, in, 16);
+        in += 16;
+      }
+      if(partial_bits==32){
+        float diff1, diff2;
+        std::memcpy(&diff1, in, 4); std::memcpy(&diff2, in+4, 4);
+        double diff1_d = diff1, diff2_d = diff2;
+        std::memcpy(out+2, &diff1_d, 8); std::memcpy(out+3, &diff2_d, 8);
+      } else {
+        std::memcpy(out+2, in, 16);
+      }
+    }
+  }
+
+  /*! Load count-many blocks starting with block i from the tape file,
+   *  and widen them into the layout used by Tapefile.
+   */
+  void load(std::istream& file, ull i, ull count, ull* tape_buf) const {
+    file.seekg(i*blocksize(), std::ios::beg);
+    file.read(reinterpret_cast<char*>(tape_buf), count*blocksize());
+    widen(count, tape_buf);
+  }
+};
+
 /*! \enum TapefileEvents
  * Event types passed to an optional event handler template argument
  * of Tapefile, to enable performance measurements.
@@ -182,3 +271,4 @@ public:
   }
 };
 
+#endif // DG_BAR_TAPE_EVAL_HPP
@@ -0,0 +1,168 @@
+/*
+   ----------------------------------------------------------------
+   Notice that the following MIT license applies to this one file
+   (dg_bar_tape_hvp.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   ----------------------------------------------------------------
+   Notice that the above MIT license applies to this one file
+   (dg_bar_tape_hvp.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+*/
+
+#ifndef DG_BAR_TAPE_HVP_HPP
+#define DG_BAR_TAPE_HVP_HPP
+
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "tape-evaluation-utils.hpp"
+#include "dg_bar_tape_eval.hpp"
+
+/*! \file dg_bar_tape_hvp.hpp
+ * Hessian-vector products from a tape recorded with --record-values=yes.
+ *
+ * Besides the tape, such a recording contains the value (dg-values) and
+ * operation code (dg-opcodes) of every block. For the supported operations,
+ * the second-order partial derivatives can be expressed by the value and
+ * the first-order partial derivatives of the block, so the operands need
+ * not be known. E.g. for c=a/b, the tape holds 1/b and -a/b^2, and
+ * d^2c/(da db) = -1/b^2 and d^2c/db^2 = 2a/b^3.
+ *
+ * A forward sweep computes the dot values for the direction v, and a
+ * reverse sweep propagates bar values and their dot values (second-order
+ * adjoints). The dot values of the input bar values form the product of
+ * the Hessian of the bar-weighted sum of outputs with v.
+ */
+
+/*! Operation codes in dg-opcodes, in the same order as Dg_Opcode in derivgrind.h.
+ */
+enum TapeOpcode : unsigned char {
+  OpLinear, OpUnknown, OpMul, OpDiv, OpSqrt, OpExp, OpLog, OpLog10,
+  OpSin, OpCos, OpTan, OpSinh, OpCosh, OpTanh, OpAsin, OpAcos, OpAtan
+};
+
+//! Second-order partial derivatives of a block with two operands.
+struct SecondPartials {
+  double h11 = 0., h12 = 0., h22 = 0.;
+  bool known = true; //!< False if the opcode does not determine them.
+};
+
+/*! Second-order partial derivatives of a block.
+ *
+ * \param opcode Operation code of the block.
+ * \param value Value of the result.
+ * \param diff1 Partial derivative with respect to the first operand.
+ * \param diff2 Partial derivative with respect to the second operand.
+ */
+inline SecondPartials secondPartials(unsigned char opcode, double value, double diff1, double diff2){
+  SecondPartials h;
+  switch(opcode){
+    case OpLinear: break;
+    case OpMul: h.h12 = 1.; break;
+    case OpDiv: h.h12 = -diff1*diff1; h.h22 = -2.*diff1*diff2; break;
+    case OpSqrt: h.h11 = -2.*diff1*diff1*diff1; break;
+    case OpExp: h.h11 = diff1; break;
+    case OpLog: h.h11 = -diff1*diff1; break;
+    case OpLog10: h.h11 = -diff1*diff1*std::log(10.); break;
+    case OpSin: case OpCos: h.h11 = -value; break;
+    case OpTan: h.h11 = 2.*value*diff1; break;
+    case OpSinh: case OpCosh: h.h11 = value; break;
+    case OpTanh: h.h11 = -2.*value*diff1; break;
+    case OpAsin: h.h11 = std::sin(value)*diff1*diff1*diff1; break;
+    case OpAcos: h.h11 = std::cos(value)*diff1*diff1*diff1; break;
+    case OpAtan: h.h11 = -2.*std::tan(value)*diff1*diff1; break;
+    default: h.known = false; break;
+  }
+  return h;
+}
+
+/*! Read a binary file with one entry of type T per tape block.
+ */
+template<typename T>
+std::vector<T> readBlockwiseFile(std::string filename, ull number_of_blocks){
+  std::ifstream file(filename, std::ios::binary|std::ios::ate);
+  WARNING(!file.good(), "Error: while opening '"<<filename<<"'. Record with --record-values=yes.")
+  ull size = file.tellg();
+  WARNING(size < number_of_blocks*sizeof(T), "Error: '"<<filename<<"' has fewer entries than the tape has blocks.")
+  std::vector<T> data(number_of_blocks);
+  file.seekg(0, std::ios::beg);
+  file.read(reinterpret_cast<char*>(data.data()), number_of_blocks*sizeof(T));
+  return data;
+}
+
+/*! Forward tangent sweep followed by a second-order reverse sweep.
+ *
+ * \param tape Tapefile.
+ * \param number_of_blocks Number of blocks on the tape.
+ * \param values Value of every block.
+ * \param opcodes Operation code of every block.
+ * \param dotvec Seeded with input dot values, receives all dot values.
+ * \param barvec Seeded with output bar values, receives all bar values.
+ * \param dotbarvec Zero-initialized, receives the dot values of all bar values.
+ * \returns Number of blocks contributing to the result whose second-order partial
+ *   derivatives are unknown, and were treated as zero.
+ */
+template<typename tape_t>
+ull evaluateHessianVectorProduct(tape_t& tape, ull number_of_blocks, std::vector<double> const& values, std::vector<unsigned char> const& opcodes, std::vector<double>& dotvec, std::vector<double>& barvec, std::vector<double>& dotbarvec){
+  tape.evaluateForward(dotvec);
+  ull unknown = 0;
+  tape.iterate(number_of_blocks-1, 0, [&](ull index, ull index1, ull index2, double diff1, double diff2){
+    double bar = barvec[index], dotbar = dotbarvec[index];
+    if(bar==0 && dotbar==0) return;
+    bool active1 = index1!=0 && index1 < 0x8000000000000000;
+    bool active2 = index2!=0 && index2 < 0x8000000000000000;
+    double dot1 = active1 ? dotvec[index1] : 0., dot2 = active2 ? dotvec[index2] : 0.;
+    SecondPartials h = secondPartials(opcodes[index], values[index], diff1, diff2);
+    if(!h.known && bar!=0 && (dot1!=0 || dot2!=0)) unknown++;
+    // dot values of the partial derivatives
+    double diff1dot = h.h11*dot1 + h.h12*dot2;
+    double diff2dot = h.h12*dot1 + h.h22*dot2;
+    if(active1){
+      barvec[index1] += bar * diff1;
+      dotbarvec[index1] += dotbar * diff1 + bar * diff1dot;
+    }
+    if(active2){
+      barvec[index2] += bar * diff2;
+      dotbarvec[index2] += dotbar * diff2 + bar * diff2dot;
+    }
+  });
+  return unknown;
+}
+
+#endif // DG_BAR_TAPE_HVP_HPP
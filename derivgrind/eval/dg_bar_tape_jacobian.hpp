@@ -0,0 +1,266 @@
+/*
+   ----------------------------------------------------------------
+   Notice that the following MIT license applies to this one file
+   (dg_bar_tape_jacobian.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   ----------------------------------------------------------------
+   Notice that the above MIT license applies to this one file
+   (dg_bar_tape_jacobian.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+*/
+
+#ifndef DG_BAR_TAPE_JACOBIAN_HPP
+#define DG_BAR_TAPE_JACOBIAN_HPP
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "tape-evaluation-utils.hpp"
+#include "dg_bar_tape_eval.hpp"
+
+/*! \file dg_bar_tape_jacobian.hpp
+ * Sparse Jacobian of the outputs with respect to the inputs of a tape.
+ *
+ * First, the sparsity pattern is determined by sweeps over the tape
+ * which propagate bitsets of the inputs (forward) or outputs (reverse)
+ * that a variable depends on, resp. influences. Each sweep handles
+ * pattern_bits-many inputs or outputs, so we choose the direction with
+ * the smaller number of them.
+ *
+ * Second, the columns (for forward sweeps) or rows (for reverse sweeps)
+ * of the Jacobian are colored such that no two columns of the same color
+ * have a non-zero entry in the same row, or vice versa. All columns of a
+ * color can be seeded at once. We color both ways greedily, and use the
+ * direction with fewer colors.
+ *
+ * Third, the compressed Jacobian is computed by vector sweeps, each of
+ * which handles vector_width-many colors.
+ *
+ * Both sweep types reuse Tapefile::evaluateForward and evaluateBackward
+ * with the derivative types JacobianPattern and JacobianVector.
+ */
+
+//! Number of 64-bit words of a bitset in a pattern sweep.
+static constexpr unsigned pattern_words = 4;
+static constexpr unsigned pattern_bits = 64*pattern_words;
+//! Number of colors handled by a vector sweep.
+static constexpr unsigned vector_width = 8;
+
+/*! Set of inputs or outputs, as "derivative" type of a pattern sweep.
+ *  Multiplication with a partial derivative does nothing, and addition
+ *  is the union.
+ */
+struct JacobianPattern {
+  ull bits[pattern_words] = {};
+  JacobianPattern& operator+=(JacobianPattern const& other){
+    for(unsigned w=0; w<pattern_words; w++) bits[w] |= other.bits[w];
+    return *this;
+  }
+  JacobianPattern const& operator*(double) const { return *this; }
+  bool operator!=(int) const {
+    for(unsigned w=0; w<pattern_words; w++) if(bits[w]) return true;
+    return false;
+  }
+  void set(unsigned bit){ bits[bit/64] |= 1ull << (bit%64); }
+  bool test(unsigned bit) const { return (bits[bit/64] >> (bit%64)) & 1; }
+};
+
+//! Dot or bar values for several seeds at once, as derivative type of a vector sweep.
+struct JacobianVector {
+  double v[vector_width] = {};
+  JacobianVector& operator+=(JacobianVector const& other){
+    for(unsigned k=0; k<vector_width; k++) v[k] += other.v[k];
+    return *this;
+  }
+  JacobianVector operator*(double diff) const {
+    JacobianVector result;
+    for(unsigned k=0; k<vector_width; k++) result.v[k] = v[k]*diff;
+    return result;
+  }
+  bool operator!=(int) const {
+    for(unsigned k=0; k<vector_width; k++) if(v[k]!=0) return true;
+    return false;
+  }
+};
+
+//! Jacobian in compressed sparse row format, rows belong to outputs and columns to inputs.
+struct SparseJacobian {
+  ull rows = 0, cols = 0;
+  std::vector<ull> rowstart; //!< Entries of row i are rowstart[i],...,rowstart[i+1]-1.
+  std::vector<ull> colindex;
+  std::vector<double> values;
+};
+
+/*! Greedy coloring of the columns of a sparsity pattern, such that columns
+ *  of the same color have no common row.
+ *
+ * \param rowpattern Column indices of all rows.
+ * \param cols Number of columns.
+ * \param color Receives the color of every column.
+ * \returns Number of colors.
+ */
+inline ull colorColumns(std::vector<std::vector<ull>> const& rowpattern, ull cols, std::vector<ull>& color){
+  std::vector<std::vector<ull>> colpattern(cols);
+  for(ull i=0; i<rowpattern.size(); i++){
+    for(ull j : rowpattern[i]) colpattern[j].push_back(i);
+  }
+  color.assign(cols, 0);
+  std::vector<ull> forbidden; // forbidden[c]==j+1 if color c is used by a neighbour of column j
+  ull ncolors = 0;
+  for(ull j=0; j<cols; j++){
+    for(ull i : colpattern[j]){
+      for(ull k : rowpattern[i]){
+        if(k<j) forbidden[color[k]] = j+1;
+      }
+    }
+    ull c = 0;
+    while(c<ncolors && forbidden[c]==j+1) c++;
+    if(c==ncolors){
+      ncolors++;
+      forbidden.push_back(0);
+    }
+    color[j] = c;
+  }
+  return ncolors;
+}
+
+/*! Compute the sparse Jacobian of a tape.
+ *
+ * \param tape Tapefile providing the sweeps.
+ * \param number_of_blocks Number of blocks on the tape.
+ * \param inputindices Indices of the inputs, which correspond to columns.
+ * \param outputindices Indices of the outputs, which correspond to rows.
+ * \param direction 'f' or 'r' to force forward or reverse vector sweeps, 0 to choose automatically.
+ * \param log Receives a summary of the sweeps.
+ */
+template<typename tape_t>
+SparseJacobian computeSparseJacobian(tape_t& tape, ull number_of_blocks, std::vector<ull> const& inputindices, std::vector<ull> const& outputindices, char direction, std::ostream& log){
+  ull n = inputindices.size(), m = outputindices.size();
+  for(ull index : inputindices) WARNING(index==0 || index>=number_of_blocks, "Error: Input index "<<index<<" is not on the tape.")
+  for(ull index : outputindices) WARNING(index>=number_of_blocks, "Error: Output index "<<index<<" is not on the tape.")
+
+  // == Sparsity pattern. ==
+  std::vector<std::vector<ull>> rowpattern(m);
+  bool patternforward = n<=m;
+  ull npatternsweeps = ((patternforward ? n : m) + pattern_bits-1) / pattern_bits;
+  std::vector<JacobianPattern> patternvec(number_of_blocks);
+  for(ull sweep=0; sweep<npatternsweeps; sweep++){
+    ull first = sweep*pattern_bits;
+    std::fill(patternvec.begin(), patternvec.end(), JacobianPattern());
+    if(patternforward){
+      for(ull j=first; j<n && j<first+pattern_bits; j++) patternvec[inputindices[j]].set(j-first);
+      tape.evaluateForward(patternvec);
+      for(ull i=0; i<m; i++){
+        for(ull j=first; j<n && j<first+pattern_bits; j++){
+          if(patternvec[outputindices[i]].test(j-first)) rowpattern[i].push_back(j);
+        }
+      }
+    } else {
+      for(ull i=first; i<m && i<first+pattern_bits; i++) patternvec[outputindices[i]].set(i-first);
+      tape.evaluateBackward(patternvec);
+      for(ull j=0; j<n; j++){
+        for(ull i=first; i<m && i<first+pattern_bits; i++){
+          if(patternvec[inputindices[j]].test(i-first)) rowpattern[i].push_back(j);
+        }
+      }
+    }
+  }
+  patternvec.clear();
+  patternvec.shrink_to_fit();
+
+  // == Coloring. ==
+  std::vector<std::vector<ull>> colpattern(n);
+  for(ull i=0; i<m; i++){
+    for(ull j : rowpattern[i]) colpattern[j].push_back(i);
+  }
+  std::vector<ull> colcolor, rowcolor;
+  ull ncolcolors = colorColumns(rowpattern, n, colcolor);
+  ull nrowcolors = colorColumns(colpattern, m, rowcolor);
+  bool vectorforward = direction=='f' || (direction==0 && ncolcolors<=nrowcolors);
+  ull ncolors = vectorforward ? ncolcolors : nrowcolors;
+
+  // == Compressed Jacobian. ==
+  SparseJacobian jacobian;
+  jacobian.rows = m;
+  jacobian.cols = n;
+  jacobian.rowstart.assign(m+1, 0);
+  for(ull i=0; i<m; i++) jacobian.rowstart[i+1] = jacobian.rowstart[i] + rowpattern[i].size();
+  jacobian.colindex.resize(jacobian.rowstart[m]);
+  jacobian.values.resize(jacobian.rowstart[m]);
+  for(ull i=0; i<m; i++){
+    std::copy(rowpattern[i].begin(), rowpattern[i].end(), jacobian.colindex.begin()+jacobian.rowstart[i]);
+  }
+  ull nvectorsweeps = (ncolors + vector_width-1) / vector_width;
+  std::vector<JacobianVector> derivativevec(number_of_blocks);
+  for(ull sweep=0; sweep<nvectorsweeps; sweep++){
+    ull first = sweep*vector_width;
+    std::fill(derivativevec.begin(), derivativevec.end(), JacobianVector());
+    if(vectorforward){
+      for(ull j=0; j<n; j++){
+        if(colcolor[j]>=first && colcolor[j]<first+vector_width) derivativevec[inputindices[j]].v[colcolor[j]-first] += 1.;
+      }
+      tape.evaluateForward(derivativevec);
+      for(ull i=0; i<m; i++){
+        for(ull e=jacobian.rowstart[i]; e<jacobian.rowstart[i+1]; e++){
+          ull c = colcolor[jacobian.colindex[e]];
+          if(c>=first && c<first+vector_width) jacobian.values[e] = derivativevec[outputindices[i]].v[c-first];
+        }
+      }
+    } else {
+      for(ull i=0; i<m; i++){
+        if(rowcolor[i]>=first && rowcolor[i]<first+vector_width) derivativevec[outputindices[i]].v[rowcolor[i]-first] += 1.;
+      }
+      tape.evaluateBackward(derivativevec);
+      for(ull i=0; i<m; i++){
+        ull c = rowcolor[i];
+        if(c<first || c>=first+vector_width) continue;
+        for(ull e=jacobian.rowstart[i]; e<jacobian.rowstart[i+1]; e++){
+          jacobian.values[e] = derivativevec[inputindices[jacobian.colindex[e]]].v[c-first];
+        }
+      }
+    }
+  }
+
+  log << m << " x " << n << " Jacobian with " << jacobian.rowstart[m] << " non-zeros. "
+      << npatternsweeps << " " << (patternforward ? "forward" : "reverse") << " pattern sweeps, "
+      << ncolcolors << " column colors, " << nrowcolors << " row colors, "
+      << nvectorsweeps << " " << (vectorforward ? "forward" : "reverse") << " vector sweeps." << std::endl;
+  return jacobian;
+}
+
+#endif // DG_BAR_TAPE_JACOBIAN_HPP
@@ -0,0 +1,333 @@
+/*
+   ----------------------------------------------------------------
+   Notice that the following MIT license applies to this one file
+   (dg_bar_tape_merge.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   ----------------------------------------------------------------
+   Notice that the above MIT license applies to this one file
+   (dg_bar_tape_merge.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+*/
+
+#ifndef DG_BAR_TAPE_MERGE_HPP
+#define DG_BAR_TAPE_MERGE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <dirent.h>
+#include "tape-evaluation-utils.hpp"
+#include "dg_bar_tape_eval.hpp"
+
+/*! \file dg_bar_tape_merge.hpp
+ * Merge the per-thread tapes recorded with --tape-per-thread=yes,
+ * or the per-rank tapes recorded with derivgrind-launch, into a single tape.
+ *
+ * With --tape-per-thread=yes, every thread with ID tid writes the
+ * blocks it records into its own file dg-tape.<tid>. The upper bits of
+ * an index (starting from bit 48) contain the thread ID, and the lower
+ * bits contain the position of the block in the thread's tape. Blocks 
+ * may refer to indices of other threads.
+ *
+ * derivgrind-launch records every MPI rank r into a subdirectory rank<r>
+ * with --index-namespace=r+1, so the upper bits contain r+1 instead. The
+ * MPI wrappers record received data as tape blocks referring to
+ * indices of the sending rank.
+ *
+ * Within a thread or rank, the blocks are ordered in the order they have 
+ * been recorded. Across threads and ranks, we have lost the original order, so
+ * we determine a topological order of all blocks: We repeatedly 
+ * take the first unmerged block of any tape whose operands have all 
+ * been merged. This always succeeds, because the block that has been 
+ * recorded first among the unmerged blocks has this property.
+ * The merged tape can be evaluated like any other tape, which amounts
+ * to a coordinated reverse sweep over all threads or ranks.
+ */
+
+//! Number of bits for the position of a block within a per-thread tape.
+static constexpr int thread_shift = 48;
+
+/*! Reads the blocks of one namespace in order, together with their values
+ *  and opcodes if present.
+ *
+ *  Like Tapefile, the reader only holds one chunk of blocks in memory,
+ *  which it loads by TapeFormat::load.
+ */
+class MergeReader {
+  static constexpr ull bufsize = 1ull<<16; //!< Number of blocks per chunk.
+  std::ifstream tapefile, valuesfile, opcodesfile;
+  TapeFormat format;
+  ull number_of_values = 0, number_of_opcodes = 0;
+  ull chunk_begin = 0, chunk_count = 0; //!< Blocks in the buffers.
+  std::vector<ull> tape_buf, values_buf;
+  std::vector<char> opcodes_buf;
+
+  static ull fileSize(std::ifstream& file){
+    file.seekg(0, std::ios::end);
+    ull size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    return size;
+  }
+
+  //! Load the chunk starting at block pos.
+  void loadChunk(){
+    chunk_begin = pos;
+    chunk_count = std::min(bufsize, number_of_blocks-pos);
+    format.load(tapefile, chunk_begin, chunk_count, tape_buf.data());
+    if(number_of_values>chunk_begin){
+      valuesfile.seekg(chunk_begin*sizeof(ull), std::ios::beg);
+      valuesfile.read(reinterpret_cast<char*>(values_buf.data()), std::min(chunk_count, number_of_values-chunk_begin)*sizeof(ull));
+    }
+    if(number_of_opcodes>chunk_begin){
+      opcodesfile.seekg(chunk_begin, std::ios::beg);
+      opcodesfile.read(opcodes_buf.data(), std::min(chunk_count, number_of_opcodes-chunk_begin));
+    }
+  }
+
+public:
+  ull number_of_blocks; //!< Number of blocks on the tape, including the dummy block 0.
+  ull pos = 1; //!< Next block to be read; block 0 is a dummy block.
+
+  /*! Open the tape file and, if present, the values file and the opcodes file
+   *  next to it, with dg-values replaced by dg-opcodes.
+   */
+  MergeReader(std::string tapefilename, std::string valuesfilename)
+    : tapefile(tapefilename, std::ios::binary), tape_buf(4*bufsize) {
+    WARNING(!tapefile.good(), "Error: while opening '"<<tapefilename<<"'.")
+    std::string dir = tapefilename.substr(0, tapefilename.rfind('/'));
+    format = TapeFormat::read(dir);
+    WARNING(format.incomplete, "Error: The tape in '"<<dir<<"' is incomplete, as the recording ran out of indices. Please record again with --index-bits=64.")
+    WARNING(!format.native(), "Error: Cannot merge '"<<tapefilename<<"', which has not been recorded with 64-bit indices and partial derivatives.")
+    number_of_blocks = fileSize(tapefile)/format.blocksize();
+    if(valuesfilename.empty()) return;
+    valuesfile.open(valuesfilename, std::ios::binary);
+    if(!valuesfile.good()) return;
+    number_of_values = fileSize(valuesfile)/sizeof(ull);
+    values_buf.resize(bufsize);
+    std::string opcodesfilename = valuesfilename;
+    opcodesfilename.replace(opcodesfilename.rfind("dg-values"), 9, "dg-opcodes");
+    opcodesfile.open(opcodesfilename, std::ios::binary);
+    if(!opcodesfile.good()) return;
+    number_of_opcodes = fileSize(opcodesfile);
+    opcodes_buf.resize(bufsize);
+  }
+
+  bool havevalues() const { return valuesfile.is_open() && valuesfile.good(); }
+  bool haveopcodes() const { return opcodesfile.is_open() && opcodesfile.good(); }
+  bool done() const { return pos>=number_of_blocks; }
+
+  //! Block pos as index1, index2, diff1, diff2.
+  ull const* block(){
+    if(pos>=chunk_begin+chunk_count) loadChunk();
+    return &tape_buf[4*(pos-chunk_begin)];
+  }
+  //! Value of block pos, or 0 if not recorded.
+  ull value(){
+    block();
+    return pos<number_of_values ? values_buf[pos-chunk_begin] : 0;
+  }
+  //! Opcode of block pos, or 0 if not recorded.
+  char opcode(){
+    block();
+    return pos<number_of_opcodes ? opcodes_buf[pos-chunk_begin] : 0;
+  }
+};
+
+/*! Merge tapes of several namespaces into a single tape.
+ *
+ * The tapes are streamed chunk by chunk, and the merged tape is written
+ * while it is produced. Only the merged index of every block is kept
+ * in memory.
+ *
+ * \param tapefiles Maps the namespace (upper index bits) to the tape file.
+ * \param valuesfiles Maps the namespace to the values file, if present.
+ *   The opcodes file is expected next to it, with dg-values replaced by dg-opcodes.
+ * \param path Directory to write dg-tape and, if there are values, dg-values and dg-opcodes to.
+ * \returns Function translating a namespaced index into the merged index.
+ */
+inline std::function<ull(ull)> mergeTapes(std::map<ull,std::string> const& tapefiles, std::map<ull,std::string> const& valuesfiles, std::string path){
+  // open tapes and values of all namespaces
+  std::map<ull, std::unique_ptr<MergeReader>> readers;
+  bool havevalues = false, haveopcodes = false;
+  for(auto const& tapefilename : tapefiles){
+    ull ns = tapefilename.first;
+    auto valuesfilename = valuesfiles.find(ns);
+    readers[ns].reset(new MergeReader(tapefilename.second, valuesfilename!=valuesfiles.end() ? valuesfilename->second : ""));
+    havevalues = havevalues || readers[ns]->havevalues();
+    haveopcodes = haveopcodes || readers[ns]->haveopcodes();
+  }
+
+  // merged index of each block, 0 if not yet merged
+  auto newindex = std::make_shared<std::map<ull, std::vector<ull>>>();
+  for(auto const& reader : readers){
+    (*newindex)[reader.first].assign(reader.second->number_of_blocks, 0);
+  }
+  // Translate an index of an operand into the merged index, or return false 
+  // if the operand has not been merged yet.
+  auto translate = [newindex](ull index, ull& translated) -> bool {
+    if(index==0 || index==0xffffffffffffffff){ translated = index; return true; }
+    ull ns = index >> thread_shift;
+    ull pos = index & ((1ull<<thread_shift)-1);
+    auto it = newindex->find(ns);
+    WARNING(it==newindex->end() || pos>=it->second.size(), "Error: Tape block refers to unknown index "<<index<<".")
+    translated = it->second[pos];
+    return translated!=0;
+  };
+
+  std::ofstream tapefile(path+"/dg-tape", std::ios::binary);
+  WARNING(!tapefile.good(), "Error: while opening '"<<path<<"/dg-tape'.")
+  std::ofstream valuesfile, opcodesfile;
+  if(havevalues){
+    valuesfile.open(path+"/dg-values", std::ios::binary);
+    WARNING(!valuesfile.good(), "Error: while opening '"<<path<<"/dg-values'.")
+  }
+  if(haveopcodes){
+    opcodesfile.open(path+"/dg-opcodes", std::ios::binary);
+    WARNING(!opcodesfile.good(), "Error: while opening '"<<path<<"/dg-opcodes'.")
+  }
+  // dummy block 0
+  const ull zeros[4] = {0,0,0,0};
+  tapefile.write(reinterpret_cast<const char*>(zeros), sizeof(zeros));
+  if(havevalues) valuesfile.write(reinterpret_cast<const char*>(zeros), sizeof(ull));
+  if(haveopcodes) opcodesfile.put(0);
+  ull merged = 1; // number of blocks in the merged tape
+
+  ull remaining = 0;
+  for(auto const& reader : readers) remaining += reader.second->number_of_blocks - 1;
+  while(remaining>0){
+    bool progress = false;
+    for(auto& reader : readers){
+      ull ns = reader.first;
+      MergeReader& r = *reader.second;
+      while(!r.done()){
+        ull const* block = r.block();
+        ull mergedblock[4];
+        if(!translate(block[0],mergedblock[0]) || !translate(block[1],mergedblock[1])) break;
+        mergedblock[2] = block[2];
+        mergedblock[3] = block[3];
+        (*newindex)[ns][r.pos] = merged++;
+        tapefile.write(reinterpret_cast<const char*>(mergedblock), sizeof(mergedblock));
+        if(havevalues){ ull value = r.value(); valuesfile.write(reinterpret_cast<const char*>(&value), sizeof(ull)); }
+        if(haveopcodes) opcodesfile.put(r.opcode());
+        r.pos++; remaining--; progress = true;
+      }
+    }
+    WARNING(!progress, "Error: Tapes are inconsistent, cannot find a block whose operands have all been merged.")
+  }
+
+  return [translate](ull index) -> ull {
+    ull translated;
+    translate(index, translated);
+    return translated;
+  };
+}
+
+/*! Merge per-thread tapes into a single tape.
+ *
+ * Reads dg-tape.<tid> and, if present, dg-values.<tid> and dg-opcodes.<tid>
+ * from the directory and writes dg-tape, dg-values and dg-opcodes. The thread-encoded indices in
+ * dg-input-indices and dg-output-indices are replaced by the merged indices.
+ *
+ * \param path Recording directory.
+ */
+inline void mergePerThreadTapes(std::string path){
+  std::map<ull,std::string> tapefiles, valuesfiles;
+  DIR* dir = opendir(path.c_str());
+  WARNING(!dir, "Error: while opening directory '"<<path<<"'.")
+  const std::string prefix = "dg-tape.";
+  while(struct dirent* entry = readdir(dir)){
+    std::string name = entry->d_name;
+    if(name.compare(0, prefix.size(), prefix)!=0) continue;
+    std::string tidstr = name.substr(prefix.size());
+    if(tidstr.empty() || tidstr.find_first_not_of("0123456789")!=std::string::npos) continue;
+    ull tid = std::stoull(tidstr);
+    tapefiles[tid] = path+"/"+name;
+    valuesfiles[tid] = path+"/dg-values."+tidstr;
+  }
+  closedir(dir);
+  WARNING(tapefiles.empty(), "Error: No per-thread tape files '"<<path<<"/dg-tape.<tid>' found.")
+  auto translate = mergeTapes(tapefiles, valuesfiles, path);
+
+  // translate input and output indices
+  for(std::string filename : {path+"/dg-input-indices", path+"/dg-output-indices"}){
+    std::vector<ull> indices = readFromTextFile<ull>(filename);
+    for(ull& index : indices){
+      index = translate(index);
+    }
+    writeToTextFile(filename, indices);
+  }
+}
+
+/*! Merge per-rank tapes recorded by derivgrind-launch into a single tape.
+ *
+ * Reads the subdirectories rank0, rank1, ... of the directory, and writes
+ * dg-tape, dg-values, dg-opcodes, dg-input-indices and dg-output-indices into the directory.
+ * The input and output indices of all ranks are concatenated in the order of ranks.
+ *
+ * \param path Recording directory passed to derivgrind-launch.
+ */
+inline void mergePerRankTapes(std::string path){
+  std::map<ull,std::string> tapefiles, valuesfiles;
+  ull nranks = 0;
+  while(std::ifstream(path+"/rank"+std::to_string(nranks)+"/dg-tape").good()){
+    std::string rankpath = path+"/rank"+std::to_string(nranks);
+    tapefiles[nranks+1] = rankpath+"/dg-tape";
+    valuesfiles[nranks+1] = rankpath+"/dg-values";
+    nranks++;
+  }
+  WARNING(nranks==0, "Error: No per-rank tape file '"<<path<<"/rank0/dg-tape' found.")
+  auto translate = mergeTapes(tapefiles, valuesfiles, path);
+
+  // translate and concatenate input and output indices
+  for(std::string filename : {"/dg-input-indices", "/dg-output-indices"}){
+    std::vector<ull> indices;
+    for(ull rank=0; rank<nranks; rank++){
+      for(ull index : readFromTextFile<ull>(path+"/rank"+std::to_string(rank)+filename)){
+        indices.push_back(translate(index));
+      }
+    }
+    writeToTextFile(path+filename, indices);
+  }
+}
+
+#endif // DG_BAR_TAPE_MERGE_HPP
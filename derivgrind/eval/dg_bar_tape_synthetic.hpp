@@ -0,0 +1,265 @@
+/*
+   ----------------------------------------------------------------
+   Notice that the following MIT license applies to this one file
+   (dg_bar_tape_synthetic.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   ----------------------------------------------------------------
+   Notice that the above MIT license applies to this one file
+   (dg_bar_tape_synthetic.hpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+*/
+
+#ifndef DG_BAR_TAPE_SYNTHETIC_HPP
+#define DG_BAR_TAPE_SYNTHETIC_HPP
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "tape-evaluation-utils.hpp"
+#include "dg_bar_tape_eval.hpp"
+
+/*! \file dg_bar_tape_synthetic.hpp
+ * Synthetic tapes of controllable shape, in order to benchmark and test
+ * the tape evaluation without recording a client program.
+ *
+ * Block 0 is the dummy block, as on recorded tapes. The inputs are
+ * blocks without operands at the beginning of the tape, and the last
+ * blocks are the outputs. The following shapes are available:
+ *  - chain: every block depends on its predecessor,
+ *  - tree: a binary reduction tree over blocks/2+1 inputs,
+ *  - dag: every block depends on one or two randomly chosen earlier
+ *    blocks. With locality l>0, the distance to an operand is drawn
+ *    uniformly from 1,...,l, or from a geometric distribution with
+ *    mean l.
+ *
+ * Unary operations have the partial derivative 1, and binary operations
+ * have the partial derivatives 1/2 and 1/2. As the partial derivatives
+ * of every block sum up to 1, the derivatives are known analytically:
+ * If all inputs have the dot value 1, all blocks have the dot value 1.
+ * If all outputs have the bar value 1, the bar values of the inputs
+ * sum up to the number of outputs.
+ */
+/*! Small and fast random number generator (SplitMix64), so that generating
+ *  the dag shape is not slower than writing it to the disk.
+ */
+struct SplitMix64 {
+  using result_type = ull;
+  ull state;
+  SplitMix64(ull seed) : state(seed) {}
+  static constexpr ull min() { return 0; }
+  static constexpr ull max() { return ~0ull; }
+  ull operator()(){
+    ull z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  //! Uniformly distributed number in 0,...,range-1.
+  ull below(ull range){
+    return (unsigned __int128)(*this)() * range >> 64;
+  }
+};
+
+struct SyntheticTape {
+  enum Shape { Chain, Tree, DAG };
+  Shape shape = Chain;
+  ull blocks = 1000000; //!< Number of blocks, excluding the dummy block.
+  ull locality = 0; //!< Operand distance parameter of the dag shape, 0 for no limit.
+  bool geometric = false; //!< Draw operand distances of the dag shape from a geometric distribution.
+  double unary = 0.; //!< Fraction of unary operations in the dag shape.
+  ull inputs = 0; //!< Number of inputs of the chain and dag shapes, 0 for a default.
+  ull outputs = 1; //!< Number of outputs.
+  ull seed = 1; //!< Seed for the dag shape.
+  TapeFormat format; //!< Layout of the blocks in the tape file.
+
+  /*! Parse a specification shape:blocks[:locality].
+   */
+  static SyntheticTape parse(std::string spec){
+    SyntheticTape synthetic;
+    synthetic.setShape(spec.substr(0, spec.find(':')));
+    if(spec.find(':')!=std::string::npos){
+      std::string rest = spec.substr(spec.find(':')+1);
+      synthetic.blocks = std::stoull(rest.substr(0, rest.find(':')));
+      if(rest.find(':')!=std::string::npos){
+        synthetic.locality = std::stoull(rest.substr(rest.find(':')+1));
+      }
+    }
+    synthetic.check();
+    return synthetic;
+  }
+
+  //! Set the shape from its name.
+  void setShape(std::string name){
+    if(name=="chain") shape = Chain;
+    else if(name=="tree") shape = Tree;
+    else if(name=="dag") shape = DAG;
+    else WARNING(true, "Error: Unknown synthetic tape shape '"<<name<<"', use chain, tree or dag.")
+  }
+
+  //! Abort if the parameters do not describe a valid tape.
+  void check() const {
+    WARNING(blocks<2, "Error: A synthetic tape needs at least two blocks.")
+    WARNING(numberOfInputs()>=blocks, "Error: Too many inputs for "<<blocks<<" blocks.")
+    WARNING(outputs==0 || outputs>blocks-numberOfInputs(), "Error: The number of outputs must be between 1 and the number of non-input blocks.")
+    WARNING(unary<0. || unary>1., "Error: The fraction of unary operations must be between 0 and 1.")
+    WARNING(format.index_bits==32 && blocks>=0x80000000ull, "Error: 32-bit indices allow for at most 2^31-1 blocks.")
+  }
+
+  //! Number of inputs, which are the blocks 1,...,numberOfInputs().
+  ull numberOfInputs() const {
+    switch(shape){
+      case Tree: return blocks/2+1;
+      case Chain: return inputs ? inputs : 1;
+      default: return inputs ? inputs : (blocks/100 > 0 ? blocks/100 : 1);
+    }
+  }
+
+  /*! Call fun(index, index1, index2, diff1, diff2) for every block of the
+   *  tape in forward order, including the dummy block.
+   */
+  template<typename fun_t>
+  void generate(fun_t fun) const {
+    fun(0, 0, 0, 0., 0.);
+    ull ninputs = numberOfInputs();
+    for(ull index=1; index<=ninputs; index++){
+      fun(index, 0, 0, 0., 0.);
+    }
+    SplitMix64 rng(seed);
+    double loggeometric = locality>1 ? std::log(1.-1./locality) : -1.;
+    ull unarythreshold = unary>=1. ? ~0ull : (ull)(unary * 18446744073709551616.);
+    // operand of block index for the dag shape
+    auto pick = [&](ull index) -> ull {
+      ull range = index-1;
+      ull d;
+      if(locality==0){
+        d = 1 + rng.below(range);
+      } else if(geometric){
+        // inversion of the geometric distribution with mean locality
+        double u = ((rng()>>11)+1) * 0x1p-53;
+        d = (ull)(std::log(u)/loggeometric);
+        d = 1 + (d<range ? d : d%range);
+      } else {
+        d = 1 + rng.below(locality<range ? locality : range);
+      }
+      return index - d;
+    };
+    for(ull index=ninputs+1; index<=blocks; index++){
+      switch(shape){
+        case Chain:
+          fun(index, index-1, 0, 1., 0.);
+          break;
+        case Tree: {
+          // the k-th inner node combines nodes 2k-1 and 2k
+          ull k = index - ninputs;
+          fun(index, 2*k-1, 2*k, 0.5, 0.5);
+          break;
+        }
+        case DAG: {
+          if(unary>0. && rng()<unarythreshold){
+            fun(index, pick(index), 0, 1., 0.);
+          } else {
+            ull index1 = pick(index);
+            fun(index, index1, pick(index), 0.5, 0.5);
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  /*! Write the tape, its format and the input and output indices into the
+   *  directory path, together with unit seeds for both evaluation directions
+   *  and the expected derivatives in dg-synthetic-expected.
+   *
+   *  The tape is streamed into the file in chunks, so its size is only
+   *  bounded by the disk.
+   */
+  void write(std::string path) const {
+    check();
+    std::string tapefilename = path+"/dg-tape";
+    FILE* tapefile = std::fopen(tapefilename.c_str(), "wb");
+    WARNING(!tapefile, "Error: while opening '"<<tapefilename<<"'.")
+    constexpr ull chunk = 1<<16; // blocks written at once
+    std::vector<char> buf(chunk*32);
+    ull fill = 0; // bytes in buf
+    ull blocksize = format.blocksize();
+    bool index32 = format.index_bits==32, partial32 = format.partial_bits==32;
+    generate([&](ull /*index*/, ull index1, ull index2, double diff1, double diff2){
+      char* out = buf.data()+fill;
+      if(index32){
+        unsigned int i1 = index1, i2 = index2;
+        std::memcpy(out, &i1, 4); std::memcpy(out+4, &i2, 4);
+        out += 8;
+      } else {
+        std::memcpy(out, &index1, 8); std::memcpy(out+8, &index2, 8);
+        out += 16;
+      }
+      if(partial32){
+        float d1 = diff1, d2 = diff2;
+        std::memcpy(out, &d1, 4); std::memcpy(out+4, &d2, 4);
+      } else {
+        std::memcpy(out, &diff1, 8); std::memcpy(out+8, &diff2, 8);
+      }
+      fill += blocksize;
+      if(fill==chunk*blocksize){
+        WARNING(std::fwrite(buf.data(), 1, fill, tapefile)!=fill, "Error: while writing '"<<tapefilename<<"'.")
+        fill = 0;
+      }
+    });
+    WARNING(std::fwrite(buf.data(), 1, fill, tapefile)!=fill, "Error: while writing '"<<tapefilename<<"'.")
+    std::fclose(tapefile);
+
+    std::ofstream(path+"/dg-tape-format") << "index-bits " << format.index_bits << "\npartial-bits " << format.partial_bits << "\n";
+    std::ofstream inputindices(path+"/dg-input-indices"), inputdots(path+"/dg-input-dots");
+    for(ull index=1; index<=numberOfInputs(); index++){
+      inputindices << index << "\n";
+      inputdots << "1.0\n";
+    }
+    std::ofstream outputindices(path+"/dg-output-indices"), outputbars(path+"/dg-output-bars");
+    for(ull index=blocks-outputs+1; index<=blocks; index++){
+      outputindices << index << "\n";
+      outputbars << "1.0\n";
+    }
+    std::ofstream(path+"/dg-synthetic-expected") << "output-dot 1\ninput-bar-sum " << outputs << "\n";
+  }
+};
+
+#endif // DG_BAR_TAPE_SYNTHETIC_HPP
@@ -51,6 +51,7 @@
 #include <iomanip>
 #include <chrono>
 #include <set>
+#include <sys/stat.h>
 
 /*! \file tape-evaluation.cpp
  * Simple program to perform the "backpropagation" / tape evaluation 
@@ -63,27 +64,25 @@
 
 #include "dg_bar_tape_eval.hpp"
 #include "tape-evaluation-utils.hpp"
+#include "dg_bar_tape_merge.hpp"
+#include "dg_bar_tape_synthetic.hpp"
+#include "dg_bar_tape_bench.hpp"
+#include "dg_bar_tape_hvp.hpp"
 
 // Chunks with bufsize-many blocks are loaded from the tape file into the heap.
 static constexpr ull bufsize = 100;
 
-// In order to run a performance measurement, set measure_evaluation_time
-// to true and make bufsize large enough so only a single chunk is loaded.
-static constexpr bool measure_evaluation_time = false;
+// With --time, the time spent evaluating the chunks (excluding loading them)
+// is accumulated and written to dg-perf-tapeeval-time.
+static bool measure_evaluation_time = false;
 static std::chrono::steady_clock::time_point tbegin;
-static std::chrono::steady_clock::time_point tend = tbegin;
-static bool tbegin_has_been_taken = false;
+static std::chrono::steady_clock::duration tevaluation{0};
 void eventhandler(TapefileEvent event){
   if(measure_evaluation_time){
     if(event==EvaluateChunkBegin){
-      if(tbegin_has_been_taken){
-        std::cerr << "Performance measurements have been activated but chunk size is not large enough." << std::endl;
-        exit(1);
-      }
       tbegin = std::chrono::steady_clock::now();
-      tbegin_has_been_taken = true;
     } else if(event==EvaluateChunkEnd) {
-      tend = std::chrono::steady_clock::now();
+      tevaluation += std::chrono::steady_clock::now() - tbegin;
     }
   }
 }
@@ -93,18 +92,56 @@ int main(int argc, char* argv[]){
 
   // open tape file
   if(argc<2){ // too few arguments
-    std::cerr << "Usage: " << argv[0] << " path [--stats|--forward|--print]" << std::endl;
+    std::cerr << "Usage: " << argv[0] << " path [--stats|--forward|--hvp|--print|--merge|--merge-ranks] [--time]" << std::endl;
+    std::cerr << "       " << argv[0] << " path --bench [--reps=N] [--cold] [--synthetic=chain|tree|dag:blocks[:locality]]" << std::endl;
     return 1;
   }
   std::string path = argv[1];
+
+  // benchmark the evaluation, optionally of a synthetic tape
+  if(argc>=3 && std::string(argv[2])=="--bench"){
+    BenchSettings settings;
+    for(int i=3; i<argc; i++){
+      std::string arg = argv[i];
+      if(arg.rfind("--reps=",0)==0){
+        settings.reps = std::stoul(arg.substr(7));
+      } else if(arg=="--cold"){
+        settings.cold = true;
+      } else if(arg.rfind("--synthetic=",0)==0){
+        mkdir(path.c_str(), 0755);
+        SyntheticTape::parse(arg.substr(12)).write(path);
+      } else {
+        WARNING(true, "Error: Unknown benchmark option '"<<arg<<"'.")
+      }
+    }
+    WARNING(settings.reps==0, "Error: Need at least one repetition.")
+    benchmarkTape<bufsize>(path, settings);
+    exit(0);
+  }
+
+  // merge tapes recorded with --tape-per-thread=yes
+  if(argc>=3 && std::string(argv[2])=="--merge"){
+    mergePerThreadTapes(path);
+    exit(0);
+  }
+
+  // merge tapes of MPI ranks recorded with derivgrind-launch
+  if(argc>=3 && std::string(argv[2])=="--merge-ranks"){
+    mergePerRankTapes(path);
+    exit(0);
+  }
+
   std::ifstream tapefile(path+"/dg-tape",std::ios::binary);
-  WARNING(!tapefile.good(), "Cannot open tape file '"<<argv[1]<<"/dg-tape'.")
+  WARNING(!tapefile.good(), "Cannot open tape file '"<<argv[1]<<"/dg-tape'. "
+    "If you have recorded with --tape-per-thread=yes, run '"<<argv[0]<<" "<<argv[1]<<" --merge' first. "
+    "If you have recorded with derivgrind-launch, run '"<<argv[0]<<" "<<argv[1]<<" --merge-ranks' first.")
+  TapeFormat format = TapeFormat::read(path);
+  WARNING(format.incomplete, "Error: The tape in '"<<argv[1]<<"' is incomplete, as the recording ran out of indices. Please record again with --index-bits=64.")
   tapefile.seekg(0,std::ios::end);
-  ull number_of_blocks = tapefile.tellg() / 32; // number of entries
+  ull number_of_blocks = tapefile.tellg() / format.blocksize(); // number of entries
 
-  auto loadfun = [&tapefile](ull i, ull count, ull* tape_buf) -> void {
-    tapefile.seekg(i*4*sizeof(double), std::ios::beg);
-    tapefile.read(reinterpret_cast<char*>(tape_buf), count*4*sizeof(double));
+  auto loadfun = [&tapefile,&format](ull i, ull count, ull* tape_buf) -> void {
+    format.load(tapefile, i, count, tape_buf);
   };
 
   Tapefile<bufsize,decltype(loadfun),eventhandler>* tape = new Tapefile<bufsize,decltype(loadfun),eventhandler>(loadfun, number_of_blocks);
@@ -147,9 +184,31 @@ int main(int argc, char* argv[]){
     exit(0);
   }
 
+  // Hessian-vector product, requires a recording with --record-values=yes
+  if(argc>=3 && std::string(argv[2])=="--hvp"){
+    std::vector<double> values = readBlockwiseFile<double>(path+"/dg-values", number_of_blocks);
+    std::vector<unsigned char> opcodes = readBlockwiseFile<unsigned char>(path+"/dg-opcodes", number_of_blocks);
+    std::vector<double> dotvec(number_of_blocks, 0.), barvec(number_of_blocks, 0.), dotbarvec(number_of_blocks, 0.);
+    seedGradientVectorFromTextFile(path+"/dg-input-indices", path+"/dg-input-dots", dotvec);
+    seedGradientVectorFromTextFile(path+"/dg-output-indices", path+"/dg-output-bars", barvec);
+    ull unknown = evaluateHessianVectorProduct(*tape, number_of_blocks, values, opcodes, dotvec, barvec, dotbarvec);
+    if(unknown>0){
+      std::cerr << "Warning: " << unknown << " blocks have unknown second-order partial derivatives "
+                << "(e.g. from pow, atan2 or DG_NEW_INDEX), which were treated as zero." << std::endl;
+    }
+    readGradientVectorToTextFile(path+"/dg-output-indices", path+"/dg-output-dots", dotvec);
+    readGradientVectorToTextFile(path+"/dg-input-indices", path+"/dg-input-bars", barvec);
+    readGradientVectorToTextFile(path+"/dg-input-indices", path+"/dg-input-hvp", dotbarvec);
+    exit(0);
+  }
+
   bool forward = false; // if true, perform forward evaluation of tape instead of reverse evaluation
-  if(argc>=3 && std::string(argv[2])=="--forward"){
-    forward = true;
+  for(int i=2; i<argc; i++){
+    if(std::string(argv[i])=="--forward"){
+      forward = true;
+    } else if(std::string(argv[i])=="--time"){
+      measure_evaluation_time = true;
+    }
   }
 
   // Initialize the derivative vector ("adjoint vector") storing the bar values, 
@@ -171,7 +230,7 @@ int main(int argc, char* argv[]){
 
   if(measure_evaluation_time){
     std::ofstream timefile(path+"/dg-perf-tapeeval-time");
-    double time = std::chrono::duration_cast<std::chrono::microseconds>(tend - tbegin).count();
+    double time = std::chrono::duration_cast<std::chrono::microseconds>(tevaluation).count();
     timefile << time/1e6 << std::endl;
   }
 
@@ -0,0 +1,117 @@
+/*
+   ----------------------------------------------------------------
+   Notice that the following MIT license applies to this one file
+   (tape-generate.cpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   ----------------------------------------------------------------
+   Notice that the above MIT license applies to this one file
+   (tape-generate.cpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+*/
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+
+/*! \file tape-generate.cpp
+ * Program to write synthetic tapes, in order to test and benchmark the
+ * tape evaluation at scale without running a client program under Valgrind.
+ *
+ * The written directory can be passed to tape-evaluation like a
+ * recording directory. See dg_bar_tape_synthetic.hpp for the shapes and
+ * the derivatives that the evaluation must reproduce.
+ */
+
+#include "tape-evaluation-utils.hpp"
+#include "dg_bar_tape_eval.hpp"
+#include "dg_bar_tape_synthetic.hpp"
+
+int main(int argc, char* argv[]){
+  if(argc<4){
+    std::cerr << "Usage: " << argv[0] << " path chain|tree|dag blocks [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --locality=l          maximal (uniform) or mean (geometric) operand distance for dag [no limit]" << std::endl;
+    std::cerr << "  --distribution=uniform|geometric  distribution of operand distances for dag [uniform]" << std::endl;
+    std::cerr << "  --unary=p             fraction of unary operations for dag [0]" << std::endl;
+    std::cerr << "  --inputs=n            number of inputs for chain and dag [1, blocks/100]" << std::endl;
+    std::cerr << "  --outputs=m           number of outputs [1]" << std::endl;
+    std::cerr << "  --seed=s              seed of the random number generator [1]" << std::endl;
+    std::cerr << "  --index-bits=64|32    size of indices on the tape [64]" << std::endl;
+    std::cerr << "  --partial-bits=64|32  size of partial derivatives on the tape [64]" << std::endl;
+    return 1;
+  }
+  std::string path = argv[1];
+  SyntheticTape synthetic;
+  synthetic.setShape(argv[2]);
+  synthetic.blocks = std::stoull(argv[3]);
+  for(int i=4; i<argc; i++){
+    std::string arg = argv[i];
+    std::string value = arg.substr(arg.find('=')+1);
+    if(arg.rfind("--locality=",0)==0){
+      synthetic.locality = std::stoull(value);
+    } else if(arg.rfind("--distribution=",0)==0){
+      WARNING(value!="uniform" && value!="geometric", "Error: Unknown distribution '"<<value<<"'.")
+      synthetic.geometric = (value=="geometric");
+    } else if(arg.rfind("--unary=",0)==0){
+      synthetic.unary = std::stod(value);
+    } else if(arg.rfind("--inputs=",0)==0){
+      synthetic.inputs = std::stoull(value);
+    } else if(arg.rfind("--outputs=",0)==0){
+      synthetic.outputs = std::stoull(value);
+    } else if(arg.rfind("--seed=",0)==0){
+      synthetic.seed = std::stoull(value);
+    } else if(arg.rfind("--index-bits=",0)==0){
+      WARNING(value!="64" && value!="32", "Error: Index bits must be 64 or 32.")
+      synthetic.format.index_bits = std::stoul(value);
+    } else if(arg.rfind("--partial-bits=",0)==0){
+      WARNING(value!="64" && value!="32", "Error: Partial bits must be 64 or 32.")
+      synthetic.format.partial_bits = std::stoul(value);
+    } else {
+      WARNING(true, "Error: Unknown option '"<<arg<<"'.")
+    }
+  }
+
+  mkdir(path.c_str(), 0755);
+  auto begin = std::chrono::steady_clock::now();
+  synthetic.write(path);
+  double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  double bytes = double(synthetic.blocks+1) * synthetic.format.blocksize();
+  std::cout << "Wrote " << synthetic.blocks+1 << " blocks (" << bytes << " bytes) in " << time
+            << " s (" << bytes/time/1e9 << " GB/s)." << std::endl;
+}
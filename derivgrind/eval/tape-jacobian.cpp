@@ -0,0 +1,130 @@
+/*
+   ----------------------------------------------------------------
+   Notice that the following MIT license applies to this one file
+   (tape-jacobian.cpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   ----------------------------------------------------------------
+   Notice that the above MIT license applies to this one file
+   (tape-jacobian.cpp) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+*/
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/*! \file tape-jacobian.cpp
+ * Program to compute the sparse Jacobian of the outputs with respect to
+ * the inputs of a tape, with a few compressed sweeps instead of one sweep
+ * per output or input.
+ *
+ * The Jacobian is written to the binary file dg-jacobian in the recording
+ * directory. Rows correspond to the lines of dg-output-indices, and columns
+ * to the lines of dg-input-indices. The file starts with three 8-byte
+ * unsigned integers: the number of rows, the number of columns and the
+ * number of non-zeros nnz. In CSR format (default), it continues with
+ * rows+1 8-byte row start offsets, nnz 8-byte column indices and nnz
+ * doubles. In COO format (--coo), it continues with nnz records of an
+ * 8-byte row index, an 8-byte column index and a double.
+ */
+
+#include "tape-evaluation-utils.hpp"
+#include "dg_bar_tape_eval.hpp"
+#include "dg_bar_tape_jacobian.hpp"
+
+// Chunks with bufsize-many blocks are loaded from the tape file into the heap.
+static constexpr ull bufsize = 100;
+
+template<typename T>
+void writeBinary(std::ofstream& file, T const& value){
+  file.write(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+int main(int argc, char* argv[]){
+  if(argc<2){
+    std::cerr << "Usage: " << argv[0] << " path [--forward|--reverse] [--coo]" << std::endl;
+    return 1;
+  }
+  std::string path = argv[1];
+  char direction = 0;
+  bool coo = false;
+  for(int i=2; i<argc; i++){
+    std::string arg = argv[i];
+    if(arg=="--forward") direction = 'f';
+    else if(arg=="--reverse") direction = 'r';
+    else if(arg=="--coo") coo = true;
+    else WARNING(true, "Error: Unknown option '"<<arg<<"'.")
+  }
+
+  std::ifstream tapefile(path+"/dg-tape",std::ios::binary);
+  WARNING(!tapefile.good(), "Cannot open tape file '"<<path<<"/dg-tape'.")
+  TapeFormat format = TapeFormat::read(path);
+  WARNING(format.incomplete, "Error: The tape in '"<<path<<"' is incomplete, as the recording ran out of indices. Please record again with --index-bits=64.")
+  tapefile.seekg(0,std::ios::end);
+  ull number_of_blocks = tapefile.tellg() / format.blocksize();
+  auto loadfun = [&tapefile,&format](ull i, ull count, ull* tape_buf) -> void {
+    tapefile.clear();
+    format.load(tapefile, i, count, tape_buf);
+  };
+  auto* tape = new Tapefile<bufsize,decltype(loadfun)>(loadfun, number_of_blocks);
+
+  std::vector<ull> inputindices = readFromTextFile<ull>(path+"/dg-input-indices");
+  std::vector<ull> outputindices = readFromTextFile<ull>(path+"/dg-output-indices");
+  SparseJacobian jacobian = computeSparseJacobian(*tape, number_of_blocks, inputindices, outputindices, direction, std::cout);
+  delete tape;
+
+  std::ofstream jacobianfile(path+"/dg-jacobian", std::ios::binary);
+  WARNING(!jacobianfile.good(), "Error: while opening '"<<path<<"/dg-jacobian'.")
+  ull nnz = jacobian.rowstart[jacobian.rows];
+  writeBinary(jacobianfile, jacobian.rows);
+  writeBinary(jacobianfile, jacobian.cols);
+  writeBinary(jacobianfile, nnz);
+  if(coo){
+    for(ull i=0; i<jacobian.rows; i++){
+      for(ull e=jacobian.rowstart[i]; e<jacobian.rowstart[i+1]; e++){
+        writeBinary(jacobianfile, i);
+        writeBinary(jacobianfile, jacobian.colindex[e]);
+        writeBinary(jacobianfile, jacobian.values[e]);
+      }
+    }
+  } else {
+    jacobianfile.write(reinterpret_cast<char const*>(jacobian.rowstart.data()), (jacobian.rows+1)*sizeof(ull));
+    jacobianfile.write(reinterpret_cast<char const*>(jacobian.colindex.data()), nnz*sizeof(ull));
+    jacobianfile.write(reinterpret_cast<char const*>(jacobian.values.data()), nnz*sizeof(double));
+  }
+}
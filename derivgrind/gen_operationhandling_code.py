@@ -224,11 +224,15 @@ def applyComponentwisely(inputs,outputs,fpsize,simdsize,bodyLowest,bodyNonLowest
     s += f"IRExpr* {outvar} = assembleSIMDVector({outputs[outvar]}_arr, {fpsize}, {simdsize}, diffenv);\n"
   return s
 
-def createBarCode(op, inputs, floatinputs, partials, value, fpsize,simdsize,llo):
+def createBarCode(op, inputs, floatinputs, partials, value, fpsize,simdsize,llo,opcode="DG_OPCODE_LINEAR"):
   """
     Create C code that records an operation on the tape for every component of a SIMD vector,
     given the partial derivatives.
 
+    For SIMD operations with one or two inputs, all components are recorded by a single
+    dirty call via dg_bar_writeToTape_vector. Otherwise, every component is recorded by a
+    separate dirty call via dg_bar_writeToTape.
+
     A partial derivative is specified as C code for an IRExpr* of type F64. The C code may involve
     - the IRExpr* arg1part of type I64 for the respective component of arg1, with the higher 4 bytes
       being zero if fpsize==4,
@@ -245,6 +249,9 @@ def createBarCode(op, inputs, floatinputs, partials, value, fpsize,simdsize,llo)
     @param fpsize - Size of component, either 4 or 8 (bytes)
     @param simdsize - Number of components, 1, 2, 4 or 8.
     @param llo - Whether it is a lowest-lane-only operation, boolean.
+    @param opcode - Dg_Opcode recorded with --record-values=yes, for the second-order partial derivatives.
+                    For three inputs, it is recorded for the block combining the first two inputs,
+                    which are then added to the third one.
   """
   # createBarCode calls applyComponentwisely with the proper input and output vectors and type conversions.
   assert(len(inputs) in [1,2,3])
@@ -256,20 +263,40 @@ def createBarCode(op, inputs, floatinputs, partials, value, fpsize,simdsize,llo)
   output_names = {"indexIntLo":"indexIntLo_part", "indexIntHi":"indexIntHi_part"}
   # the body computes IRExpr* indexIntLo_part, IRExpr* indexIntHi_part of type I64 with the upper and lower
   # layer of the index in the respective lower 4 bytes, and zero in the upper four bytes.
-  bodyLowest = ""
+  floatconversion = ""
   for i in floatinputs:
     if fpsize==4:
-      bodyLowest += f'IRExpr* arg{i}_part_f = IRExpr_Unop(Iop_F32toF64,IRExpr_Unop(Iop_ReinterpI32asF32,IRExpr_Unop(Iop_64to32,arg{i}_part)));\n'
+      floatconversion += f'IRExpr* arg{i}_part_f = IRExpr_Unop(Iop_F32toF64,IRExpr_Unop(Iop_ReinterpI32asF32,IRExpr_Unop(Iop_64to32,arg{i}_part)));\n'
     else:
-      bodyLowest += f'IRExpr* arg{i}_part_f = IRExpr_Unop(Iop_ReinterpI64asF64,arg{i}_part);'
+      floatconversion += f'IRExpr* arg{i}_part_f = IRExpr_Unop(Iop_ReinterpI64asF64,arg{i}_part);'
+  if simdsize>1 and not llo and len(inputs) in [1,2]:
+    # compute partials and values for every component, then record all components with a single dirty call
+    barcode = f"IRExpr* diff1_arr[{simdsize}];\nIRExpr* diff2_arr[{simdsize}];\nIRExpr* value_arr[{simdsize}];\n"
+    for component in range(simdsize):
+      barcode += "{\n"
+      for i in inputs:
+        barcode += f"  IRExpr* arg{i}_part = getSIMDComponent(arg{i},{fpsize},{simdsize},{component},diffenv);\n"
+        if fpsize==4:
+          barcode += f"  arg{i}_part = IRExpr_Binop(Iop_32HLto64,IRExpr_Const(IRConst_U32(0)),arg{i}_part);\n"
+      barcode += floatconversion
+      barcode += f"  diff1_arr[{component}] = {partials[0]};\n"
+      barcode += f"  diff2_arr[{component}] = {partials[1] if len(inputs)==2 else 'IRExpr_Const(IRConst_F64(0.))'};\n"
+      barcode += f"  value_arr[{component}] = {value};\n"
+      barcode += "}\n"
+    index2 = f"i{inputs[1]}Lo, i{inputs[1]}Hi" if len(inputs)==2 else "NULL, NULL"
+    barcode += f"IRExpr** indexIntHiLo = dg_bar_writeToTape_vector(diffenv, i{inputs[0]}Lo, i{inputs[0]}Hi, {index2}, diff1_arr, diff2_arr, value_arr, {fpsize}, {simdsize}, {opcode});\n"
+    barcode += f"IRExpr* indexLo = reinterpretType(diffenv,indexIntHiLo[0], typeOfIRExpr(diffenv->sb_out->tyenv,{op.apply()}));\n"
+    barcode += f"IRExpr* indexHi = reinterpretType(diffenv,indexIntHiLo[1], typeOfIRExpr(diffenv->sb_out->tyenv,{op.apply()}));\n"
+    return barcode
+  bodyLowest = floatconversion
   # add statement to push to tape
   if len(inputs)==1: # use index 0 to indicate missing input
-    bodyLowest += f'  IRExpr** indexIntHiLo_part = dg_bar_writeToTape(diffenv,i{inputs[0]}Lo_part,i{inputs[0]}Hi_part,IRExpr_Const(IRConst_U64(0)),IRExpr_Const(IRConst_U64(0)), {partials[0]}, IRExpr_Const(IRConst_F64(0.)), {value});\n  IRExpr* indexIntLo_part = indexIntHiLo_part[0];\n  IRExpr* indexIntHi_part = indexIntHiLo_part[1];\n'
+    bodyLowest += f'  IRExpr** indexIntHiLo_part = dg_bar_writeToTape(diffenv,i{inputs[0]}Lo_part,i{inputs[0]}Hi_part,IRExpr_Const(IRConst_U64(0)),IRExpr_Const(IRConst_U64(0)), {partials[0]}, IRExpr_Const(IRConst_F64(0.)), {value}, {opcode});\n  IRExpr* indexIntLo_part = indexIntHiLo_part[0];\n  IRExpr* indexIntHi_part = indexIntHiLo_part[1];\n'
   elif len(inputs)==2:
-    bodyLowest += f'  IRExpr** indexIntHiLo_part = dg_bar_writeToTape(diffenv,i{inputs[0]}Lo_part,i{inputs[0]}Hi_part,i{inputs[1]}Lo_part,i{inputs[1]}Hi_part, {partials[0]}, {partials[1]}, {value});\n  IRExpr* indexIntLo_part = indexIntHiLo_part[0];\n  IRExpr* indexIntHi_part = indexIntHiLo_part[1];\n'
+    bodyLowest += f'  IRExpr** indexIntHiLo_part = dg_bar_writeToTape(diffenv,i{inputs[0]}Lo_part,i{inputs[0]}Hi_part,i{inputs[1]}Lo_part,i{inputs[1]}Hi_part, {partials[0]}, {partials[1]}, {value}, {opcode});\n  IRExpr* indexIntLo_part = indexIntHiLo_part[0];\n  IRExpr* indexIntHi_part = indexIntHiLo_part[1];\n'
   elif len(inputs)==3: # add two tape entries to combine three inputs
-    bodyLowest += f'  IRExpr** indexIntermediateIntHiLo_part = dg_bar_writeToTape(diffenv,i{inputs[0]}Lo_part,i{inputs[0]}Hi_part,i{inputs[1]}Lo_part,i{inputs[1]}Hi_part, {partials[0]}, {partials[1]}, IRExpr_Const(IRConst_F64(0.)));\n  IRExpr* indexIntermediateIntLo_part = indexIntermediateIntHiLo_part[0];\n  IRExpr* indexIntermediateIntHi_part = indexIntermediateIntHiLo_part[1];\n'
-    bodyLowest += f'  IRExpr** indexIntHiLo_part = dg_bar_writeToTape(diffenv,indexIntermediateIntLo_part,indexIntermediateIntHi_part,i{inputs[2]}Lo_part,i{inputs[2]}Hi_part, IRExpr_Const(IRConst_F64(1.)), {partials[2]}, {value});\n  IRExpr* indexIntLo_part = indexIntHiLo_part[0];\n  IRExpr* indexIntHi_part = indexIntHiLo_part[1];\n'
+    bodyLowest += f'  IRExpr** indexIntermediateIntHiLo_part = dg_bar_writeToTape(diffenv,i{inputs[0]}Lo_part,i{inputs[0]}Hi_part,i{inputs[1]}Lo_part,i{inputs[1]}Hi_part, {partials[0]}, {partials[1]}, IRExpr_Const(IRConst_F64(0.)), {opcode});\n  IRExpr* indexIntermediateIntLo_part = indexIntermediateIntHiLo_part[0];\n  IRExpr* indexIntermediateIntHi_part = indexIntermediateIntHiLo_part[1];\n'
+    bodyLowest += f'  IRExpr** indexIntHiLo_part = dg_bar_writeToTape(diffenv,indexIntermediateIntLo_part,indexIntermediateIntHi_part,i{inputs[2]}Lo_part,i{inputs[2]}Hi_part, IRExpr_Const(IRConst_F64(1.)), {partials[2]}, {value}, DG_OPCODE_LINEAR);\n  IRExpr* indexIntLo_part = indexIntHiLo_part[0];\n  IRExpr* indexIntHi_part = indexIntHiLo_part[1];\n'
   if llo:
     bodyNonLowest = f'  IRExpr* indexIntLo_part = i{inputs[0]}Lo_part;\n  IRExpr* indexIntHi_part = i{inputs[0]}Hi_part;\n'
   else:
@@ -365,9 +392,9 @@ for suffix,fpsize,simdsize,llo in [pF64, pF32, p64Fx2, p64Fx4, p32Fx4, p32Fx8, p
 
   add.barcode = createBarCode(add, [2-llo,3-llo], [2-llo,3-llo], ["IRExpr_Const(IRConst_F64(1.))", "IRExpr_Const(IRConst_F64(1.))"], f"IRExpr_Triop(Iop_AddF64,dg_rounding_mode,{arg2}_part_f,{arg3}_part_f)", fpsize, simdsize, llo)
   sub.barcode = createBarCode(sub, [2-llo,3-llo], [2-llo,3-llo], ["IRExpr_Const(IRConst_F64(1.))", "IRExpr_Const(IRConst_F64(-1.))"], f"IRExpr_Triop(Iop_SubF64,dg_rounding_mode,{arg2}_part_f,{arg3}_part_f)", fpsize, simdsize, llo)
-  mul.barcode = createBarCode(mul, [2-llo,3-llo], [2-llo, 3-llo], [f"{arg3}_part_f", f"{arg2}_part_f"], f"IRExpr_Triop(Iop_MulF64,dg_rounding_mode,{arg2}_part_f,{arg3}_part_f)", fpsize, simdsize, llo)
-  div.barcode = createBarCode(div, [2-llo,3-llo], [2-llo, 3-llo], [f"IRExpr_Triop(Iop_DivF64,dg_rounding_mode,IRExpr_Const(IRConst_F64(1.)),{arg3}_part_f)", f"IRExpr_Triop(Iop_DivF64,dg_rounding_mode,IRExpr_Triop(Iop_MulF64,dg_rounding_mode,IRExpr_Const(IRConst_F64(-1.)), {arg2}_part_f),IRExpr_Triop(Iop_MulF64,dg_rounding_mode,{arg3}_part_f,{arg3}_part_f))"],f"IRExpr_Triop(Iop_DivF64,dg_rounding_mode,{arg2}_part_f,{arg3}_part_f)", fpsize, simdsize, llo)
-  sqrt.barcode = createBarCode(sqrt, [2-sqrt_noroundingmode], [2-sqrt_noroundingmode], [f"IRExpr_Triop(Iop_DivF64,dg_rounding_mode,IRExpr_Const(IRConst_F64(0.5)), IRExpr_Binop(Iop_SqrtF64,dg_rounding_mode,{sqrt_arg2}_part_f))"], f"IRExpr_Binop(Iop_SqrtF64,dg_rounding_mode,{sqrt_arg2}_part_f)", fpsize, simdsize, llo)
+  mul.barcode = createBarCode(mul, [2-llo,3-llo], [2-llo, 3-llo], [f"{arg3}_part_f", f"{arg2}_part_f"], f"IRExpr_Triop(Iop_MulF64,dg_rounding_mode,{arg2}_part_f,{arg3}_part_f)", fpsize, simdsize, llo, "DG_OPCODE_MUL")
+  div.barcode = createBarCode(div, [2-llo,3-llo], [2-llo, 3-llo], [f"IRExpr_Triop(Iop_DivF64,dg_rounding_mode,IRExpr_Const(IRConst_F64(1.)),{arg3}_part_f)", f"IRExpr_Triop(Iop_DivF64,dg_rounding_mode,IRExpr_Triop(Iop_MulF64,dg_rounding_mode,IRExpr_Const(IRConst_F64(-1.)), {arg2}_part_f),IRExpr_Triop(Iop_MulF64,dg_rounding_mode,{arg3}_part_f,{arg3}_part_f))"],f"IRExpr_Triop(Iop_DivF64,dg_rounding_mode,{arg2}_part_f,{arg3}_part_f)", fpsize, simdsize, llo, "DG_OPCODE_DIV")
+  sqrt.barcode = createBarCode(sqrt, [2-sqrt_noroundingmode], [2-sqrt_noroundingmode], [f"IRExpr_Triop(Iop_DivF64,dg_rounding_mode,IRExpr_Const(IRConst_F64(0.5)), IRExpr_Binop(Iop_SqrtF64,dg_rounding_mode,{sqrt_arg2}_part_f))"], f"IRExpr_Binop(Iop_SqrtF64,dg_rounding_mode,{sqrt_arg2}_part_f)", fpsize, simdsize, llo, "DG_OPCODE_SQRT")
 
   add.trickcode = createTrickCode(add, [2-llo,3-llo], [2-llo,3-llo], False, fpsize, simdsize, llo)
   sub.trickcode = createTrickCode(sub, [2-llo,3-llo], [2-llo,3-llo], False, fpsize, simdsize, llo)
@@ -420,7 +447,7 @@ for Op in ["Add", "Sub"]:
     if fpsize==4:
       res = f"IRExpr_Binop(Iop_F64toF32,arg1,{res})"
     the_op.dotcode = dv(res)
-    the_op.barcode = createBarCode(the_op, [2,3,4], [2,3,4], ["arg3_part_f", "arg2_part_f", f"IRExpr_Const(IRConst_F64({'1.' if Op=='Add' else '-1.'}))"], the_op.apply("arg1", "arg2_part_f", "arg3_part_f", "arg4_part_f"), fpsize, simdsize,llo)
+    the_op.barcode = createBarCode(the_op, [2,3,4], [2,3,4], ["arg3_part_f", "arg2_part_f", f"IRExpr_Const(IRConst_F64({'1.' if Op=='Add' else '-1.'}))"], the_op.apply("arg1", "arg2_part_f", "arg3_part_f", "arg4_part_f"), fpsize, simdsize,llo, "DG_OPCODE_MUL")
     the_op.trickcode = createTrickCode(the_op, [2,3,4], [2,3,4], False, fpsize, simdsize,llo)
     IROp_Infos += [ the_op ]
 
@@ -431,11 +458,11 @@ scalef64.barcode = createBarCode(scalef64, [2], [], ["IRExpr_Triop(Iop_ScaleF64,
 scalef64.trickcode = createTrickCode(scalef64, [2], [2], False, 8, 1, False)
 yl2xf64 = IROp_Info("Iop_Yl2xF64", 3, [2,3],8,1,True)
 yl2xf64.dotcode = dv("IRExpr_Triop(Iop_AddF64,arg1,IRExpr_Triop(Iop_Yl2xF64,arg1,d2,arg3),IRExpr_Triop(Iop_DivF64,arg1,IRExpr_Triop(Iop_MulF64,arg1,arg2,d3),IRExpr_Triop(Iop_MulF64,arg1,IRExpr_Const(IRConst_F64(0.6931471805599453094172321214581)),arg3)))")
-yl2xf64.barcode = createBarCode(yl2xf64, [2,3], [], ["IRExpr_Triop(Iop_Yl2xF64,arg1,IRExpr_Const(IRConst_F64(1.)),arg3)",  "IRExpr_Triop(Iop_DivF64,arg1,arg2,IRExpr_Triop(Iop_MulF64,arg1,IRExpr_Const(IRConst_F64(0.6931471805599453094172321214581)), arg3))"], yl2xf64.apply(), 8, 1, False)
+yl2xf64.barcode = createBarCode(yl2xf64, [2,3], [], ["IRExpr_Triop(Iop_Yl2xF64,arg1,IRExpr_Const(IRConst_F64(1.)),arg3)",  "IRExpr_Triop(Iop_DivF64,arg1,arg2,IRExpr_Triop(Iop_MulF64,arg1,IRExpr_Const(IRConst_F64(0.6931471805599453094172321214581)), arg3))"], yl2xf64.apply(), 8, 1, False, "DG_OPCODE_UNKNOWN")
 yl2xf64.trickcode = createTrickCode(yl2xf64, [2,3], [2,3], False, 8, 1, False)
 yl2xp1f64 = IROp_Info("Iop_Yl2xp1F64", 3, [2,3],8,1,True)
 yl2xp1f64.dotcode = dv("IRExpr_Triop(Iop_AddF64,arg1,IRExpr_Triop(Iop_Yl2xp1F64,arg1,d2,arg3),IRExpr_Triop(Iop_DivF64,arg1,IRExpr_Triop(Iop_MulF64,arg1,arg2,d3),IRExpr_Triop(Iop_MulF64,arg1,IRExpr_Const(IRConst_F64(0.6931471805599453094172321214581)),IRExpr_Triop(Iop_AddF64, arg1, arg3, IRExpr_Const(IRConst_F64(1.))))))")
-yl2xp1f64.barcode = createBarCode(yl2xp1f64, [2,3], [], ["IRExpr_Triop(Iop_Yl2xp1F64,arg1,IRExpr_Const(IRConst_F64(1.)),arg3)",  "IRExpr_Triop(Iop_DivF64,arg1,arg2,IRExpr_Triop(Iop_MulF64,arg1,IRExpr_Const(IRConst_F64(0.6931471805599453094172321214581)),IRExpr_Triop(Iop_AddF64, arg1, arg3, IRExpr_Const(IRConst_F64(1.)))))"], yl2xp1f64.apply(), 8, 1, False)
+yl2xp1f64.barcode = createBarCode(yl2xp1f64, [2,3], [], ["IRExpr_Triop(Iop_Yl2xp1F64,arg1,IRExpr_Const(IRConst_F64(1.)),arg3)",  "IRExpr_Triop(Iop_DivF64,arg1,arg2,IRExpr_Triop(Iop_MulF64,arg1,IRExpr_Const(IRConst_F64(0.6931471805599453094172321214581)),IRExpr_Triop(Iop_AddF64, arg1, arg3, IRExpr_Const(IRConst_F64(1.)))))"], yl2xp1f64.apply(), 8, 1, False, "DG_OPCODE_UNKNOWN")
 yl2xp1f64.trickcode = createTrickCode(yl2xp1f64, [2,3], [2,3], False, 8, 1, False)
 IROp_Infos += [ scalef64, yl2xf64, yl2xp1f64 ]
 
@@ -446,8 +473,14 @@ for Op, op in [("And","and"), ("Or","or"), ("Xor","xor")]:
   for (simdsize,fpsize) in [(1,4),(1,8),(2,8),(4,8)]:
     size = simdsize*fpsize*8
     the_op = IROp_Info(f"Iop_{Op}{'V' if size>=128 else ''}{size}", 2, [1,2],fpsize,simdsize,False)
-    the_op.dotcode = applyComponentwisely({"arg1":"arg1_part","d1":"d1_part","arg2":"arg2_part","d2":"d2_part"}, {"dotvalue":"dotvalue_part"}, fpsize, simdsize, f'IRExpr* dotvalue_part = mkIRExprCCall(Ity_I64,0,"dg_dot_bitwise_{op}64", &dg_dot_bitwise_{op}64, mkIRExprVec_4(arg1_part, d1_part, arg2_part, d2_part));') 
-    the_op.barcode = applyComponentwisely({"arg1":"arg1_part","i1Lo":"i1Lo_part","i1Hi":"i1Hi_part","arg2":"arg2_part","i2Lo":"i2Lo_part","i2Hi":"i2Hi_part"}, {"indexLo":"indexLo_part","indexHi":"indexHi_part"}, fpsize, simdsize, f'IRDirty* di = unsafeIRDirty_0_N( 0, "dg_bar_bitwise_{op}64", &dg_bar_bitwise_{op}64, mkIRExprVec_6(arg1_part, i1Lo_part, i1Hi_part, arg2_part, i2Lo_part, i2Hi_part));  \n addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(di));\n IRTemp iLo = newIRTemp(diffenv->sb_out->tyenv, Ity_I64), iHi = newIRTemp(diffenv->sb_out->tyenv, Ity_I64);\n   IRDirty* diLo = unsafeIRDirty_1_N( iLo, 0, "dg_bar_bitwise_get_lower", &dg_bar_bitwise_get_lower, mkIRExprVec_0());\naddStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(diLo));  IRDirty* diHi = unsafeIRDirty_1_N( iHi, 0, "dg_bar_bitwise_get_higher", &dg_bar_bitwise_get_higher, mkIRExprVec_0());\naddStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(diHi));\n   IRExpr* indexLo_part = IRExpr_RdTmp(iLo);\n IRExpr* indexHi_part = IRExpr_RdTmp(iHi); ') 
+    # masks known at translation time are handled inline, otherwise call the runtime handlers;
+    # if the mask was read from client memory and has been modified since, call the runtime handlers
+    the_op.dotcode = f"IRExpr* unchanged = NULL;\nIRExpr* dotvalue = dg_dot_bitwise_constant_mask(diffenv, '{op[0]}', {fpsize}, arg1, d1, arg2, d2, &unchanged);\nif(!dotvalue || unchanged){{\n"
+    the_op.dotcode += applyComponentwisely({"arg1":"arg1_part","d1":"d1_part","arg2":"arg2_part","d2":"d2_part"}, {"dotvalue_helper":"dotvalue_part"}, fpsize, simdsize, f'IRExpr* dotvalue_part;\nif(unchanged){{\n IRTemp t = newIRTemp(diffenv->sb_out->tyenv, Ity_I64);\n IRDirty* di = unsafeIRDirty_1_N(t, 0, "dg_dot_bitwise_{op}64", &dg_dot_bitwise_{op}64, mkIRExprVec_4(arg1_part, d1_part, arg2_part, d2_part));\n di->guard = IRExpr_Unop(Iop_Not1,unchanged);\n addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(di));\n dotvalue_part = IRExpr_RdTmp(t);\n}} else {{\n dotvalue_part = mkIRExprCCall(Ity_I64,0,"dg_dot_bitwise_{op}64", &dg_dot_bitwise_{op}64, mkIRExprVec_4(arg1_part, d1_part, arg2_part, d2_part));\n}}') 
+    the_op.dotcode += "dotvalue = dotvalue ? IRExpr_ITE(unchanged,dotvalue,dotvalue_helper) : dotvalue_helper;\n}\n"
+    the_op.barcode = f"IRExpr* unchanged = NULL;\nIRExpr** indexHiLo = dg_bar_bitwise_constant_mask(diffenv, '{op[0]}', {fpsize}, arg1, i1Lo, i1Hi, arg2, i2Lo, i2Hi, &unchanged);\nIRExpr *indexLo, *indexHi;\nif(indexHiLo && !unchanged){{\n  indexLo = indexHiLo[0];\n  indexHi = indexHiLo[1];\n}} else {{\n"
+    the_op.barcode += applyComponentwisely({"arg1":"arg1_part","i1Lo":"i1Lo_part","i1Hi":"i1Hi_part","arg2":"arg2_part","i2Lo":"i2Lo_part","i2Hi":"i2Hi_part"}, {"indexLo_helper":"indexLo_part","indexHi_helper":"indexHi_part"}, fpsize, simdsize, f'IRDirty* di = unsafeIRDirty_0_N( 0, "dg_bar_bitwise_{op}64", &dg_bar_bitwise_{op}64, mkIRExprVec_6(arg1_part, i1Lo_part, i1Hi_part, arg2_part, i2Lo_part, i2Hi_part));  \n IRTemp iLo = newIRTemp(diffenv->sb_out->tyenv, Ity_I64), iHi = newIRTemp(diffenv->sb_out->tyenv, Ity_I64);\n   IRDirty* diLo = unsafeIRDirty_1_N( iLo, 0, "dg_bar_bitwise_get_lower", &dg_bar_bitwise_get_lower, mkIRExprVec_0());\n  IRDirty* diHi = unsafeIRDirty_1_N( iHi, 0, "dg_bar_bitwise_get_higher", &dg_bar_bitwise_get_higher, mkIRExprVec_0());\n if(unchanged){{\n  di->guard = IRExpr_Unop(Iop_Not1,unchanged);\n  diLo->guard = IRExpr_Unop(Iop_Not1,unchanged);\n  diHi->guard = IRExpr_Unop(Iop_Not1,unchanged);\n }}\n addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(di));\n addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(diLo));\n addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(diHi));\n   IRExpr* indexLo_part = IRExpr_RdTmp(iLo);\n IRExpr* indexHi_part = IRExpr_RdTmp(iHi); ') 
+    the_op.barcode += "indexLo = indexHiLo ? IRExpr_ITE(unchanged,indexHiLo[0],indexLo_helper) : indexLo_helper;\nindexHi = indexHiLo ? IRExpr_ITE(unchanged,indexHiLo[1],indexHi_helper) : indexHi_helper;\n}\n"
     the_op.trickcode = applyComponentwisely({"arg1":"arg1_part","f1Lo":"f1Lo_part","f1Hi":"f1Hi_part","arg2":"arg2_part","f2Lo":"f2Lo_part","f2Hi":"f2Hi_part"}, {"flagsLo":"flagsLo_part","flagsHi":"flagsHi_part"}, fpsize, simdsize, f'IRDirty* di = unsafeIRDirty_0_N( 0, "dg_trick_bitwise_{op}64", &dg_trick_bitwise_{op}64, mkIRExprVec_6(arg1_part, f1Lo_part, f1Hi_part, arg2_part, f2Lo_part, f2Hi_part));  \n addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(di));\n IRTemp fLo = newIRTemp(diffenv->sb_out->tyenv, Ity_I64), fHi = newIRTemp(diffenv->sb_out->tyenv, Ity_I64);\n   IRDirty* diLo = unsafeIRDirty_1_N( fLo, 0, "dg_trick_bitwise_get_lower", &dg_trick_bitwise_get_lower, mkIRExprVec_0());\naddStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(diLo));  IRDirty* diHi = unsafeIRDirty_1_N( fHi, 0, "dg_trick_bitwise_get_higher", &dg_trick_bitwise_get_higher, mkIRExprVec_0());\naddStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(diHi));\n   IRExpr* flagsLo_part = IRExpr_RdTmp(fLo);\n IRExpr* flagsHi_part = IRExpr_RdTmp(fHi); ') 
     the_op.disable_print_results = True # because many are not floating-point operations
     IROp_Infos += [ the_op ]
@@ -68,9 +68,10 @@ import re
 # Generate dg_replace_math.c.
 
 class DERIVGRIND_MATH_FUNCTION_BASE:
-  def __init__(self,name,type_):
+  def __init__(self,name,type_,opcode):
     self.name = name
     self.type = type_
+    self.opcode = opcode # Dg_Opcode recorded with --record-values=yes
     if self.type=="double":
       self.size = 8
       self.T = "D"
@@ -87,8 +88,8 @@ class DERIVGRIND_MATH_FUNCTION_BASE:
 class DERIVGRIND_MATH_FUNCTION(DERIVGRIND_MATH_FUNCTION_BASE):
   """Wrap a math.h function (fp type)->fp type to also handle
     the derivative information."""
-  def __init__(self,name,deriv,type_):
-    super().__init__(name,type_)
+  def __init__(self,name,deriv,type_,opcode="DG_OPCODE_LINEAR"):
+    super().__init__(name,type_,opcode)
     self.deriv = deriv
   def c_code(self):
     return \
@@ -115,7 +116,7 @@ __attribute__((optimize("O0")))
       x_pdiff = ({self.deriv});
       unsigned long long ret_i;
       DG_DISABLE(0,1);
-      DG_NEW_INDEX(&x_i,&y_i,&x_pdiff,&y_pdiff,&ret_i,&ret_d);
+      DG_NEW_INDEX_OPCODE(&x_i,&y_i,&x_pdiff,&y_pdiff,&ret_i,&ret_d,{self.opcode});
       DG_SET_INDEX(&ret,&ret_i);
     }} else if(DG_GET_MODE=='t') {{ /* bit-trick-finding mode */
       DG_DISABLE(0,1);
@@ -136,8 +137,8 @@ __attribute__((optimize("O0")))
 class DERIVGRIND_MATH_FUNCTION2(DERIVGRIND_MATH_FUNCTION_BASE):
   """Wrap a math.h function (fp type,fp type)->fp type to also handle
     the derivative information."""
-  def __init__(self,name,derivX,derivY,type_):
-    super().__init__(name,type_)
+  def __init__(self,name,derivX,derivY,type_,opcode="DG_OPCODE_LINEAR"):
+    super().__init__(name,type_,opcode)
     self.derivX = derivX
     self.derivY = derivY
   def c_code(self):
@@ -168,7 +169,7 @@ __attribute__((optimize("O0")))
       y_pdiff = ({self.derivY});
       unsigned long long ret_i;
       DG_DISABLE(0,1);
-      DG_NEW_INDEX(&x_i,&y_i,&x_pdiff,&y_pdiff,&ret_i,&ret_d);
+      DG_NEW_INDEX_OPCODE(&x_i,&y_i,&x_pdiff,&y_pdiff,&ret_i,&ret_d,{self.opcode});
       DG_SET_INDEX(&ret,&ret_i);
     }} else if(DG_GET_MODE=='t') {{ /* bit-trick-finding mode */
       DG_DISABLE(0,1);
@@ -192,8 +193,8 @@ __attribute__((optimize("O0")))
 class DERIVGRIND_MATH_FUNCTION2x(DERIVGRIND_MATH_FUNCTION_BASE):
   """Wrap a math.h function (fp type,extra type)->fp type to also handle
     the derivative information."""
-  def __init__(self,name,deriv,type_, extratype, extratypeletter):
-    super().__init__(name,type_)
+  def __init__(self,name,deriv,type_, extratype, extratypeletter,opcode="DG_OPCODE_LINEAR"):
+    super().__init__(name,type_,opcode)
     self.deriv = deriv
     self.extratype = extratype
     self.extratypeletter = extratypeletter # 'p' for pointer, 'i' for integer
@@ -222,7 +223,7 @@ __attribute__((optimize("O0")))
       x_pdiff = ({self.deriv});
       unsigned long long ret_i;
       DG_DISABLE(0,1);
-      DG_NEW_INDEX(&x_i,&y_i,&x_pdiff,&y_pdiff,&ret_i,&ret_d);
+      DG_NEW_INDEX_OPCODE(&x_i,&y_i,&x_pdiff,&y_pdiff,&ret_i,&ret_d,{self.opcode});
       DG_SET_INDEX(&ret,&ret_i);
     }} else if(DG_GET_MODE=='t') {{ /* bit-trick-finding mode */
       DG_DISABLE(0,1);
@@ -243,74 +244,74 @@ __attribute__((optimize("O0")))
 functions = [
 
   # missing: modf
-  DERIVGRIND_MATH_FUNCTION("acos","-1./sqrt(1.-x*x)","double"),
-  DERIVGRIND_MATH_FUNCTION("asin","1./sqrt(1.-x*x)","double"),
-  DERIVGRIND_MATH_FUNCTION("atan","1./(1.+x*x)","double"),
+  DERIVGRIND_MATH_FUNCTION("acos","-1./sqrt(1.-x*x)","double","DG_OPCODE_ACOS"),
+  DERIVGRIND_MATH_FUNCTION("asin","1./sqrt(1.-x*x)","double","DG_OPCODE_ASIN"),
+  DERIVGRIND_MATH_FUNCTION("atan","1./(1.+x*x)","double","DG_OPCODE_ATAN"),
   DERIVGRIND_MATH_FUNCTION("ceil","0.","double"),
-  DERIVGRIND_MATH_FUNCTION("cos", "-sin(x)","double"),
-  DERIVGRIND_MATH_FUNCTION("cosh", "sinh(x)","double"),
-  DERIVGRIND_MATH_FUNCTION("exp", "exp(x)","double"),
+  DERIVGRIND_MATH_FUNCTION("cos", "-sin(x)","double","DG_OPCODE_COS"),
+  DERIVGRIND_MATH_FUNCTION("cosh", "sinh(x)","double","DG_OPCODE_COSH"),
+  DERIVGRIND_MATH_FUNCTION("exp", "exp(x)","double","DG_OPCODE_EXP"),
   DERIVGRIND_MATH_FUNCTION("fabs", "(x>0.?1.:-1.)","double"),
   DERIVGRIND_MATH_FUNCTION("floor", "0.","double"),
-  DERIVGRIND_MATH_FUNCTION("log","1./x","double"),
-  DERIVGRIND_MATH_FUNCTION("log10", "1./(log(10.)*x)","double"),
-  DERIVGRIND_MATH_FUNCTION("sin", "cos(x)","double"),
-  DERIVGRIND_MATH_FUNCTION("sinh", "cosh(x)","double"),
-  DERIVGRIND_MATH_FUNCTION("sqrt", "1./(2.*sqrt(x))","double"),
-  DERIVGRIND_MATH_FUNCTION("tan", "1./(cos(x)*cos(x))","double"),
-  DERIVGRIND_MATH_FUNCTION("tanh", "1.-tanh(x)*tanh(x)","double"),
-  DERIVGRIND_MATH_FUNCTION2("atan2","-y/(x*x+y*y)","x/(x*x+y*y)","double"),
+  DERIVGRIND_MATH_FUNCTION("log","1./x","double","DG_OPCODE_LOG"),
+  DERIVGRIND_MATH_FUNCTION("log10", "1./(log(10.)*x)","double","DG_OPCODE_LOG10"),
+  DERIVGRIND_MATH_FUNCTION("sin", "cos(x)","double","DG_OPCODE_SIN"),
+  DERIVGRIND_MATH_FUNCTION("sinh", "cosh(x)","double","DG_OPCODE_SINH"),
+  DERIVGRIND_MATH_FUNCTION("sqrt", "1./(2.*sqrt(x))","double","DG_OPCODE_SQRT"),
+  DERIVGRIND_MATH_FUNCTION("tan", "1./(cos(x)*cos(x))","double","DG_OPCODE_TAN"),
+  DERIVGRIND_MATH_FUNCTION("tanh", "1.-tanh(x)*tanh(x)","double","DG_OPCODE_TANH"),
+  DERIVGRIND_MATH_FUNCTION2("atan2","-y/(x*x+y*y)","x/(x*x+y*y)","double","DG_OPCODE_UNKNOWN"),
   DERIVGRIND_MATH_FUNCTION2("fmod", "1.", "- floor(fabs(x/y)) * (x>0.?1.:-1.) * (y>0.?1.:-1.)","double"),
-  DERIVGRIND_MATH_FUNCTION2("pow"," (y==0.||y==-0.)?0.:(y*pow(x,y-1))", "(x<=0.) ? 0. : (pow(x,y)*log(x))","double"), 
+  DERIVGRIND_MATH_FUNCTION2("pow"," (y==0.||y==-0.)?0.:(y*pow(x,y-1))", "(x<=0.) ? 0. : (pow(x,y)*log(x))","double","DG_OPCODE_UNKNOWN"),
   DERIVGRIND_MATH_FUNCTION2x("frexp","ldexp(1.,-*e)","double","int*","p"),
   DERIVGRIND_MATH_FUNCTION2x("ldexp","ldexp(1.,e)","double","int","i"),
   DERIVGRIND_MATH_FUNCTION2("copysign", "((x>=0.)^(y>=0.)?-1.:1.)", "0.", "double"),
 
 
 
-  DERIVGRIND_MATH_FUNCTION("acosf","-1.f/sqrtf(1.f-x*x)","float"),
-  DERIVGRIND_MATH_FUNCTION("asinf","1.f/sqrtf(1.f-x*x)","float"),
-  DERIVGRIND_MATH_FUNCTION("atanf","1.f/(1.f+x*x)","float"),
+  DERIVGRIND_MATH_FUNCTION("acosf","-1.f/sqrtf(1.f-x*x)","float","DG_OPCODE_ACOS"),
+  DERIVGRIND_MATH_FUNCTION("asinf","1.f/sqrtf(1.f-x*x)","float","DG_OPCODE_ASIN"),
+  DERIVGRIND_MATH_FUNCTION("atanf","1.f/(1.f+x*x)","float","DG_OPCODE_ATAN"),
   DERIVGRIND_MATH_FUNCTION("ceilf","0.f","float"),
-  DERIVGRIND_MATH_FUNCTION("cosf", "-sinf(x)","float"),
-  DERIVGRIND_MATH_FUNCTION("coshf", "sinhf(x)","float"),
-  DERIVGRIND_MATH_FUNCTION("expf", "expf(x)","float"),
+  DERIVGRIND_MATH_FUNCTION("cosf", "-sinf(x)","float","DG_OPCODE_COS"),
+  DERIVGRIND_MATH_FUNCTION("coshf", "sinhf(x)","float","DG_OPCODE_COSH"),
+  DERIVGRIND_MATH_FUNCTION("expf", "expf(x)","float","DG_OPCODE_EXP"),
   DERIVGRIND_MATH_FUNCTION("fabsf", "(x>0.f?1.f:-1.f)","float"),
   DERIVGRIND_MATH_FUNCTION("floorf", "0.f","float"),
-  DERIVGRIND_MATH_FUNCTION("logf","1.f/x","float"),
-  DERIVGRIND_MATH_FUNCTION("log10f", "1.f/(logf(10.f)*x)","float"),
-  DERIVGRIND_MATH_FUNCTION("sinf", "cosf(x)","float"),
-  DERIVGRIND_MATH_FUNCTION("sinhf", "coshf(x)","float"),
-  DERIVGRIND_MATH_FUNCTION("sqrtf", "1.f/(2.f*sqrtf(x))","float"),
-  DERIVGRIND_MATH_FUNCTION("tanf", "1.f/(cosf(x)*cosf(x))","float"),
-  DERIVGRIND_MATH_FUNCTION("tanhf", "1.f-tanhf(x)*tanhf(x)","float"),
-  DERIVGRIND_MATH_FUNCTION2("atan2f","-y/(x*x+y*y)","x/(x*x+y*y)","float"),
+  DERIVGRIND_MATH_FUNCTION("logf","1.f/x","float","DG_OPCODE_LOG"),
+  DERIVGRIND_MATH_FUNCTION("log10f", "1.f/(logf(10.f)*x)","float","DG_OPCODE_LOG10"),
+  DERIVGRIND_MATH_FUNCTION("sinf", "cosf(x)","float","DG_OPCODE_SIN"),
+  DERIVGRIND_MATH_FUNCTION("sinhf", "coshf(x)","float","DG_OPCODE_SINH"),
+  DERIVGRIND_MATH_FUNCTION("sqrtf", "1.f/(2.f*sqrtf(x))","float","DG_OPCODE_SQRT"),
+  DERIVGRIND_MATH_FUNCTION("tanf", "1.f/(cosf(x)*cosf(x))","float","DG_OPCODE_TAN"),
+  DERIVGRIND_MATH_FUNCTION("tanhf", "1.f-tanhf(x)*tanhf(x)","float","DG_OPCODE_TANH"),
+  DERIVGRIND_MATH_FUNCTION2("atan2f","-y/(x*x+y*y)","x/(x*x+y*y)","float","DG_OPCODE_UNKNOWN"),
   DERIVGRIND_MATH_FUNCTION2("fmodf", "1.f", "- floorf(fabsf(x/y)) * (x>0.f?1.f:-1.f) * (y>0.f?1.f:-1.f)","float"),
-  DERIVGRIND_MATH_FUNCTION2("powf"," (y==0.f||y==-0.f)?0.f:(y*powf(x,y-1))", "(x<=0.f) ? 0.f : (powf(x,y)*logf(x))","float"), 
+  DERIVGRIND_MATH_FUNCTION2("powf"," (y==0.f||y==-0.f)?0.f:(y*powf(x,y-1))", "(x<=0.f) ? 0.f : (powf(x,y)*logf(x))","float","DG_OPCODE_UNKNOWN"),
   DERIVGRIND_MATH_FUNCTION2x("frexpf","ldexpf(1.f,-*e)","float","int*","p"),
   DERIVGRIND_MATH_FUNCTION2x("ldexpf","ldexpf(1.f,e)","float","int","i"),
   DERIVGRIND_MATH_FUNCTION2("copysignf", "((x>=0.f)^(y>=0.f)?-1.f:1.f)", "0.f", "float"),
 
 
-  DERIVGRIND_MATH_FUNCTION("acosl","-1.l/sqrtl(1.l-x*x)","long double"),
-  DERIVGRIND_MATH_FUNCTION("asinl","1.l/sqrtl(1.l-x*x)","long double"),
-  DERIVGRIND_MATH_FUNCTION("atanl","1.l/(1.l+x*x)","long double"),
+  DERIVGRIND_MATH_FUNCTION("acosl","-1.l/sqrtl(1.l-x*x)","long double","DG_OPCODE_ACOS"),
+  DERIVGRIND_MATH_FUNCTION("asinl","1.l/sqrtl(1.l-x*x)","long double","DG_OPCODE_ASIN"),
+  DERIVGRIND_MATH_FUNCTION("atanl","1.l/(1.l+x*x)","long double","DG_OPCODE_ATAN"),
   DERIVGRIND_MATH_FUNCTION("ceill","0.l","long double"),
-  DERIVGRIND_MATH_FUNCTION("cosl", "-sinl(x)","long double"),
-  DERIVGRIND_MATH_FUNCTION("coshl", "sinhl(x)","long double"),
-  DERIVGRIND_MATH_FUNCTION("expl", "expl(x)","long double"),
+  DERIVGRIND_MATH_FUNCTION("cosl", "-sinl(x)","long double","DG_OPCODE_COS"),
+  DERIVGRIND_MATH_FUNCTION("coshl", "sinhl(x)","long double","DG_OPCODE_COSH"),
+  DERIVGRIND_MATH_FUNCTION("expl", "expl(x)","long double","DG_OPCODE_EXP"),
   DERIVGRIND_MATH_FUNCTION("fabsl", "(x>0.l?1.l:-1.l)","long double"),
   DERIVGRIND_MATH_FUNCTION("floorl", "0.l","long double"),
-  DERIVGRIND_MATH_FUNCTION("logl","1.l/x","long double"),
-  DERIVGRIND_MATH_FUNCTION("log10l", "1.l/(logl(10.l)*x)","long double"),
-  DERIVGRIND_MATH_FUNCTION("sinl", "cosl(x)","long double"),
-  DERIVGRIND_MATH_FUNCTION("sinhl", "coshl(x)","long double"),
-  DERIVGRIND_MATH_FUNCTION("sqrtl", "1.l/(2.l*sqrtl(x))","long double"),
-  DERIVGRIND_MATH_FUNCTION("tanl", "1.l/(cosl(x)*cosl(x))","long double"),
-  DERIVGRIND_MATH_FUNCTION("tanhl", "1.l-tanhl(x)*tanhl(x)","long double"),
-  DERIVGRIND_MATH_FUNCTION2("atan2l","-y/(x*x+y*y)","x/(x*x+y*y)","long double"),
+  DERIVGRIND_MATH_FUNCTION("logl","1.l/x","long double","DG_OPCODE_LOG"),
+  DERIVGRIND_MATH_FUNCTION("log10l", "1.l/(logl(10.l)*x)","long double","DG_OPCODE_LOG10"),
+  DERIVGRIND_MATH_FUNCTION("sinl", "cosl(x)","long double","DG_OPCODE_SIN"),
+  DERIVGRIND_MATH_FUNCTION("sinhl", "coshl(x)","long double","DG_OPCODE_SINH"),
+  DERIVGRIND_MATH_FUNCTION("sqrtl", "1.l/(2.l*sqrtl(x))","long double","DG_OPCODE_SQRT"),
+  DERIVGRIND_MATH_FUNCTION("tanl", "1.l/(cosl(x)*cosl(x))","long double","DG_OPCODE_TAN"),
+  DERIVGRIND_MATH_FUNCTION("tanhl", "1.l-tanhl(x)*tanhl(x)","long double","DG_OPCODE_TANH"),
+  DERIVGRIND_MATH_FUNCTION2("atan2l","-y/(x*x+y*y)","x/(x*x+y*y)","long double","DG_OPCODE_UNKNOWN"),
   DERIVGRIND_MATH_FUNCTION2("fmodl", "1.l", "- floorl(fabsl(x/y)) * (x>0.l?1.l:-1.l) * (y>0.l?1.l:-1.l)","long double"),
-  DERIVGRIND_MATH_FUNCTION2("powl"," (y==0.l||y==-0.l)?0.l:(y*powl(x,y-1))", "(x<=0.l) ? 0.l : (powl(x,y)*logl(x))","long double"), 
+  DERIVGRIND_MATH_FUNCTION2("powl"," (y==0.l||y==-0.l)?0.l:(y*powl(x,y-1))", "(x<=0.l) ? 0.l : (powl(x,y)*logl(x))","long double","DG_OPCODE_UNKNOWN"),
   DERIVGRIND_MATH_FUNCTION2x("frexpl","ldexpl(1.l,-*e)","long double","int*","p"),
   DERIVGRIND_MATH_FUNCTION2x("ldexpl","ldexpl(1.l,e)","long double","int","i"),
   DERIVGRIND_MATH_FUNCTION2("copysignl", "((x>=0.l)^(y>=0.l)?-1.l:1.l)", "0.l", "long double"),
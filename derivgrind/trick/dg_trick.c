@@ -43,6 +43,14 @@
 #include "pub_tool_basics.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_tooliface.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_execontext.h"
+#include "pub_tool_debuginfo.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_machine.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_threadstate.h"
 
 #include "../dg_shadow.h"
 #include "../bar/dg_bar_shadow.h"
@@ -139,16 +147,75 @@ static void dg_trick_dirty_loadF80le(DiffEnv* diffenv, IRExpr* addr, IRTemp temp
   addStmtToIRSB(diffenv->sb_out, IRStmt_Dirty(ddHi));
 }
 
+/*! Bit-trick report, for one guest instruction address.
+ *
+ *  Like the error manager of Valgrind deduplicates errors, we print a
+ *  report with stack trace only when a bit-trick is found at the address for
+ *  the first time, and only count subsequent hits. The flag patterns of all
+ *  hits are aggregated. The summary is printed by dg_trick_finalize.
+ */
+typedef struct _DgTrickReport {
+  struct _DgTrickReport* next;
+  UWord addr; //!< Guest instruction address, key of the hash table.
+  ULong fLo; //!< Union of the activity bits of all hits.
+  ULong fHi; //!< Union of the discreteness bits of all hits.
+  ULong count; //!< Number of hits.
+  ExeContext* where; //!< Stack trace of the first hit.
+} DgTrickReport;
+
+static VgHashTable* dg_trick_reports;
+
 ULong dg_trick_warn_dirtyhelper( ULong fLo, ULong fHi, ULong size ){
   ULong mask = (size==4) ? 0x00000000fffffffful : 0xfffffffffffffffful;
-  if((dg_disable[VG_(get_running_tid)()]==0) && (fLo & fHi & mask)){
+  ThreadId tid = VG_(get_running_tid)();
+  if((dg_disable[tid]==0) && (fLo & fHi & mask)){
+    Addr addr = VG_(get_IP)(tid);
+    DgTrickReport* report = VG_(HT_lookup)(dg_trick_reports, addr);
+    if(report){ // already reported, only count
+      report->count++;
+      report->fLo |= fLo;
+      report->fHi |= fHi;
+      return 0;
+    }
+    report = VG_(malloc)("Bit-trick report", sizeof(DgTrickReport));
+    report->addr = addr;
+    report->fLo = fLo;
+    report->fHi = fHi;
+    report->count = 1;
+    report->where = VG_(record_ExeContext)(tid, 0);
+    VG_(HT_add_node)(dg_trick_reports, report);
     VG_(message)(Vg_UserMsg, "Active discrete data used as floating-point operand.\n");
     VG_(message)(Vg_UserMsg, "Activity bits: %llu. Discreteness bits: %llu.\n", fLo, fHi);
     VG_(message)(Vg_UserMsg, "At\n");
-    VG_(get_and_pp_StackTrace)(VG_(get_running_tid)(), 16);
+    VG_(pp_ExeContext)(report->where);
     VG_(message)(Vg_UserMsg, "\n");
     //VG_(gdbserver)(VG_(get_running_tid)());
   }
+  return 0;
+}
+
+static Int dg_trick_report_cmp_count(const void* a, const void* b){
+  ULong count_a = (*(DgTrickReport* const*)a)->count;
+  ULong count_b = (*(DgTrickReport* const*)b)->count;
+  return count_a>count_b ? -1 : (count_a<count_b ? 1 : 0);
+}
+
+/*! Print how often each bit-trick has been found, most frequent first.
+ */
+static void dg_trick_print_summary(void){
+  UInt n;
+  VgHashNode** reports = VG_(HT_to_array)(dg_trick_reports, &n);
+  if(n>0){
+    VG_(ssort)(reports, n, sizeof(VgHashNode*), dg_trick_report_cmp_count);
+    VG_(message)(Vg_UserMsg, "Bit-trick summary: %u distinct locations.\n", n);
+    VG_(message)(Vg_UserMsg, "      hits  activity bits      discreteness bits  location\n");
+    for(UInt i=0; i<n; i++){
+      DgTrickReport* report = (DgTrickReport*)reports[i];
+      VG_(message)(Vg_UserMsg, "%10llu  %016llx   %016llx   %s\n", report->count, report->fLo, report->fHi,
+        VG_(describe_IP)(VG_(get_ExeContext_epoch)(report->where), report->addr, NULL));
+    }
+  }
+  VG_(free)(reports);
 }
 
 static void dg_trick_warn4(DiffEnv* diffenv, IRExpr* flagsLo, IRExpr* flagsHi){
@@ -232,12 +299,19 @@ void dg_trick_handle_statement(DiffEnv* diffenv, IRStmt* st_orig){
   add_statement_modified(diffenv,dg_trick_expressionhandling,st_orig);
 }
 
+void dg_trick_handle_statement_passive(DiffEnv* diffenv, IRStmt* st_orig){
+  add_statement_passive(diffenv,dg_trick_expressionhandling,st_orig);
+}
+
 void dg_trick_initialize(void){
   dg_bar_shadow_mem_buffer = VG_(malloc)("dg_bar_shadow_mem_buffer",2*sizeof(V256));
   dg_bar_shadowInit();
+  dg_trick_reports = VG_(HT_construct)("Bit-trick reports");
 }
 
 void dg_trick_finalize(void){
+  dg_trick_print_summary();
+  VG_(HT_destruct)(dg_trick_reports, VG_(free));
   VG_(free)(dg_bar_shadow_mem_buffer);
   dg_bar_shadowFini();
 }
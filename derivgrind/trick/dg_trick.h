@@ -43,6 +43,13 @@
  */
 void dg_trick_handle_statement(DiffEnv* diffenv, IRStmt* st_orig);
 
+/*! Add passive bit-trick-finding instrumentation to output IRSB, for functions
+ *  excluded by --no-instrument.
+ *  \param[in,out] diffenv - General data.
+ *  \param[in] st_orig - Original statement.
+ */
+void dg_trick_handle_statement_passive(DiffEnv* diffenv, IRStmt* st_orig);
+
 /*! Initialize forward-mode data structures.
  */
 void dg_trick_initialize(void);
@@ -13,7 +13,10 @@ mkdir -p $exported_install/bin
 cp $original_install/bin/valgrind $exported_install/bin/derivgrind-valgrind
 cp $original_install/bin/derivgrind-config $exported_install/bin/derivgrind-config
 cp $original_install/bin/derivgrind $exported_install/bin/derivgrind
+cp $original_install/bin/derivgrind-launch $exported_install/bin/derivgrind-launch
 cp $original_install/bin/tape-evaluation $exported_install/bin/tape-evaluation
+cp $original_install/bin/tape-generate $exported_install/bin/tape-generate
+cp $original_install/bin/tape-jacobian $exported_install/bin/tape-jacobian
 
 mkdir -p $exported_install/libexec/valgrind
 for file in derivgrind-amd64-linux derivgrind-x86-linux vgpreload_core-amd64-linux.so vgpreload_core-x86-linux.so vgpreload_derivgrind-amd64-linux.so vgpreload_derivgrind-x86-linux.so; do
@@ -24,3 +27,10 @@ mkdir -p $exported_install/include/valgrind
 for file in valgrind.h derivgrind.h derivgrind-recording.h; do
   cp $original_install/include/valgrind/$file $exported_install/include/valgrind/$file
 done
+
+mkdir -p $exported_install/lib/valgrind
+for file in libderivgrind_mpiwrap-amd64-linux.so libderivgrind_mpiwrap-x86-linux.so; do
+  if test -f $original_install/lib/valgrind/$file; then
+    cp $original_install/lib/valgrind/$file $exported_install/lib/valgrind/$file
+  fi
+done
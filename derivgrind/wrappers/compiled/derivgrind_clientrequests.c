@@ -62,6 +62,18 @@ void dg_inputf(void** val){
 void dg_outputf(void** val){
   DG_OUTPUTF(*(unsigned long long*)*val);
 }
+void dg_inputf_array(void** val, int* count, int* size){
+  switch(*size){
+    case 4: DG_INPUT_ARRAY(*val,*count,float); break;
+    case 8: DG_INPUT_ARRAY(*val,*count,double); break;
+  }
+}
+void dg_outputf_array(void** val, int* count, int* size){
+  switch(*size){
+    case 4: DG_OUTPUT_ARRAY(*val,*count,float); break;
+    case 8: DG_OUTPUT_ARRAY(*val,*count,double); break;
+  }
+}
 void dg_mark_float(void** val, int* size){
   switch(*size){
     case 4: DG_MARK_FLOAT(*(float*)*val); break;
@@ -88,6 +88,24 @@ module derivgrind_clientrequests
       type(c_ptr)  :: val
     end subroutine dg_outputf
   end interface
+  interface
+    subroutine dg_inputf_array(val, count_, size_) bind(C)
+      use, intrinsic :: iso_c_binding
+      implicit none
+      type(c_ptr)  :: val
+      integer(kind=c_int), intent(in) :: count_
+      integer(kind=c_int), intent(in) :: size_
+    end subroutine dg_inputf_array
+  end interface
+  interface
+    subroutine dg_outputf_array(val, count_, size_) bind(C)
+      use, intrinsic :: iso_c_binding
+      implicit none
+      type(c_ptr)  :: val
+      integer(kind=c_int), intent(in) :: count_
+      integer(kind=c_int), intent(in) :: size_
+    end subroutine dg_outputf_array
+  end interface
   interface
     subroutine dg_mark_float(val, size_) bind(C)
       use, intrinsic :: iso_c_binding
@@ -59,12 +59,23 @@
  * itself does not run under Derivgrind. 
  *
  * Usage:
- * derivgrind-library-caller library.so functionname fptype nParam nInput nOutput path
+ * derivgrind-library-caller library.so functionname fptype nParam nInput nOutput path [batch]
  *
  * This calls the symbol `functionname` from library.so, providing nParam
  * bytes of non-differentiable parameters, nInput differentiable input scalars of
  * type fptype, and nOutput differentiable output scalars if type fptype.
  *
+ * If batch is given, the function is called batch times with the same
+ * parameters, one after another. Then dg-libcaller-inputs contains batch
+ * consecutive input vectors, and dg-libcaller-outputs receives batch
+ * consecutive output vectors. The inputs and outputs of all calls are
+ * registered in this order, so in dg-input-indices and dg-output-indices,
+ * the k-th call owns the lines k*nInput to (k+1)*nInput-1 and
+ * k*nOutput to (k+1)*nOutput-1, respectively. As the calls do not depend on
+ * each other, a single tape evaluation yields the gradients of all calls.
+ * This saves the startup and translation costs of Valgrind for all but the
+ * first call of a mini-batch.
+ *
  * The signature of the external function must be 
  *     void functionname(int, char*, int, fptype const*, int, fptype*)
  * The three pairs of an integer and a pointer specify the size/count of
@@ -94,11 +105,12 @@ int main_fp(int argc, char* argv[]){
   }
 
   // sizes of non-differentiable parameters, differentiable inputs, differentiable outputs
-  long long param_size, input_count, output_count;
+  long long param_size, input_count, output_count, batch = 1;
   try { // parse from command-line arguments
     param_size = std::stoll(argv[4]);
     input_count = std::stoll(argv[5]);
     output_count = std::stoll(argv[6]);
+    if(argc>8) batch = std::stoll(argv[8]);
   } catch (std::invalid_argument const& ex) {
     std::cerr << "Invalid argument:\n" << ex.what() << std::endl;
     exit(EXIT_FAILURE);
@@ -107,6 +119,11 @@ int main_fp(int argc, char* argv[]){
     exit(EXIT_FAILURE);
   }
 
+  if(batch<1){
+    std::cerr << "Invalid batch size " << batch << "." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
   // buffers for non-diff parameters, diff inputs, diff outputs
   char* param_buf;
   fptype *input_buf, *output_buf;
@@ -117,30 +134,28 @@ int main_fp(int argc, char* argv[]){
   std::ifstream input_file(path+"/dg-libcaller-inputs", std::ios::binary);
 
   param_buf = new char[param_size+1]; // +1 to avoid allocations of length zero
-  input_buf = new fptype[input_count+1];
-  output_buf = new fptype[output_count+1];
+  input_buf = new fptype[batch*input_count+1];
+  output_buf = new fptype[batch*output_count+1];
   if(!param_buf || !input_buf || !output_buf){
     std::cerr << "Failure to allocate buffers." << std::endl;
     exit(EXIT_FAILURE);
   }
 
   param_file.read((char*)param_buf, param_size);
-  input_file.read((char*)input_buf, input_count*sizeof(fptype));
+  input_file.read((char*)input_buf, batch*input_count*sizeof(fptype));
 
   // register inputs
-  for(unsigned long long i=0; i<input_count; i++){
-    DG_INPUTF(input_buf[i]);
+  DG_INPUT_ARRAY(input_buf, batch*input_count, fptype);
+  // call the function for every input vector
+  for(long long k=0; k<batch; k++){
+    loaded_fun(param_size, param_buf, input_count, input_buf+k*input_count, output_count, output_buf+k*output_count);
   }
-  // call the function
-  loaded_fun(param_size, param_buf, input_count, input_buf, output_count, output_buf);
   // register outputs
-  for(unsigned long long i=0; i<output_count; i++){
-    DG_OUTPUTF(output_buf[i]);
-  }
+  DG_OUTPUT_ARRAY(output_buf, batch*output_count, fptype);
 
   // write binary output
   std::ofstream output_file(path+"/dg-libcaller-outputs", std::ios::binary);
-  output_file.write((char*)output_buf, sizeof(fptype)*output_count);
+  output_file.write((char*)output_buf, sizeof(fptype)*batch*output_count);
 
   return 0;
 }
@@ -0,0 +1,815 @@
+/*--------------------------------------------------------------------*/
+/*--- MPI wrappers.                           derivgrind_mpiwrap.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   ----------------------------------------------------------------
+   Notice that the following MIT license applies to this one file
+   only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+
+   This file is part of Derivgrind, an automatic differentiation
+   tool applicable to compiled programs.
+
+   Copyright (C) 2022, Chair for Scientific Computing, TU Kaiserslautern
+   Copyright (C) since 2023, Chair for Scientific Computing, University of Kaiserslautern-Landau
+   Homepage: https://www.scicomp.uni-kl.de
+   Contact: Prof. Nicolas R. Gauger (derivgrind@projects.rptu.de)
+
+   Lead developer: Max Aehle
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   ----------------------------------------------------------------
+   Notice that the above MIT license applies to this one file
+   only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+   ----------------------------------------------------------------
+*/
+
+/* Wrappers for point-to-point communication and MPI_Allreduce, 
+ * transferring the dot values (forward mode) or linking the tapes of 
+ * different ranks (recording mode) along with MPI_DOUBLE and MPI_FLOAT data.
+ *
+ * Like $(top_srcdir)/mpi/libmpiwrap.c, this library uses Valgrind's 
+ * function wrapping mechanism and has to be LD_PRELOADed into the MPI 
+ * program; derivgrind-launch does this.
+ *
+ * Data received via MPI is written by the MPI library or by the kernel, so
+ * its shadow is meaningless. Therefore, the sender sends a second message
+ * with the dot values or indices right after the data, with the same tag
+ * but on a shadow communicator, which duplicates the communicator of the
+ * data. As MPI messages on a communicator do not overtake each other, the 
+ * receiver receives the shadow messages in the order of the data. Receives
+ * of the program, e.g. with MPI_ANY_TAG or by routines that are not 
+ * wrapped, can never match a shadow message.
+ *
+ * Blocking sends and receives (MPI_Send and its variants, MPI_Recv, 
+ * MPI_Sendrecv and MPI_Sendrecv_replace) transfer the shadow message 
+ * right away. Non-blocking sends and receives (MPI_Isend and its variants,
+ * MPI_Irecv) start the shadow message non-blockingly as well, and the 
+ * wrappers of MPI_Wait, MPI_Test and their variants finish it. 
+ * Communication that would transfer differentiated data without its 
+ * shadow message aborts the program instead of silently desynchronising 
+ * the shadow messages: MPI_Irecv from MPI_ANY_SOURCE, persistent 
+ * requests, matched receives (MPI_Mrecv, MPI_Imrecv), and freeing or 
+ * cancelling a pending request.
+ *
+ * The shadow communicator is cached as an attribute of the communicator.
+ * As duplication is collective, it is created by the wrappers of MPI_Init,
+ * MPI_Init_thread, MPI_Comm_dup and MPI_Comm_split, which all members of 
+ * the communicator call together. Point-to-point communication on other 
+ * communicators is not differentiated, and the received data is passive.
+ *
+ * In recording mode, each rank records its own tape in its own index 
+ * namespace (--index-namespace). For every received element, the receiver
+ * records a block whose operand is the index of the sent element on the
+ * sender's tape. Allreduce with MPI_SUM gathers the indices of all ranks
+ * and records the sum. "tape-evaluation path --merge-ranks" merges the
+ * tapes of all ranks into a single tape, so that a reverse sweep over
+ * the merged tape propagates adjoints across ranks.
+ *
+ * Other collective routines, datatypes and reduction operations are
+ * not differentiated. Collectives never match point-to-point messages, 
+ * so they do not disturb the shadow messages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "mpi.h"
+#include "valgrind.h"
+#include "derivgrind.h"
+
+/* Match "libmpi*.so*", like libmpiwrap.c. */
+#define WRAPPER_FOR(name) I_WRAP_SONAME_FNNAME_ZU(libmpiZaZdsoZa,name)
+
+/* Non-zero while a wrapper performs communication by itself,
+ * which must not be wrapped again. */
+static __thread int dg_mpi_nested = 0;
+
+/* Attribute key of the shadow communicator. */
+static int dg_mpi_keyval = MPI_KEYVAL_INVALID;
+
+/* Free the shadow communicator along with the communicator. */
+static int dg_mpi_free_shadow_comm(MPI_Comm comm, int keyval, void* attr, void* extra){
+  MPI_Comm* shadowcomm = (MPI_Comm*)attr;
+  PMPI_Comm_free(shadowcomm);
+  free(shadowcomm);
+  return MPI_SUCCESS;
+}
+
+/* Create the shadow communicator of comm. Collective over comm. */
+static void dg_mpi_create_shadow_comm(MPI_Comm comm){
+  char mode = DG_GET_MODE;
+  if(comm==MPI_COMM_NULL || (mode!='d' && mode!='b')) return;
+  if(dg_mpi_keyval==MPI_KEYVAL_INVALID){
+    PMPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, dg_mpi_free_shadow_comm, &dg_mpi_keyval, NULL);
+  }
+  MPI_Comm* shadowcomm = malloc(sizeof(MPI_Comm));
+  dg_mpi_nested++;
+  int err = PMPI_Comm_dup(comm, shadowcomm);
+  dg_mpi_nested--;
+  if(err==MPI_SUCCESS){
+    PMPI_Comm_set_attr(comm, dg_mpi_keyval, shadowcomm);
+  } else {
+    free(shadowcomm);
+  }
+}
+
+/* Shadow communicator of comm, or MPI_COMM_NULL if there is none. */
+static MPI_Comm dg_mpi_shadow_comm(MPI_Comm comm){
+  MPI_Comm* shadowcomm;
+  int flag = 0;
+  if(dg_mpi_keyval!=MPI_KEYVAL_INVALID){
+    PMPI_Comm_get_attr(comm, dg_mpi_keyval, &shadowcomm, &flag);
+  }
+  return flag ? *shadowcomm : MPI_COMM_NULL;
+}
+
+/* Size of a floating-point element of the datatype, or 0 if the 
+ * datatype is not differentiated. */
+static int dg_mpi_elemsize(MPI_Datatype datatype){
+  if(datatype==MPI_DOUBLE) return 8;
+  if(datatype==MPI_FLOAT) return 4;
+  return 0;
+}
+
+/* Whether communication of the datatype should be differentiated. */
+static int dg_mpi_active(MPI_Datatype datatype){
+  char mode = DG_GET_MODE;
+  return !dg_mpi_nested && (mode=='d' || mode=='b') && dg_mpi_elemsize(datatype)!=0;
+}
+
+/* Size in bytes of the shadow of a single element. */
+static int dg_mpi_shadowsize(int elemsize){
+  return DG_GET_MODE=='d' ? elemsize : sizeof(unsigned long long);
+}
+
+/* Read the dot values or indices of count elements at buf into shadow. */
+static void dg_mpi_get_shadow(void const* buf, int count, int elemsize, void* shadow){
+  if(DG_GET_MODE=='d'){
+    DG_GET_DOTVALUE(buf, shadow, count*elemsize);
+  } else {
+    for(int i=0; i<count; i++){
+      DG_GET_INDEX((char const*)buf+i*elemsize, (unsigned long long*)shadow+i);
+    }
+  }
+}
+
+/* Value of an element, for --record-values=yes. */
+static double dg_mpi_value(void const* buf, int i, int elemsize){
+  double value;
+  DG_DISABLE(1,0);
+  value = elemsize==8 ? ((double const*)buf)[i] : ((float const*)buf)[i];
+  DG_DISABLE(0,1);
+  return value;
+}
+
+/* Set the dot values of count received elements at buf, or 
+ * record blocks linking them to the indices of the sender. */
+static void dg_mpi_set_shadow(void* buf, int count, int elemsize, void const* shadow){
+  if(DG_GET_MODE=='d'){
+    DG_SET_DOTVALUE(buf, shadow, count*elemsize);
+  } else {
+    unsigned long long const* remoteindices = (unsigned long long const*)shadow;
+    unsigned long long zeroindex = 0, newindex;
+    double one = 1., zero = 0.;
+    for(int i=0; i<count; i++){
+      double value = dg_mpi_value(buf,i,elemsize);
+      DG_NEW_INDEX_OPCODE(&remoteindices[i], &zeroindex, &one, &zero, &newindex, &value, DG_OPCODE_LINEAR);
+      DG_SET_INDEX((char*)buf+i*elemsize, &newindex);
+    }
+  }
+}
+
+/* Set the dot values or indices of count elements at buf to zero. */
+static void dg_mpi_clear_shadow(void* buf, int count, int elemsize){
+  int shadowsize = dg_mpi_shadowsize(elemsize);
+  void* shadow = calloc(count, shadowsize);
+  if(DG_GET_MODE=='d'){
+    DG_SET_DOTVALUE(buf, shadow, count*elemsize);
+  } else {
+    for(int i=0; i<count; i++){
+      DG_SET_INDEX((char*)buf+i*elemsize, (unsigned long long*)shadow+i);
+    }
+  }
+  free(shadow);
+}
+
+/* --- Communicator creation --- */
+int WRAPPER_FOR(PMPI_Init)(int* argc, char*** argv){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  CALL_FN_W_WW(err, fn, argc,argv);
+  if(err==MPI_SUCCESS) dg_mpi_create_shadow_comm(MPI_COMM_WORLD);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Init_thread)(int* argc, char*** argv, int required, int* provided){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  CALL_FN_W_WWWW(err, fn, argc,argv,required,provided);
+  if(err==MPI_SUCCESS) dg_mpi_create_shadow_comm(MPI_COMM_WORLD);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Comm_dup)(MPI_Comm comm, MPI_Comm* newcomm){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  CALL_FN_W_WW(err, fn, comm,newcomm);
+  if(err==MPI_SUCCESS && !dg_mpi_nested) dg_mpi_create_shadow_comm(*newcomm);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Comm_split)(MPI_Comm comm, int color, int key, MPI_Comm* newcomm){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  CALL_FN_W_WWWW(err, fn, comm,color,key,newcomm);
+  if(err==MPI_SUCCESS && !dg_mpi_nested) dg_mpi_create_shadow_comm(*newcomm);
+  return err;
+}
+
+/* Receive the shadow message of the count elements at buf, which have 
+ * been received from the source and with the tag given in status. */
+static int dg_mpi_recv_shadow(void* buf, int count, int elemsize,
+                              MPI_Status* status, MPI_Comm shadowcomm){
+  int shadowsize = dg_mpi_shadowsize(elemsize);
+  void* shadow = malloc(count*shadowsize);
+  MPI_Status shadow_status;
+  int err, shadowcount;
+  dg_mpi_nested++;
+  err = PMPI_Recv(shadow, count*shadowsize, MPI_BYTE, status->MPI_SOURCE, status->MPI_TAG, shadowcomm, &shadow_status);
+  dg_mpi_nested--;
+  if(err==MPI_SUCCESS){
+    PMPI_Get_count(&shadow_status, MPI_BYTE, &shadowcount);
+    dg_mpi_set_shadow(buf, shadowcount/shadowsize, elemsize, shadow);
+  }
+  free(shadow);
+  return err;
+}
+
+/* Make the elements received at buf passive. */
+static void dg_mpi_clear_received(void* buf, MPI_Datatype datatype, MPI_Status* status){
+  int received;
+  PMPI_Get_count(status, datatype, &received);
+  if(received!=MPI_UNDEFINED) dg_mpi_clear_shadow(buf, received, dg_mpi_elemsize(datatype));
+}
+
+/* Abort instead of silently desynchronising data and shadow messages. */
+static void dg_mpi_unsupported(char const* routine){
+  fprintf(stderr, "Derivgrind MPI wrapper: %s is not differentiated for MPI_DOUBLE "
+                  "and MPI_FLOAT data on this communicator; aborting.\n", routine);
+  PMPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+/* --- Send --- */
+static int generic_Send(void* buf, int count, MPI_Datatype datatype,
+                        int dest, int tag, MPI_Comm comm){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  CALL_FN_W_6W(err, fn, buf,count,datatype,dest,tag,comm);
+  if(err!=MPI_SUCCESS || !dg_mpi_active(datatype)) return err;
+  MPI_Comm shadowcomm = dg_mpi_shadow_comm(comm);
+  if(shadowcomm==MPI_COMM_NULL) return err;
+  int elemsize = dg_mpi_elemsize(datatype);
+  int shadowsize = dg_mpi_shadowsize(elemsize);
+  void* shadow = malloc(count*shadowsize);
+  dg_mpi_get_shadow(buf, count, elemsize, shadow);
+  dg_mpi_nested++;
+  err = PMPI_Send(shadow, count*shadowsize, MPI_BYTE, dest, tag, shadowcomm);
+  dg_mpi_nested--;
+  free(shadow);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Send)(void* buf, int count, MPI_Datatype datatype,
+                           int dest, int tag, MPI_Comm comm){
+  return generic_Send(buf,count,datatype,dest,tag,comm);
+}
+int WRAPPER_FOR(PMPI_Bsend)(void* buf, int count, MPI_Datatype datatype,
+                            int dest, int tag, MPI_Comm comm){
+  return generic_Send(buf,count,datatype,dest,tag,comm);
+}
+int WRAPPER_FOR(PMPI_Ssend)(void* buf, int count, MPI_Datatype datatype,
+                            int dest, int tag, MPI_Comm comm){
+  return generic_Send(buf,count,datatype,dest,tag,comm);
+}
+int WRAPPER_FOR(PMPI_Rsend)(void* buf, int count, MPI_Datatype datatype,
+                            int dest, int tag, MPI_Comm comm){
+  return generic_Send(buf,count,datatype,dest,tag,comm);
+}
+
+/* --- Recv --- */
+int WRAPPER_FOR(PMPI_Recv)(void* buf, int count, MPI_Datatype datatype,
+                           int source, int tag,
+                           MPI_Comm comm, MPI_Status* status){
+  OrigFn fn;
+  int err;
+  MPI_Status fake_status;
+  VALGRIND_GET_ORIG_FN(fn);
+  if(status==MPI_STATUS_IGNORE) status = &fake_status;
+  CALL_FN_W_7W(err, fn, buf,count,datatype,source,tag,comm,status);
+  if(err!=MPI_SUCCESS || !dg_mpi_active(datatype)) return err;
+  MPI_Comm shadowcomm = dg_mpi_shadow_comm(comm);
+  if(shadowcomm==MPI_COMM_NULL){ // not differentiated, received data is passive
+    dg_mpi_clear_received(buf, datatype, status);
+    return err;
+  }
+  // receive the shadow message from the actual source, with the actual tag
+  return dg_mpi_recv_shadow(buf, count, dg_mpi_elemsize(datatype), status, shadowcomm);
+}
+
+/* --- Sendrecv --- */
+/* The shadow of the sent data is sent non-blockingly, so that the shadow
+ * messages of two ranks exchanging data cannot deadlock. */
+static int dg_mpi_sendrecv_shadow(void const* sendshadow, int sendshadowsize, int dest, int sendtag,
+                                  void* recvbuf, int recvcount, MPI_Datatype recvtype,
+                                  MPI_Comm comm, MPI_Status* status){
+  MPI_Comm shadowcomm = dg_mpi_shadow_comm(comm);
+  MPI_Request shadowrequest = MPI_REQUEST_NULL;
+  int err = MPI_SUCCESS;
+  if(sendshadow && shadowcomm!=MPI_COMM_NULL){
+    dg_mpi_nested++;
+    err = PMPI_Isend(sendshadow, sendshadowsize, MPI_BYTE, dest, sendtag, shadowcomm, &shadowrequest);
+    dg_mpi_nested--;
+  }
+  if(err==MPI_SUCCESS && dg_mpi_active(recvtype)){
+    if(shadowcomm==MPI_COMM_NULL) dg_mpi_clear_received(recvbuf, recvtype, status);
+    else err = dg_mpi_recv_shadow(recvbuf, recvcount, dg_mpi_elemsize(recvtype), status, shadowcomm);
+  }
+  if(shadowrequest!=MPI_REQUEST_NULL){
+    dg_mpi_nested++;
+    PMPI_Wait(&shadowrequest, MPI_STATUS_IGNORE);
+    dg_mpi_nested--;
+  }
+  return err;
+}
+
+/* Shadow of count elements at buf if their communication is 
+ * differentiated, or NULL. */
+static void* dg_mpi_send_shadow(void const* buf, int count, MPI_Datatype datatype, MPI_Comm comm){
+  if(!dg_mpi_active(datatype) || dg_mpi_shadow_comm(comm)==MPI_COMM_NULL) return NULL;
+  int elemsize = dg_mpi_elemsize(datatype);
+  void* shadow = malloc(count*dg_mpi_shadowsize(elemsize));
+  dg_mpi_get_shadow(buf, count, elemsize, shadow);
+  return shadow;
+}
+
+int WRAPPER_FOR(PMPI_Sendrecv)(void* sendbuf, int sendcount, MPI_Datatype sendtype,
+                               int dest, int sendtag,
+                               void* recvbuf, int recvcount, MPI_Datatype recvtype,
+                               int source, int recvtag,
+                               MPI_Comm comm, MPI_Status* status){
+  OrigFn fn;
+  int err;
+  MPI_Status fake_status;
+  VALGRIND_GET_ORIG_FN(fn);
+  if(status==MPI_STATUS_IGNORE) status = &fake_status;
+  CALL_FN_W_12W(err, fn, sendbuf,sendcount,sendtype,dest,sendtag,
+                         recvbuf,recvcount,recvtype,source,recvtag,comm,status);
+  if(err!=MPI_SUCCESS) return err;
+  void* sendshadow = dg_mpi_send_shadow(sendbuf, sendcount, sendtype, comm);
+  int sendshadowsize = sendshadow ? sendcount*dg_mpi_shadowsize(dg_mpi_elemsize(sendtype)) : 0;
+  err = dg_mpi_sendrecv_shadow(sendshadow, sendshadowsize, dest, sendtag,
+                               recvbuf, recvcount, recvtype, comm, status);
+  free(sendshadow);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Sendrecv_replace)(void* buf, int count, MPI_Datatype datatype,
+                                       int dest, int sendtag, int source, int recvtag,
+                                       MPI_Comm comm, MPI_Status* status){
+  OrigFn fn;
+  int err;
+  MPI_Status fake_status;
+  VALGRIND_GET_ORIG_FN(fn);
+  if(status==MPI_STATUS_IGNORE) status = &fake_status;
+  // fetch the shadow before buf is overwritten
+  void* sendshadow = dg_mpi_send_shadow(buf, count, datatype, comm);
+  int sendshadowsize = sendshadow ? count*dg_mpi_shadowsize(dg_mpi_elemsize(datatype)) : 0;
+  CALL_FN_W_9W(err, fn, buf,count,datatype,dest,sendtag,source,recvtag,comm,status);
+  if(err==MPI_SUCCESS){
+    err = dg_mpi_sendrecv_shadow(sendshadow, sendshadowsize, dest, sendtag,
+                                 buf, count, datatype, comm, status);
+  }
+  free(sendshadow);
+  return err;
+}
+
+/* --- Non-blocking communication --- */
+/* A non-blocking send or receive of differentiated data that has not been
+ * completed by MPI_Wait, MPI_Test or their variants yet. For sends, the 
+ * shadow message is sent non-blockingly as well. For receives, the 
+ * shadow message is received non-blockingly on the shadow communicator 
+ * with the same source and tag, so that data and shadow messages are 
+ * matched in the same order. */
+typedef struct DgMpiPending {
+  MPI_Request request; // request of the data message
+  MPI_Request shadowrequest; // request of the shadow message
+  void* buf; // receive buffer, NULL for sends
+  int elemsize;
+  void* shadow;
+  struct DgMpiPending* next;
+} DgMpiPending;
+static DgMpiPending* dg_mpi_pending = NULL;
+static pthread_mutex_t dg_mpi_pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void dg_mpi_add_pending(MPI_Request request, MPI_Request shadowrequest,
+                               void* buf, int elemsize, void* shadow){
+  DgMpiPending* p = malloc(sizeof(DgMpiPending));
+  p->request = request;
+  p->shadowrequest = shadowrequest;
+  p->buf = buf;
+  p->elemsize = elemsize;
+  p->shadow = shadow;
+  pthread_mutex_lock(&dg_mpi_pending_mutex);
+  p->next = dg_mpi_pending;
+  dg_mpi_pending = p;
+  pthread_mutex_unlock(&dg_mpi_pending_mutex);
+}
+
+/* Pending operation of the request, or NULL. Must be looked up before the 
+ * request is completed, as MPI then sets it to MPI_REQUEST_NULL. */
+static DgMpiPending* dg_mpi_find_pending(MPI_Request request){
+  DgMpiPending* p = NULL;
+  if(dg_mpi_nested || request==MPI_REQUEST_NULL) return NULL;
+  pthread_mutex_lock(&dg_mpi_pending_mutex);
+  for(p = dg_mpi_pending; p && p->request!=request; p = p->next);
+  pthread_mutex_unlock(&dg_mpi_pending_mutex);
+  return p;
+}
+
+/* Pending operations of an array of requests, or NULL if there are none. */
+static DgMpiPending** dg_mpi_find_pendings(int count, MPI_Request const* requests){
+  DgMpiPending** pendings = NULL;
+  for(int i=0; i<count; i++){
+    DgMpiPending* p = dg_mpi_find_pending(requests[i]);
+    if(p && !pendings) pendings = calloc(count, sizeof(DgMpiPending*));
+    if(p) pendings[i] = p;
+  }
+  return pendings;
+}
+
+/* Finish the pending operation after MPI has completed its data message. */
+static int dg_mpi_complete(DgMpiPending* p, MPI_Status* status){
+  MPI_Status shadow_status;
+  int err, shadowcount;
+  pthread_mutex_lock(&dg_mpi_pending_mutex);
+  DgMpiPending** pp;
+  for(pp = &dg_mpi_pending; *pp!=p; pp = &(*pp)->next);
+  *pp = p->next;
+  pthread_mutex_unlock(&dg_mpi_pending_mutex);
+  if(p->shadowrequest==MPI_REQUEST_NULL){ // not differentiated, received data is passive
+    dg_mpi_clear_received(p->buf, p->elemsize==8 ? MPI_DOUBLE : MPI_FLOAT, status);
+    free(p);
+    return MPI_SUCCESS;
+  }
+  dg_mpi_nested++;
+  err = PMPI_Wait(&p->shadowrequest, &shadow_status);
+  dg_mpi_nested--;
+  if(err==MPI_SUCCESS && p->buf){
+    int shadowsize = dg_mpi_shadowsize(p->elemsize);
+    PMPI_Get_count(&shadow_status, MPI_BYTE, &shadowcount);
+    dg_mpi_set_shadow(p->buf, shadowcount/shadowsize, p->elemsize, p->shadow);
+  }
+  free(p->shadow);
+  free(p);
+  return err;
+}
+
+/* Finish the pending operations of the requests that MPI has completed.
+ * indices lists the completed requests, or is NULL if all are completed. */
+static int dg_mpi_complete_some(DgMpiPending** pendings, int outcount, int const* indices,
+                                MPI_Status* statuses){
+  int err = MPI_SUCCESS;
+  for(int k=0; k<outcount; k++){
+    DgMpiPending* p = pendings[indices ? indices[k] : k];
+    if(p){
+      int suberr = dg_mpi_complete(p, &statuses[k]);
+      if(err==MPI_SUCCESS) err = suberr;
+    }
+  }
+  free(pendings);
+  return err;
+}
+
+static int generic_Isend(void* buf, int count, MPI_Datatype datatype,
+                         int dest, int tag, MPI_Comm comm, MPI_Request* request){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  CALL_FN_W_7W(err, fn, buf,count,datatype,dest,tag,comm,request);
+  if(err!=MPI_SUCCESS) return err;
+  void* shadow = dg_mpi_send_shadow(buf, count, datatype, comm);
+  if(!shadow) return err;
+  MPI_Request shadowrequest;
+  dg_mpi_nested++;
+  err = PMPI_Isend(shadow, count*dg_mpi_shadowsize(dg_mpi_elemsize(datatype)), MPI_BYTE,
+                   dest, tag, dg_mpi_shadow_comm(comm), &shadowrequest);
+  dg_mpi_nested--;
+  if(err==MPI_SUCCESS) dg_mpi_add_pending(*request, shadowrequest, NULL, 0, shadow);
+  else free(shadow);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Isend)(void* buf, int count, MPI_Datatype datatype,
+                            int dest, int tag, MPI_Comm comm, MPI_Request* request){
+  return generic_Isend(buf,count,datatype,dest,tag,comm,request);
+}
+int WRAPPER_FOR(PMPI_Ibsend)(void* buf, int count, MPI_Datatype datatype,
+                             int dest, int tag, MPI_Comm comm, MPI_Request* request){
+  return generic_Isend(buf,count,datatype,dest,tag,comm,request);
+}
+int WRAPPER_FOR(PMPI_Issend)(void* buf, int count, MPI_Datatype datatype,
+                             int dest, int tag, MPI_Comm comm, MPI_Request* request){
+  return generic_Isend(buf,count,datatype,dest,tag,comm,request);
+}
+int WRAPPER_FOR(PMPI_Irsend)(void* buf, int count, MPI_Datatype datatype,
+                             int dest, int tag, MPI_Comm comm, MPI_Request* request){
+  return generic_Isend(buf,count,datatype,dest,tag,comm,request);
+}
+
+int WRAPPER_FOR(PMPI_Irecv)(void* buf, int count, MPI_Datatype datatype,
+                            int source, int tag, MPI_Comm comm, MPI_Request* request){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  int active = dg_mpi_active(datatype);
+  MPI_Comm shadowcomm = active ? dg_mpi_shadow_comm(comm) : MPI_COMM_NULL;
+  // Shadow messages from different sources might arrive in a different 
+  // order than the data, so a wildcard receive cannot be matched in advance.
+  if(shadowcomm!=MPI_COMM_NULL && source==MPI_ANY_SOURCE) 
+    dg_mpi_unsupported("MPI_Irecv from MPI_ANY_SOURCE");
+  CALL_FN_W_7W(err, fn, buf,count,datatype,source,tag,comm,request);
+  if(err!=MPI_SUCCESS || !active) return err;
+  int elemsize = dg_mpi_elemsize(datatype);
+  if(shadowcomm==MPI_COMM_NULL){
+    dg_mpi_add_pending(*request, MPI_REQUEST_NULL, buf, elemsize, NULL);
+    return err;
+  }
+  int shadowsize = dg_mpi_shadowsize(elemsize);
+  void* shadow = malloc(count*shadowsize);
+  MPI_Request shadowrequest;
+  dg_mpi_nested++;
+  err = PMPI_Irecv(shadow, count*shadowsize, MPI_BYTE, source, tag, shadowcomm, &shadowrequest);
+  dg_mpi_nested--;
+  if(err==MPI_SUCCESS) dg_mpi_add_pending(*request, shadowrequest, buf, elemsize, shadow);
+  else free(shadow);
+  return err;
+}
+
+/* Persistent requests and matched receives would transfer data without 
+ * shadow messages. */
+static void dg_mpi_check_persistent(char const* routine, MPI_Datatype datatype, MPI_Comm comm){
+  if(dg_mpi_active(datatype) && dg_mpi_shadow_comm(comm)!=MPI_COMM_NULL)
+    dg_mpi_unsupported(routine);
+}
+#define PERSISTENT_WRAPPER(name,routine) \
+  int WRAPPER_FOR(name)(void* buf, int count, MPI_Datatype datatype, \
+                        int rank, int tag, MPI_Comm comm, MPI_Request* request){ \
+    OrigFn fn; \
+    int err; \
+    VALGRIND_GET_ORIG_FN(fn); \
+    dg_mpi_check_persistent(routine, datatype, comm); \
+    CALL_FN_W_7W(err, fn, buf,count,datatype,rank,tag,comm,request); \
+    return err; \
+  }
+PERSISTENT_WRAPPER(PMPI_Send_init,"MPI_Send_init")
+PERSISTENT_WRAPPER(PMPI_Bsend_init,"MPI_Bsend_init")
+PERSISTENT_WRAPPER(PMPI_Ssend_init,"MPI_Ssend_init")
+PERSISTENT_WRAPPER(PMPI_Rsend_init,"MPI_Rsend_init")
+PERSISTENT_WRAPPER(PMPI_Recv_init,"MPI_Recv_init")
+
+#if MPI_VERSION >= 3
+/* The communicator of a matched message is not known here. */
+int WRAPPER_FOR(PMPI_Mrecv)(void* buf, int count, MPI_Datatype datatype,
+                            MPI_Message* message, MPI_Status* status){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  if(dg_mpi_active(datatype) && dg_mpi_keyval!=MPI_KEYVAL_INVALID) dg_mpi_unsupported("MPI_Mrecv");
+  CALL_FN_W_5W(err, fn, buf,count,datatype,message,status);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Imrecv)(void* buf, int count, MPI_Datatype datatype,
+                             MPI_Message* message, MPI_Request* request){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  if(dg_mpi_active(datatype) && dg_mpi_keyval!=MPI_KEYVAL_INVALID) dg_mpi_unsupported("MPI_Imrecv");
+  CALL_FN_W_5W(err, fn, buf,count,datatype,message,request);
+  return err;
+}
+#endif
+
+/* --- Completion of non-blocking communication --- */
+int WRAPPER_FOR(PMPI_Wait)(MPI_Request* request, MPI_Status* status){
+  OrigFn fn;
+  int err;
+  MPI_Status fake_status;
+  VALGRIND_GET_ORIG_FN(fn);
+  DgMpiPending* p = dg_mpi_find_pending(*request);
+  if(status==MPI_STATUS_IGNORE) status = &fake_status;
+  CALL_FN_W_WW(err, fn, request,status);
+  if(err==MPI_SUCCESS && p) err = dg_mpi_complete(p, status);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Test)(MPI_Request* request, int* flag, MPI_Status* status){
+  OrigFn fn;
+  int err;
+  MPI_Status fake_status;
+  VALGRIND_GET_ORIG_FN(fn);
+  DgMpiPending* p = dg_mpi_find_pending(*request);
+  if(status==MPI_STATUS_IGNORE) status = &fake_status;
+  CALL_FN_W_WWW(err, fn, request,flag,status);
+  if(err==MPI_SUCCESS && *flag && p) err = dg_mpi_complete(p, status);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Waitall)(int count, MPI_Request* requests, MPI_Status* statuses){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  DgMpiPending** pendings = dg_mpi_find_pendings(count, requests);
+  if(!pendings){
+    CALL_FN_W_WWW(err, fn, count,requests,statuses);
+    return err;
+  }
+  MPI_Status* fake_statuses = statuses==MPI_STATUSES_IGNORE ? malloc(count*sizeof(MPI_Status)) : NULL;
+  if(fake_statuses) statuses = fake_statuses;
+  CALL_FN_W_WWW(err, fn, count,requests,statuses);
+  if(err==MPI_SUCCESS) err = dg_mpi_complete_some(pendings, count, NULL, statuses);
+  else free(pendings);
+  free(fake_statuses);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Testall)(int count, MPI_Request* requests, int* flag, MPI_Status* statuses){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  DgMpiPending** pendings = dg_mpi_find_pendings(count, requests);
+  if(!pendings){
+    CALL_FN_W_WWWW(err, fn, count,requests,flag,statuses);
+    return err;
+  }
+  MPI_Status* fake_statuses = statuses==MPI_STATUSES_IGNORE ? malloc(count*sizeof(MPI_Status)) : NULL;
+  if(fake_statuses) statuses = fake_statuses;
+  CALL_FN_W_WWWW(err, fn, count,requests,flag,statuses);
+  if(err==MPI_SUCCESS && *flag) err = dg_mpi_complete_some(pendings, count, NULL, statuses);
+  else free(pendings);
+  free(fake_statuses);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Waitany)(int count, MPI_Request* requests, int* index, MPI_Status* status){
+  OrigFn fn;
+  int err;
+  MPI_Status fake_status;
+  VALGRIND_GET_ORIG_FN(fn);
+  DgMpiPending** pendings = dg_mpi_find_pendings(count, requests);
+  if(status==MPI_STATUS_IGNORE) status = &fake_status;
+  CALL_FN_W_WWWW(err, fn, count,requests,index,status);
+  if(pendings){
+    if(err==MPI_SUCCESS && *index!=MPI_UNDEFINED) err = dg_mpi_complete_some(pendings, 1, index, status);
+    else free(pendings);
+  }
+  return err;
+}
+int WRAPPER_FOR(PMPI_Testany)(int count, MPI_Request* requests, int* index, int* flag, MPI_Status* status){
+  OrigFn fn;
+  int err;
+  MPI_Status fake_status;
+  VALGRIND_GET_ORIG_FN(fn);
+  DgMpiPending** pendings = dg_mpi_find_pendings(count, requests);
+  if(status==MPI_STATUS_IGNORE) status = &fake_status;
+  CALL_FN_W_5W(err, fn, count,requests,index,flag,status);
+  if(pendings){
+    if(err==MPI_SUCCESS && *flag && *index!=MPI_UNDEFINED) err = dg_mpi_complete_some(pendings, 1, index, status);
+    else free(pendings);
+  }
+  return err;
+}
+static int generic_Waitsome(int incount, MPI_Request* requests, int* outcount,
+                            int* indices, MPI_Status* statuses){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  DgMpiPending** pendings = dg_mpi_find_pendings(incount, requests);
+  if(!pendings){
+    CALL_FN_W_5W(err, fn, incount,requests,outcount,indices,statuses);
+    return err;
+  }
+  MPI_Status* fake_statuses = statuses==MPI_STATUSES_IGNORE ? malloc(incount*sizeof(MPI_Status)) : NULL;
+  if(fake_statuses) statuses = fake_statuses;
+  CALL_FN_W_5W(err, fn, incount,requests,outcount,indices,statuses);
+  if(err==MPI_SUCCESS && *outcount!=MPI_UNDEFINED) err = dg_mpi_complete_some(pendings, *outcount, indices, statuses);
+  else free(pendings);
+  free(fake_statuses);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Waitsome)(int incount, MPI_Request* requests, int* outcount,
+                               int* indices, MPI_Status* statuses){
+  return generic_Waitsome(incount,requests,outcount,indices,statuses);
+}
+int WRAPPER_FOR(PMPI_Testsome)(int incount, MPI_Request* requests, int* outcount,
+                               int* indices, MPI_Status* statuses){
+  return generic_Waitsome(incount,requests,outcount,indices,statuses);
+}
+
+/* The shadow message of a freed or cancelled request could not be 
+ * completed consistently. */
+int WRAPPER_FOR(PMPI_Request_free)(MPI_Request* request){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  if(dg_mpi_find_pending(*request)) dg_mpi_unsupported("MPI_Request_free");
+  CALL_FN_W_W(err, fn, request);
+  return err;
+}
+int WRAPPER_FOR(PMPI_Cancel)(MPI_Request* request){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  if(dg_mpi_find_pending(*request)) dg_mpi_unsupported("MPI_Cancel");
+  CALL_FN_W_W(err, fn, request);
+  return err;
+}
+
+/* --- Allreduce --- */
+int WRAPPER_FOR(PMPI_Allreduce)(void* sendbuf, void* recvbuf, int count,
+                                MPI_Datatype datatype, MPI_Op op,
+                                MPI_Comm comm){
+  OrigFn fn;
+  int err;
+  VALGRIND_GET_ORIG_FN(fn);
+  if(!dg_mpi_active(datatype)){
+    CALL_FN_W_6W(err, fn, sendbuf,recvbuf,count,datatype,op,comm);
+    return err;
+  }
+  int elemsize = dg_mpi_elemsize(datatype);
+  int shadowsize = dg_mpi_shadowsize(elemsize);
+  // fetch the shadow before recvbuf is overwritten
+  void* shadow = malloc(count*shadowsize);
+  dg_mpi_get_shadow(sendbuf==MPI_IN_PLACE ? recvbuf : sendbuf, count, elemsize, shadow);
+  CALL_FN_W_6W(err, fn, sendbuf,recvbuf,count,datatype,op,comm);
+  if(err!=MPI_SUCCESS){ free(shadow); return err; }
+  if(op!=MPI_SUM){
+    static int warned = 0;
+    if(!warned){
+      fprintf(stderr, "Derivgrind MPI wrapper: MPI_Allreduce is only differentiated for MPI_SUM; "
+                      "treating results of other reduction operations as constants.\n");
+      warned = 1;
+    }
+    dg_mpi_clear_shadow(recvbuf, count, elemsize);
+    free(shadow);
+    return err;
+  }
+  dg_mpi_nested++;
+  if(DG_GET_MODE=='d'){
+    // dot values are summed up like the values
+    void* dotsum = malloc(count*elemsize);
+    err = PMPI_Allreduce(shadow, dotsum, count, datatype, MPI_SUM, comm);
+    if(err==MPI_SUCCESS) DG_SET_DOTVALUE(recvbuf, dotsum, count*elemsize);
+    free(dotsum);
+  } else {
+    // gather indices of all ranks and record their sum
+    int size;
+    PMPI_Comm_size(comm, &size);
+    unsigned long long* indices = malloc((size_t)size*count*sizeof(unsigned long long));
+    err = PMPI_Allgather(shadow, count, MPI_UNSIGNED_LONG_LONG, indices, count, MPI_UNSIGNED_LONG_LONG, comm);
+    if(err==MPI_SUCCESS){
+      double one = 1.;
+      for(int i=0; i<count; i++){
+        double value = dg_mpi_value(recvbuf,i,elemsize);
+        unsigned long long sumindex = indices[i];
+        for(int r=1; r<size; r++){
+          DG_NEW_INDEX_OPCODE(&sumindex, &indices[(size_t)r*count+i], &one, &one, &sumindex, &value, DG_OPCODE_LINEAR);
+        }
+        DG_SET_INDEX((char*)recvbuf+i*elemsize, &sumindex);
+      }
+    }
+    free(indices);
+  }
+  dg_mpi_nested--;
+  free(shadow);
+  return err;
+}
@@ -74,6 +74,10 @@ import subprocess
 # differentiable inputs. The third argument (here 1) specifies the number
 # of expected outputs.
 #
+# If x is a two-dimensional tensor, each of its rows is a separate input
+# vector of a mini-batch. The function is called for all of them in a single
+# Derivgrind process, and y has one row of outputs per input vector.
+#
 # The signature of myfun must be
 #
 #     void myfun(int, char*, int, fptype const*, int, fptype*)
@@ -113,6 +117,14 @@ def derivgrind(library,functionname,arch='amd64'):
       else:
         raise Exception("Unhandled TensorFlow tensor type.")
 
+      # float32 partial derivatives are precise enough for float32 inputs, and shrink the tape by a quarter
+      tapepartials = ["--tape-partials=f32"] if fptype=="float" else []
+
+      # rows of a two-dimensional input are evaluated as a batch
+      input_np = input.numpy()
+      batch = input_np.shape[0] if input_np.ndim==2 else 1
+      ninput = input_np.size // batch
+
       tempdir = tempfile.TemporaryDirectory()
 #      os.mkfifo(tempdir.name+"/dg-libcaller-params")
 #      os.mkfifo(tempdir.name+"/dg-libcaller-inputs")
@@ -123,19 +135,24 @@ def derivgrind(library,functionname,arch='amd64'):
       with open(tempdir.name+"/dg-libcaller-params", "wb") as param_buf:
         param_buf.write(params)
       with open(tempdir.name+"/dg-libcaller-inputs", "wb") as input_buf:
-        input.numpy().tofile(input_buf)
+        input_np.tofile(input_buf)
 
-      forward_process = subprocess.run([bin_path+"/valgrind", "--quiet", "--tool=derivgrind", "--record="+tempdir.name, libexec_path+"/valgrind/derivgrind-library-caller-"+arch+"_linux", library, functionname, fptype, str(len(params)), str(len(input.numpy())), str(noutput), tempdir.name])
+      forward_process = subprocess.run([bin_path+"/valgrind", "--quiet", "--tool=derivgrind", "--record="+tempdir.name]+tapepartials+[libexec_path+"/valgrind/derivgrind-library-caller-"+arch+"_linux", library, functionname, fptype, str(len(params)), str(ninput), str(noutput), tempdir.name, str(batch)])
       
       with open(tempdir.name+"/dg-libcaller-outputs",'rb') as output_buf:
-        output = tf.Variable(np.fromfile(output_buf, dtype=input.numpy().dtype, count=noutput))
+        output_np = np.fromfile(output_buf, dtype=input_np.dtype, count=batch*noutput)
+      if input_np.ndim==2:
+        output_np = output_np.reshape(batch,noutput)
+      output = tf.Variable(output_np)
       with open(tempdir.name+"/dg-tape",'rb') as tape_buf:
         ctx_tape = tape_buf.read()
+      with open(tempdir.name+"/dg-tape-format",'rb') as tapeformat_buf:
+        ctx_tapeformat = tapeformat_buf.read()
       with open(tempdir.name+"/dg-input-indices",'rb') as inputindices_buf:
         ctx_inputindices = inputindices_buf.read()
       with open(tempdir.name+"/dg-output-indices",'rb') as outputindices_buf:
         ctx_outputindices = outputindices_buf.read()
-      ctx_ninput = len(input.numpy())
+      ctx_inputshape = input_np.shape
 
       def grad(grad_output):
         tempdir = tempfile.TemporaryDirectory()
@@ -146,21 +163,23 @@ def derivgrind(library,functionname,arch='amd64'):
 #       os.mkfifo(tempdir.name+"/dg-output-bars")
         with open(tempdir.name+"/dg-tape","wb") as tape_buf:
           tape_buf.write(ctx_tape)
+        with open(tempdir.name+"/dg-tape-format","wb") as tapeformat_buf:
+          tapeformat_buf.write(ctx_tapeformat)
         with open(tempdir.name+"/dg-input-indices","wb") as inputindices_buf:
           inputindices_buf.write(ctx_inputindices)
         with open(tempdir.name+"/dg-output-indices","wb") as outputindices_buf:
           outputindices_buf.write(ctx_outputindices)
         
         with open(tempdir.name+"/dg-output-bars","w") as outputbars_buf:
-          outputbars_buf.writelines([str(float(bar))+"\n" for bar in grad_output])
+          outputbars_buf.writelines([str(float(bar))+"\n" for bar in grad_output.numpy().flatten()])
 
         backward_process = subprocess.run([bin_path+"/tape-evaluation", tempdir.name])
 
-        grad_input_np = np.empty(ctx_ninput,dtype=grad_output.numpy().dtype)
+        grad_input_np = np.empty(int(np.prod(ctx_inputshape)),dtype=grad_output.numpy().dtype)
         with open(tempdir.name+"/dg-input-bars","r") as inputbars_buf:
-          for i in range(ctx_ninput):
+          for i in range(grad_input_np.size):
             grad_input_np[i] = float( inputbars_buf.readline().strip() )
-        grad_input = tf.Variable(grad_input_np)
+        grad_input = tf.Variable(grad_input_np.reshape(ctx_inputshape))
           
         return (None,grad_input,None)
 